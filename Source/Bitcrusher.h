@@ -0,0 +1,164 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * Bit depth and sample rate reduction for the effects chain
+ *
+ * Each channel keeps its own hold sample and decimation phase, so both sides
+ * step at exactly the same moments whatever the block sizes. The rate
+ * reduction is fractional: a phase accumulator decides when to take a new
+ * sample, so sweeping CRUSH moves smoothly instead of in whole-sample steps.
+ *
+ * Quantising and the wet/dry mix happen in one pass over the block, with no
+ * dry copy. Without rate reduction the loop is branch-free so the compiler
+ * vectorises it. Optional TPDF dither trades the quantiser's harmonic
+ * distortion for a noise floor.
+ *
+ * Setters and process() belong to the audio thread.
+ */
+class Bitcrusher
+{
+public:
+    Bitcrusher() = default;
+
+    void prepare (const juce::dsp::ProcessSpec& spec)
+    {
+        jassert (spec.numChannels <= maxChannels);
+        juce::ignoreUnused (spec);
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& held : holdSample)  held = 0.0f;
+        for (auto& phase : holdPhase)  phase = 1.0f;  // Take a fresh sample straight away
+
+        ditherPosition = 0;
+        currentMix = targetMix;
+    }
+
+    // 1 to 16 bits - applied from the next block
+    void setBitDepth (float bits)
+    {
+        auto levels = std::exp2 (juce::jlimit (1.0f, 16.0f, bits));
+        quantiseScale = levels * 0.5f;  // Audio range is -1.0 to +1.0
+        quantiseStep = 1.0f / quantiseScale;
+    }
+
+    // 1 = full rate, 32 = one new sample every 32 - fractional factors are fine
+    void setDownsampleFactor (float factor)
+    {
+        holdIncrement = 1.0f / juce::jlimit (1.0f, 32.0f, factor);
+    }
+
+    // Reached by the end of the next block
+    void setMix (float mix)                     { targetMix = juce::jlimit (0.0f, 1.0f, mix); }
+    void setDitherEnabled (bool shouldDither)   { ditherEnabled = shouldDither; }
+
+    void process (const juce::dsp::AudioBlock<float>& block)
+    {
+        auto numChannels = juce::jmin (block.getNumChannels(), maxChannels);
+        auto numSamples = static_cast<int> (block.getNumSamples());
+
+        auto mixStep = (targetMix - currentMix) / static_cast<float> (juce::jmax (1, numSamples));
+
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            auto* data = block.getChannelPointer (ch);
+
+            // Channels get differently seeded dither so it doesn't image in the centre
+            auto ditherSeed = ditherPosition + static_cast<juce::uint32> (ch) * 0x9e3779b9u;
+
+            if (holdIncrement >= 1.0f)
+                processFullRate (data, numSamples, ditherSeed, mixStep);
+            else
+                processDecimated (data, numSamples, ch, ditherSeed, mixStep);
+        }
+
+        ditherPosition += static_cast<juce::uint32> (numSamples);
+        currentMix = targetMix;
+    }
+
+private:
+    //==============================================================================
+    // No rate reduction: every sample is quantised, so there's no state to carry
+    void processFullRate (float* data, int numSamples, juce::uint32 ditherSeed, float mixStep)
+    {
+        auto scale = quantiseScale, step = quantiseStep, mix = currentMix;
+        auto ditherAmount = ditherEnabled ? 1.0f : 0.0f;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto dry = data[i];
+            auto crushed = quantise (dry, scale, step, ditherAmount * getDither (ditherSeed + static_cast<juce::uint32> (i)));
+            data[i] = dry + (mix + mixStep * static_cast<float> (i)) * (crushed - dry);
+        }
+    }
+
+    void processDecimated (float* data, int numSamples, size_t channel, juce::uint32 ditherSeed, float mixStep)
+    {
+        auto held = holdSample[channel];
+        auto phase = holdPhase[channel];
+        auto ditherAmount = ditherEnabled ? 1.0f : 0.0f;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto dry = data[i];
+
+            if (phase >= 1.0f)
+            {
+                phase -= 1.0f;
+                held = quantise (dry, quantiseScale, quantiseStep,
+                                 ditherAmount * getDither (ditherSeed + static_cast<juce::uint32> (i)));
+            }
+
+            phase += holdIncrement;
+            data[i] = dry + (currentMix + mixStep * static_cast<float> (i)) * (held - dry);
+        }
+
+        holdSample[channel] = held;
+        holdPhase[channel] = phase;
+    }
+
+    // Floors to the grid like the original crusher, dither measured in steps
+    static float quantise (float x, float scale, float step, float dither)
+    {
+        auto scaled = x * scale + dither;
+
+        // floor() via truncation and an integer correction, which the compiler vectorises
+        auto floored = static_cast<int> (scaled);
+        floored -= static_cast<float> (floored) > scaled ? 1 : 0;
+
+        return juce::jlimit (-1.0f, 1.0f, static_cast<float> (floored) * step);
+    }
+
+    // Triangular (TPDF) dither between -1 and +1 steps, hashed from the sample position so
+    // it needs no generator state and vectorises
+    static float getDither (juce::uint32 position)
+    {
+        auto hash = position * 0x9e3779b1u;
+        hash ^= hash >> 15;
+        hash *= 0x85ebca77u;
+        hash ^= hash >> 13;
+
+        auto a = static_cast<float> (static_cast<int> (hash & 0xffffu));
+        auto b = static_cast<float> (static_cast<int> (hash >> 16));
+        return (a - b) * (1.0f / 65536.0f);
+    }
+
+    //==============================================================================
+    static constexpr size_t maxChannels = 2;
+
+    float holdSample[maxChannels] = {};
+    float holdPhase[maxChannels] = {};
+    juce::uint32 ditherPosition = 0;
+
+    float quantiseScale = 32768.0f, quantiseStep = 1.0f / 32768.0f;
+    float holdIncrement = 1.0f;
+    float currentMix = 0.0f, targetMix = 0.0f;
+    bool ditherEnabled = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Bitcrusher)
+};
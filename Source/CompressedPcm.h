@@ -0,0 +1,428 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if JUCE_MSVC
+ #include <intrin.h>
+#endif
+
+//==============================================================================
+/**
+ * Decoded audio held as compressed integer PCM, for the decoded track cache
+ *
+ * Samples are rounded to 24 (or 16) bits and coded in 4096-frame blocks, each
+ * standing on its own: unused low bits dropped, left/side stereo where that's
+ * smaller, a fixed first- or second-order predictor and Rice-coded residuals.
+ * A table of block offsets means any block decodes without the ones before it.
+ *
+ * Lossless for 16- and 24-bit files. Lossy decodes get rounded to the chosen
+ * depth, which at 24 bits is far below their own coding noise.
+ */
+class CompressedPcm
+{
+public:
+    static constexpr int blockSize = 4096;
+
+    CompressedPcm (int numChannelsToStore, int bitDepthToUse)
+        : numChannels (numChannelsToStore),
+          bitDepth (bitDepthToUse),
+          scale (static_cast<float> (1 << (bitDepthToUse - 1))),
+          values (static_cast<size_t> (numChannelsToStore) * blockSize),
+          residuals (blockSize),
+          sideValues (blockSize)
+    {
+        jassert (numChannels > 0);
+        jassert (bitDepth == 16 || bitDepth == 24);
+    }
+
+    // Blocks go in order, each blockSize long apart from the last one
+    void appendBlock (const float* const* channels, int numSamplesInBlock)
+    {
+        jassert (numSamplesInBlock > 0 && numSamplesInBlock <= blockSize);
+        jassert (numSamples % blockSize == 0);  // Nothing after a short block
+
+        blockOffsets.push_back (static_cast<uint32_t> (data.size()));
+
+        // Anything past +-16 is broken audio anyway, and the limit keeps every residual inside 32 bits
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* dest = values.data() + ch * blockSize;
+
+            for (int i = 0; i < numSamplesInBlock; ++i)
+                dest[i] = juce::roundToInt (juce::jlimit (-16.0f, 16.0f, channels[ch][i]) * scale);
+        }
+
+        // Right minus left is usually much smaller than right on its own
+        bool useSide = false;
+
+        if (numChannels == 2)
+        {
+            const auto* left = values.data();
+            const auto* right = left + blockSize;
+
+            for (int i = 0; i < numSamplesInBlock; ++i)
+                sideValues[static_cast<size_t> (i)] = right[i] - left[i];
+
+            useSide = lowestResidualSum (sideValues.data(), numSamplesInBlock)
+                        < lowestResidualSum (right, numSamplesInBlock);
+        }
+
+        writeBits (useSide ? 1u : 0u, 8);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            encodeChannel (ch == 1 && useSide ? sideValues.data() : values.data() + ch * blockSize, numSamplesInBlock);
+
+        // Byte-align so every block starts at its offset
+        if (bitCount > 0)
+            writeBits (0, 8 - bitCount);
+
+        numSamples += numSamplesInBlock;
+    }
+
+    // Call once the last block is in: drops the encoder's scratch space and spare capacity
+    void finishEncoding()
+    {
+        // The decoder loads eight bytes at a time and can run up to fifteen past where it needs to
+        data.insert (data.end(), 16, 0);
+        data.shrink_to_fit();
+        blockOffsets.shrink_to_fit();
+
+        std::vector<int32_t>().swap (values);
+        std::vector<uint32_t>().swap (residuals);
+        std::vector<int32_t>().swap (sideValues);
+    }
+
+    int getNumChannels() const noexcept  { return numChannels; }
+    int getNumSamples() const noexcept   { return numSamples; }
+    int getBitDepth() const noexcept     { return bitDepth; }
+    int getNumBlocks() const noexcept    { return static_cast<int> (blockOffsets.size()); }
+
+    int getBlockLength (int blockIndex) const noexcept
+    {
+        return juce::jmin (blockSize, numSamples - blockIndex * blockSize);
+    }
+
+    size_t getSizeInBytes() const noexcept
+    {
+        return data.capacity() + blockOffsets.capacity() * sizeof (uint32_t)
+                 + (values.capacity() + sideValues.capacity()) * sizeof (int32_t)
+                 + residuals.capacity() * sizeof (uint32_t);
+    }
+
+    //==============================================================================
+    /**
+     * Decodes one block at a time into float audio
+     *
+     * Holds its own scratch space and the last block it decoded, so it never
+     * allocates after construction and is fine on the audio thread. One per
+     * reader - the CompressedPcm itself is only read, so any number can share it.
+     */
+    class BlockDecoder
+    {
+    public:
+        explicit BlockDecoder (const CompressedPcm& source)
+            : pcm (source),
+              block (source.numChannels, blockSize),
+              values (static_cast<size_t> (source.numChannels) * blockSize)
+        {
+        }
+
+        // The decoded block, getBlockLength (blockIndex) samples long. Valid until the next call.
+        const juce::AudioBuffer<float>& decode (int blockIndex)
+        {
+            jassert (juce::isPositiveAndBelow (blockIndex, pcm.getNumBlocks()));
+
+            if (blockIndex != decodedBlock)
+            {
+                pcm.decodeBlock (blockIndex, values.data(), block);
+                decodedBlock = blockIndex;
+            }
+
+            return block;
+        }
+
+    private:
+        const CompressedPcm& pcm;
+        juce::AudioBuffer<float> block;
+        std::vector<int32_t> values;
+        int decodedBlock = -1;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BlockDecoder)
+    };
+
+private:
+    //==============================================================================
+    static constexpr int maxOrder = 2;
+    static constexpr uint32_t escapeQuotient = 24;  // Unary codes this long are followed by the raw 32-bit value
+
+    // Residual of a fixed polynomial predictor, using whatever history the block has so far
+    static int32_t residualAt (const int32_t* x, int i, int order) noexcept
+    {
+        if (order == 0 || i == 0)   return x[i];
+        if (order == 1 || i == 1)   return x[i] - x[i - 1];
+        return x[i] - 2 * x[i - 1] + x[i - 2];
+    }
+
+    static uint64_t residualSum (const int32_t* x, int n, int order) noexcept
+    {
+        uint64_t sum = 0;
+
+        for (int i = 0; i < n; ++i)
+            sum += static_cast<uint64_t> (std::abs (static_cast<int64_t> (residualAt (x, i, order))));
+
+        return sum;
+    }
+
+    static uint64_t lowestResidualSum (const int32_t* x, int n) noexcept
+    {
+        return juce::jmin (residualSum (x, n, 0), residualSum (x, n, 1), residualSum (x, n, 2));
+    }
+
+    static uint32_t zigZag (int32_t v) noexcept    { return (static_cast<uint32_t> (v) << 1) ^ static_cast<uint32_t> (v >> 31); }
+    static int32_t unZigZag (uint32_t u) noexcept  { return static_cast<int32_t> (u >> 1) ^ -static_cast<int32_t> (u & 1); }
+
+    void encodeChannel (const int32_t* x, int n)
+    {
+        // Low bits that are zero in every sample, e.g. a 16-bit file stored at 24 bits
+        uint32_t allBits = 0;
+
+        for (int i = 0; i < n; ++i)
+            allBits |= static_cast<uint32_t> (x[i]);
+
+        int shift = 0;
+
+        if (allBits != 0)
+            while (((allBits >> shift) & 1) == 0)
+                ++shift;
+
+        int order = 0;
+        uint64_t bestSum = std::numeric_limits<uint64_t>::max();
+
+        for (int o = 0; o <= maxOrder; ++o)
+        {
+            auto sum = residualSum (x, n, o);
+
+            if (sum < bestSum)
+            {
+                bestSum = sum;
+                order = o;
+            }
+        }
+
+        uint64_t codeSum = 0;
+
+        for (int i = 0; i < n; ++i)
+        {
+            residuals[static_cast<size_t> (i)] = zigZag (residualAt (x, i, order) >> shift);
+            codeSum += residuals[static_cast<size_t> (i)];
+        }
+
+        // Rice parameter near log2 of the mean, then whichever neighbour codes smallest
+        int k = 0;
+
+        while (k < 30 && (static_cast<uint64_t> (n) << (k + 1)) <= codeSum)
+            ++k;
+
+        auto bestK = k;
+        auto bestBits = riceBits (n, k);
+
+        for (auto candidate : { k - 1, k + 1 })
+        {
+            if (candidate < 0 || candidate > 30)
+                continue;
+
+            auto bits = riceBits (n, candidate);
+
+            if (bits < bestBits)
+            {
+                bestBits = bits;
+                bestK = candidate;
+            }
+        }
+
+        writeBits (static_cast<uint32_t> (order | (shift << 2)), 8);
+        writeBits (static_cast<uint32_t> (bestK), 8);
+
+        for (int i = 0; i < n; ++i)
+            writeRice (residuals[static_cast<size_t> (i)], bestK);
+    }
+
+    uint64_t riceBits (int n, int k) const noexcept
+    {
+        uint64_t bits = static_cast<uint64_t> (n) * static_cast<uint64_t> (k + 1);
+
+        for (int i = 0; i < n; ++i)
+        {
+            auto quotient = residuals[static_cast<size_t> (i)] >> k;
+            bits += quotient < escapeQuotient ? quotient : escapeQuotient + 32 - static_cast<uint64_t> (k);
+        }
+
+        return bits;
+    }
+
+    void writeRice (uint32_t value, int k)
+    {
+        auto quotient = value >> k;
+
+        if (quotient >= escapeQuotient)
+        {
+            writeBits (1, static_cast<int> (escapeQuotient) + 1);
+            writeBits (value, 32);
+            return;
+        }
+
+        // Quotient as that many zeros and a one, then the low k bits
+        writeBits (1, static_cast<int> (quotient) + 1);
+
+        if (k > 0)
+            writeBits (value & ((1u << k) - 1), k);
+    }
+
+    void writeBits (uint32_t value, int numBits)
+    {
+        jassert (numBits > 0 && numBits <= 32);
+
+        bitBuffer = (bitBuffer << numBits) | value;
+        bitCount += numBits;
+
+        while (bitCount >= 8)
+        {
+            bitCount -= 8;
+            data.push_back (static_cast<uint8_t> (bitBuffer >> bitCount));
+        }
+    }
+
+    //==============================================================================
+    class BitReader
+    {
+    public:
+        explicit BitReader (const uint8_t* start) noexcept : next (start) {}
+
+        uint32_t readBits (int numBits) noexcept
+        {
+            refill();
+            auto value = static_cast<uint32_t> (cache >> (64 - numBits));
+            cache <<= numBits;
+            available -= numBits;
+            return value;
+        }
+
+        uint32_t readRice (int k) noexcept
+        {
+            refill();
+
+            // At least 56 bits are loaded, and a valid code has its one within the first 25
+            auto zeros = countLeadingZeros (cache);
+            cache <<= zeros + 1;
+            available -= zeros + 1;
+
+            if (static_cast<uint32_t> (zeros) >= escapeQuotient)
+                return readBits (32);
+
+            auto value = static_cast<uint32_t> (zeros) << k;
+            return k > 0 ? value | readBits (k) : value;
+        }
+
+    private:
+        // Tops the cache up to at least 56 bits with one unaligned load and no loop
+        void refill() noexcept
+        {
+            cache |= juce::ByteOrder::bigEndianInt64 (next) >> available;
+            next += (63 - available) >> 3;
+            available |= 56;
+        }
+
+        static int countLeadingZeros (uint64_t v) noexcept
+        {
+            jassert (v != 0);
+           #if JUCE_MSVC
+            unsigned long index;
+            _BitScanReverse64 (&index, v);
+            return 63 - static_cast<int> (index);
+           #else
+            return __builtin_clzll (v);
+           #endif
+        }
+
+        const uint8_t* next;
+        uint64_t cache = 0;
+        int available = 0;
+    };
+
+    // scratch holds numChannels * blockSize integers
+    void decodeBlock (int blockIndex, int32_t* scratch, juce::AudioBuffer<float>& destination) const
+    {
+        auto n = getBlockLength (blockIndex);
+        BitReader reader (data.data() + blockOffsets[static_cast<size_t> (blockIndex)]);
+
+        auto useSide = reader.readBits (8) != 0;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto header = static_cast<int> (reader.readBits (8));
+            auto order = header & 3;
+            auto shift = header >> 2;
+            auto k = static_cast<int> (reader.readBits (8));
+            auto* x = scratch + ch * blockSize;
+
+            // Undo the predictor in the shifted domain, then restore the dropped bits
+            auto warmUp = juce::jmin (order, n);
+
+            for (int i = 0; i < warmUp; ++i)
+                x[i] = unZigZag (reader.readRice (k)) + (i > 0 ? x[i - 1] : 0);
+
+            if (order == 0)
+                for (int i = warmUp; i < n; ++i)
+                    x[i] = unZigZag (reader.readRice (k));
+            else if (order == 1)
+                for (int i = warmUp; i < n; ++i)
+                    x[i] = unZigZag (reader.readRice (k)) + x[i - 1];
+            else
+                for (int i = warmUp; i < n; ++i)
+                    x[i] = unZigZag (reader.readRice (k)) + 2 * x[i - 1] - x[i - 2];
+
+            if (shift > 0)
+                for (int i = 0; i < n; ++i)
+                    x[i] = static_cast<int32_t> (static_cast<uint32_t> (x[i]) << shift);
+        }
+
+        if (useSide)
+        {
+            auto* right = scratch + blockSize;
+
+            for (int i = 0; i < n; ++i)
+                right[i] += scratch[i];
+        }
+
+        auto inverseScale = 1.0f / scale;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            const auto* x = scratch + ch * blockSize;
+            auto* dest = destination.getWritePointer (ch);
+
+            for (int i = 0; i < n; ++i)
+                dest[i] = static_cast<float> (x[i]) * inverseScale;
+        }
+    }
+
+    //==============================================================================
+    int numChannels, bitDepth;
+    float scale;
+    int numSamples = 0;
+
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> blockOffsets;  // Seek table: where each block starts in data
+
+    // Encoder only
+    std::vector<int32_t> values;
+    std::vector<uint32_t> residuals;
+    std::vector<int32_t> sideValues;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CompressedPcm)
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "DecodedTrackCache.h"
+
+//==============================================================================
+/**
+ * Plays a track straight out of DecodedTrackCache
+ *
+ * Stands in for the reader and read-ahead buffer when the whole track is
+ * already decoded: every block is a copy, and seeking just moves the position.
+ * Compressed tracks are decoded one 4096-frame block at a time as playback
+ * reaches them, into space allocated up front.
+ * Holds its own reference, so the cache evicting the track doesn't affect it.
+ */
+class DecodedAudioSource : public juce::PositionableAudioSource
+{
+public:
+    explicit DecodedAudioSource (DecodedTrackCache::TrackPtr trackToPlay)
+        : track (std::move (trackToPlay))
+    {
+        jassert (track != nullptr);
+
+        if (track->isCompressed())
+            blockDecoder.reset (new CompressedPcm::BlockDecoder (*track->compressed));
+    }
+
+    double getSampleRate() const noexcept  { return track->sampleRate; }
+
+    //==============================================================================
+    void prepareToPlay (int, double) override {}
+    void releaseResources() override {}
+
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& info) override
+    {
+        auto totalLength = getTotalLength();
+        auto numSourceChannels = track->getNumChannels();
+
+        for (int done = 0; done < info.numSamples;)
+        {
+            if (looping && totalLength > 0)
+                position %= totalLength;
+
+            auto numThisTime = static_cast<int> (juce::jlimit ((juce::int64) 0, static_cast<juce::int64> (info.numSamples - done),
+                                                               totalLength - position));
+
+            if (numThisTime <= 0)
+            {
+                // Past the end - silence, like the reader gives
+                info.buffer->clear (info.startSample + done, info.numSamples - done);
+                position += info.numSamples - done;
+                return;
+            }
+
+            const auto* audio = &track->audio;
+            auto sourceStart = static_cast<int> (position);
+
+            if (blockDecoder != nullptr)
+            {
+                auto blockIndex = static_cast<int> (position / CompressedPcm::blockSize);
+                sourceStart = static_cast<int> (position % CompressedPcm::blockSize);
+                numThisTime = juce::jmin (numThisTime, CompressedPcm::blockSize - sourceStart);
+                audio = &blockDecoder->decode (blockIndex);
+            }
+
+            for (int ch = 0; ch < info.buffer->getNumChannels(); ++ch)
+                info.buffer->copyFrom (ch, info.startSample + done, *audio, ch % numSourceChannels,
+                                       sourceStart, numThisTime);
+
+            position += numThisTime;
+            done += numThisTime;
+        }
+    }
+
+    //==============================================================================
+    void setNextReadPosition (juce::int64 newPosition) override  { position = juce::jmax ((juce::int64) 0, newPosition); }
+    juce::int64 getNextReadPosition() const override            { return position; }
+    juce::int64 getTotalLength() const override                 { return track->getNumSamples(); }
+    bool isLooping() const override                             { return looping; }
+    void setLooping (bool shouldLoop) override                  { looping = shouldLoop; }
+
+private:
+    DecodedTrackCache::TrackPtr track;
+    std::unique_ptr<CompressedPcm::BlockDecoder> blockDecoder;  // Only for compressed tracks
+    juce::int64 position = 0;
+    bool looping = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DecodedAudioSource)
+};
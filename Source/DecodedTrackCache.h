@@ -0,0 +1,323 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "CompressedPcm.h"
+#include <atomic>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+
+//==============================================================================
+/**
+ * Fully decoded tracks kept in memory, least recently used evicted first
+ *
+ * Keyed by path and modification time, so an edited file is decoded afresh.
+ * Tracks are handed out as shared pointers: evicting one only drops the
+ * cache's reference, and a deck or analysis task still using it keeps it
+ * alive until it's done.
+ *
+ * By default tracks are stored compressed (see CompressedPcm), which fits
+ * about twice as many lossy decodes and three times as many 16-bit files in
+ * the same budget. Playback then decodes a 4096-frame block at a time.
+ *
+ * prefetch() decodes on the cache's own low-priority thread. find() never
+ * decodes, and getOrDecode() decodes on the calling thread - neither is for
+ * the audio thread.
+ */
+class DecodedTrackCache
+{
+public:
+    struct Track
+    {
+        juce::AudioBuffer<float> audio;             // Plain float PCM...
+        std::unique_ptr<CompressedPcm> compressed;  // ...or this instead, and audio is left empty
+        double sampleRate = 0.0;
+
+        bool isCompressed() const noexcept  { return compressed != nullptr; }
+        int getNumChannels() const noexcept { return isCompressed() ? compressed->getNumChannels() : audio.getNumChannels(); }
+        int getNumSamples() const noexcept  { return isCompressed() ? compressed->getNumSamples() : audio.getNumSamples(); }
+
+        size_t getSizeInBytes() const
+        {
+            if (isCompressed())
+                return compressed->getSizeInBytes();
+
+            return static_cast<size_t> (audio.getNumChannels()) * static_cast<size_t> (audio.getNumSamples()) * sizeof (float);
+        }
+    };
+
+    using TrackPtr = std::shared_ptr<const Track>;
+
+    enum class Storage
+    {
+        floatingPoint,    // Cheapest to play, biggest
+        compressed24Bit,  // Lossless for 16- and 24-bit files, inaudible rounding for lossy ones
+        compressed16Bit   // Smallest: lossy decodes are rounded to CD resolution
+    };
+
+    static constexpr size_t defaultMemoryBudget = 512 * 1024 * 1024;  // Around six four-minute stereo tracks as floats
+
+    explicit DecodedTrackCache (juce::AudioFormatManager& formatManagerToUse, size_t memoryBudgetBytes = defaultMemoryBudget)
+        : formatManager (formatManagerToUse),
+          memoryBudget (memoryBudgetBytes),
+          decoder (*this)
+    {
+        decoder.startThread (juce::Thread::Priority::low);
+    }
+
+    ~DecodedTrackCache()
+    {
+        decoder.stopThread (4000);
+    }
+
+    // Shrinking the budget evicts straight away
+    void setMemoryBudget (size_t bytes)
+    {
+        const juce::ScopedLock sl (lock);
+        memoryBudget = bytes;
+        evictToFit (0);
+    }
+
+    size_t getMemoryBudget() const   { return memoryBudget.load(); }
+
+    // Applies to tracks decoded from now on; ones already cached stay as they are
+    void setStorage (Storage newStorage)   { storage = newStorage; }
+    Storage getStorage() const noexcept    { return storage.load(); }
+
+    size_t getMemoryUsed() const     { return memoryUsed.load(); }
+
+    int getNumHits() const noexcept    { return numHits.load(); }
+    int getNumMisses() const noexcept  { return numMisses.load(); }
+
+    // The decoded track if it's cached, otherwise nullptr. Marks it as recently used.
+    TrackPtr find (const juce::File& file)
+    {
+        auto key = makeKey (file);
+        const juce::ScopedLock sl (lock);
+
+        auto found = index.find (key);
+
+        if (found == index.end())
+        {
+            ++numMisses;
+            return {};
+        }
+
+        ++numHits;
+        entries.splice (entries.begin(), entries, found->second);
+        return found->second->track;
+    }
+
+    // Decodes on the calling thread if needed. Returns nullptr if the file can't be read.
+    // Tracks bigger than the whole budget are returned but not kept.
+    TrackPtr getOrDecode (const juce::File& file)
+    {
+        if (auto cached = find (file))
+            return cached;
+
+        auto decoded = decode (file);
+
+        if (decoded != nullptr)
+            return insert (makeKey (file), decoded);
+
+        return {};
+    }
+
+    // Queues a file for decoding in the background, if it isn't cached or queued already.
+    // 'readFrom' is an already decoded copy of it, such as a TranscodeCache file, to read
+    // instead of decoding the original again.
+    void prefetch (const juce::File& file, const juce::File& readFrom = {})
+    {
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (index.count (makeKey (file)) > 0 || pendingFiles.contains (file))
+                return;
+
+            pendingFiles.add (file);
+            pendingReadFrom.add (readFrom);
+        }
+
+        decoder.notify();
+    }
+
+private:
+    //==============================================================================
+    class Decoder : public juce::Thread
+    {
+    public:
+        explicit Decoder (DecodedTrackCache& c) : juce::Thread ("Track Cache"), cache (c) {}
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                wait (-1);
+
+                while (! threadShouldExit() && cache.decodeNextPending())
+                {
+                }
+            }
+        }
+
+    private:
+        DecodedTrackCache& cache;
+    };
+
+    struct Entry
+    {
+        juce::String key;
+        TrackPtr track;
+        size_t bytes;
+    };
+
+    //==============================================================================
+    // Decoder thread: returns true if there was a file to decode, so the rest of the queue gets done too
+    bool decodeNextPending()
+    {
+        juce::File file, readFrom;
+
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (pendingFiles.isEmpty())
+                return false;
+
+            file = pendingFiles.removeAndReturn (0);
+            readFrom = pendingReadFrom.removeAndReturn (0);
+
+            if (index.count (makeKey (file)) > 0)
+                return true;
+        }
+
+        if (auto decoded = decode (readFrom.existsAsFile() ? readFrom : file))
+            insert (makeKey (file), decoded);
+
+        return true;
+    }
+
+    std::shared_ptr<Track> decode (const juce::File& file) const
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+        if (reader == nullptr || reader->lengthInSamples <= 0
+             || reader->lengthInSamples > std::numeric_limits<int>::max())
+            return {};
+
+        auto numChannels = static_cast<int> (juce::jmax (1u, reader->numChannels));
+        auto numSamples = static_cast<int> (reader->lengthInSamples);
+        auto storageToUse = storage.load();
+
+        // Not worth decoding something that would push everything else out and still not fit.
+        // Compressed tracks are judged by their uncompressed integer size, which they rarely get near.
+        auto bytesPerSample = storageToUse == Storage::floatingPoint ? sizeof (float)
+                            : storageToUse == Storage::compressed24Bit ? size_t (3) : size_t (2);
+
+        if (static_cast<size_t> (numChannels) * static_cast<size_t> (numSamples) * bytesPerSample > memoryBudget.load())
+            return {};
+
+        auto track = std::make_shared<Track>();
+        track->sampleRate = reader->sampleRate;
+
+        // Both paths go a block at a time and give up if the cache is being destroyed,
+        // rather than holding up its destructor for a whole long track
+        if (storageToUse == Storage::floatingPoint)
+        {
+            track->audio.setSize (numChannels, numSamples);
+
+            for (int start = 0; start < numSamples; start += floatBlockSize)
+            {
+                if (decoder.threadShouldExit())
+                    return {};
+
+                auto numThisTime = juce::jmin (floatBlockSize, numSamples - start);
+
+                if (! reader->read (&track->audio, start, numThisTime, start, true, true))
+                    return {};
+            }
+
+            return track;
+        }
+
+        // One block at a time, so the whole track never has to exist as floats
+        auto pcm = std::make_unique<CompressedPcm> (numChannels, storageToUse == Storage::compressed24Bit ? 24 : 16);
+        juce::AudioBuffer<float> block (numChannels, CompressedPcm::blockSize);
+
+        for (int start = 0; start < numSamples; start += CompressedPcm::blockSize)
+        {
+            if (decoder.threadShouldExit())
+                return {};
+
+            auto numThisTime = juce::jmin (CompressedPcm::blockSize, numSamples - start);
+
+            if (! reader->read (&block, 0, numThisTime, start, true, true))
+                return {};
+
+            pcm->appendBlock (block.getArrayOfReadPointers(), numThisTime);
+        }
+
+        pcm->finishEncoding();
+        track->compressed = std::move (pcm);
+        return track;
+    }
+
+    // Two threads decoding the same file both get a track back, and the first one in is kept
+    TrackPtr insert (const juce::String& key, const std::shared_ptr<Track>& track)
+    {
+        const juce::ScopedLock sl (lock);
+
+        auto found = index.find (key);
+
+        if (found != index.end())
+            return found->second->track;
+
+        auto bytes = track->getSizeInBytes();
+
+        if (bytes > memoryBudget.load())
+            return track;
+
+        evictToFit (bytes);
+
+        entries.push_front ({ key, track, bytes });
+        index[key] = entries.begin();
+        memoryUsed += bytes;
+
+        return track;
+    }
+
+    // Called with the lock held
+    void evictToFit (size_t bytesNeeded)
+    {
+        while (! entries.empty() && memoryUsed.load() + bytesNeeded > memoryBudget.load())
+        {
+            auto& oldest = entries.back();
+            memoryUsed -= oldest.bytes;
+            index.erase (oldest.key);
+            entries.pop_back();
+        }
+    }
+
+    static juce::String makeKey (const juce::File& file)
+    {
+        return file.getFullPathName() + "|" + juce::String (file.getLastModificationTime().toMilliseconds());
+    }
+
+    //==============================================================================
+    static constexpr int floatBlockSize = 65536;  // Samples decoded per read when storing floats
+
+    juce::AudioFormatManager& formatManager;
+
+    juce::CriticalSection lock;
+    std::list<Entry> entries;  // Most recently used first
+    std::map<juce::String, std::list<Entry>::iterator> index;
+    juce::Array<juce::File> pendingFiles, pendingReadFrom;  // Side by side: what to cache, and what to read it from
+
+    std::atomic<size_t> memoryBudget, memoryUsed { 0 };
+    std::atomic<Storage> storage { Storage::compressed24Bit };
+    std::atomic<int> numHits { 0 }, numMisses { 0 };
+
+    Decoder decoder;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DecodedTrackCache)
+};
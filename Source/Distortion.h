@@ -0,0 +1,310 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <memory>
+
+//==============================================================================
+/**
+ * Soft-clipping distortion with selectable 1x/2x/4x/8x oversampling
+ *
+ * Up to 11x drive into a tanh curve produces harmonics far above Nyquist, so
+ * at the base rate they fold back as inharmonic aliasing. Running the shaper
+ * at 2, 4 or 8 times the rate pushes most of that above the audible band
+ * before the decimation filter removes it.
+ *
+ * Every oversampler is built in prepare(), so changing the factor never
+ * allocates; the block where it changes crossfades the old and new factor.
+ * The new factor's filters first run over the recent input, so its output
+ * doesn't fade in from silence under the crossfade.
+ * The linear-phase filters add a whole number of samples of latency, and the
+ * dry path is delayed by the same amount so the wet/dry mix doesn't comb.
+ *
+ * Setters and process() belong to the audio thread.
+ */
+class Distortion
+{
+public:
+    static constexpr int numFactors = 4;  // 1x, 2x, 4x, 8x
+
+    Distortion() = default;
+
+    void prepare (const juce::dsp::ProcessSpec& spec)
+    {
+        auto numChannels = static_cast<int> (spec.numChannels);
+        auto maximumBlockSize = static_cast<int> (spec.maximumBlockSize);
+
+        latencies[0] = 0;
+
+        for (size_t stages = 1; stages < numFactors; ++stages)
+        {
+            auto& oversampler = oversamplers[stages];
+            oversampler.reset (new juce::dsp::Oversampling<float> (spec.numChannels, stages,
+                                                                   juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple,
+                                                                   false, true));
+            oversampler->initProcessing (spec.maximumBlockSize);
+            latencies[stages] = static_cast<int> (oversampler->getLatencyInSamples());
+        }
+
+        // Dry path delay plus a block, and the input history primeOversampler() reads back
+        auto ringSize = juce::nextPowerOfTwo (2 * latencies[numFactors - 1] + maximumBlockSize);
+        dryBuffer.setSize (numChannels, ringSize);
+        ringMask = ringSize - 1;
+
+        switchBuffer.setSize (numChannels, maximumBlockSize);
+
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& oversampler : oversamplers)
+            if (oversampler != nullptr)
+                oversampler->reset();
+
+        dryBuffer.clear();
+        writePosition = 0;
+
+        currentFactorIndex = targetFactorIndex;
+        currentDrive = targetDrive;
+        currentMix = targetMix;
+    }
+
+    // 1 to 11x gain into the shaper - reached by the end of the next block
+    void setDrive (float drive)  { targetDrive = drive; }
+    void setMix (float mix)      { targetMix = juce::jlimit (0.0f, 1.0f, mix); }
+
+    // 1, 2, 4 or 8 - anything else rounds down to one of those
+    void setOversamplingFactor (int factor)
+    {
+        targetFactorIndex = getFactorIndex (factor);
+    }
+
+    static int getFactorIndex (int factor)
+    {
+        return juce::jlimit (0, numFactors - 1, static_cast<int> (std::log2 (juce::jmax (1, factor))));
+    }
+
+    // In base-rate samples, valid after prepare(). The stage's output lags its input by this much.
+    int getLatencySamples (int factor) const  { return latencies[static_cast<size_t> (getFactorIndex (factor))]; }
+    int getLatencySamples() const             { return latencies[static_cast<size_t> (currentFactorIndex)]; }
+
+    void process (juce::dsp::AudioBlock<float>& block)
+    {
+        auto numSamples = static_cast<int> (block.getNumSamples());
+        jassert (numSamples <= switchBuffer.getNumSamples());  // Larger than the block size given to prepare()
+
+        writeDry (block);
+
+        if (currentMix < 0.01f && targetMix < 0.01f)
+        {
+            // Fully dry - only keep the dry path's delay consistent
+            readDry (block, getLatencySamples());
+            finishBlock (numSamples);
+            return;
+        }
+
+        if (targetFactorIndex == currentFactorIndex)
+        {
+            renderWet (block, currentFactorIndex);
+            mixWithDry (block, getLatencySamples());
+        }
+        else
+        {
+            // Run the new factor alongside the old one for a block and crossfade, since the latency jumps
+            primeOversampler (targetFactorIndex, block.getNumChannels());
+
+            auto newBlock = juce::dsp::AudioBlock<float> (switchBuffer).getSubsetChannelBlock (0, block.getNumChannels())
+                                                                       .getSubBlock (0, block.getNumSamples());
+            newBlock.copyFrom (block);
+
+            renderWet (block, currentFactorIndex);
+            mixWithDry (block, getLatencySamples());
+
+            renderWet (newBlock, targetFactorIndex);
+            mixWithDry (newBlock, latencies[static_cast<size_t> (targetFactorIndex)]);
+
+            crossfade (block, newBlock);
+        }
+
+        finishBlock (numSamples);
+    }
+
+private:
+    //==============================================================================
+    // Drive ramped across the block, then the shaper at the oversampled rate
+    void renderWet (juce::dsp::AudioBlock<float>& block, int factorIndex)
+    {
+        applyRamp (block, currentDrive, targetDrive);
+        shapeOversampled (block, factorIndex);
+    }
+
+    void shapeOversampled (juce::dsp::AudioBlock<float>& block, int factorIndex)
+    {
+        if (factorIndex == 0)
+        {
+            shape (block);
+            return;
+        }
+
+        auto& oversampler = *oversamplers[static_cast<size_t> (factorIndex)];
+        auto oversampledBlock = oversampler.processSamplesUp (block);
+        shape (oversampledBlock);
+        oversampler.processSamplesDown (block);
+    }
+
+    // Feeds the input from before this block through a factor's filters, so they hold what they
+    // would have if it had been running all along. Straight after a reset its output would fade
+    // in over the latency, which the crossfade turns into a dip.
+    void primeOversampler (int factorIndex, size_t numChannels)
+    {
+        if (factorIndex == 0)
+            return;
+
+        oversamplers[static_cast<size_t> (factorIndex)]->reset();
+
+        // The linear-phase filters reach back twice their latency
+        auto numToPrime = 2 * latencies[static_cast<size_t> (factorIndex)];
+
+        for (int done = 0; done < numToPrime;)
+        {
+            auto numThisTime = juce::jmin (switchBuffer.getNumSamples(), numToPrime - done);
+            auto chunk = juce::dsp::AudioBlock<float> (switchBuffer).getSubsetChannelBlock (0, numChannels)
+                                                                    .getSubBlock (0, static_cast<size_t> (numThisTime));
+
+            for (size_t ch = 0; ch < numChannels; ++ch)
+            {
+                auto* data = chunk.getChannelPointer (ch);
+
+                for (int i = 0; i < numThisTime; ++i)
+                    data[i] = *getDelayedDry (static_cast<int> (ch), i, numToPrime - done);
+            }
+
+            chunk.multiplyBy (currentDrive);
+            shapeOversampled (chunk, factorIndex);
+            done += numThisTime;
+        }
+    }
+
+    // JUCE's Pade approximation of tanh - a division instead of a libm call, and it vectorises.
+    // It's only accurate up to +/-5, where tanh is flat to within 1e-4 anyway. Clipping first in
+    // a separate pass keeps both loops branch-free.
+    static void shape (juce::dsp::AudioBlock<float>& block)
+    {
+        auto numSamples = static_cast<int> (block.getNumSamples());
+
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            auto* data = block.getChannelPointer (ch);
+            juce::FloatVectorOperations::clip (data, data, -5.0f, 5.0f, numSamples);
+
+            for (int i = 0; i < numSamples; ++i)
+                data[i] = juce::dsp::FastMathApproximations::tanh (data[i]);
+        }
+    }
+
+    void writeDry (const juce::dsp::AudioBlock<float>& block)
+    {
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            auto* input = block.getChannelPointer (ch);
+            auto* ring = dryBuffer.getWritePointer (static_cast<int> (ch));
+
+            for (size_t i = 0; i < block.getNumSamples(); ++i)
+                ring[(writePosition + static_cast<int> (i)) & ringMask] = input[i];
+        }
+    }
+
+    // This block's input, delayed to line up with a wet path of the given latency
+    const float* getDelayedDry (int channel, int sample, int latency) const
+    {
+        return dryBuffer.getReadPointer (channel) + ((writePosition + sample - latency) & ringMask);
+    }
+
+    void readDry (juce::dsp::AudioBlock<float>& block, int latency)
+    {
+        if (latency == 0)
+            return;  // The block already holds it
+
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            auto* output = block.getChannelPointer (ch);
+
+            for (size_t i = 0; i < block.getNumSamples(); ++i)
+                output[i] = *getDelayedDry (static_cast<int> (ch), static_cast<int> (i), latency);
+        }
+    }
+
+    // output = dry * (1 - mix) + wet * mix, with the mix ramped across the block
+    void mixWithDry (juce::dsp::AudioBlock<float>& wetBlock, int latency)
+    {
+        auto mixStep = (targetMix - currentMix) / static_cast<float> (juce::jmax ((size_t) 1, wetBlock.getNumSamples()));
+
+        for (size_t ch = 0; ch < wetBlock.getNumChannels(); ++ch)
+        {
+            auto* output = wetBlock.getChannelPointer (ch);
+
+            for (size_t i = 0; i < wetBlock.getNumSamples(); ++i)
+            {
+                auto dry = *getDelayedDry (static_cast<int> (ch), static_cast<int> (i), latency);
+                auto mix = currentMix + mixStep * static_cast<float> (i);
+                output[i] = dry + mix * (output[i] - dry);
+            }
+        }
+    }
+
+    static void crossfade (juce::dsp::AudioBlock<float>& block, const juce::dsp::AudioBlock<float>& fadeIn)
+    {
+        auto step = 1.0f / static_cast<float> (juce::jmax ((size_t) 1, block.getNumSamples()));
+
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            auto* output = block.getChannelPointer (ch);
+            auto* incoming = fadeIn.getChannelPointer (ch);
+
+            for (size_t i = 0; i < block.getNumSamples(); ++i)
+                output[i] += step * static_cast<float> (i) * (incoming[i] - output[i]);
+        }
+    }
+
+    static void applyRamp (juce::dsp::AudioBlock<float>& block, float startGain, float endGain)
+    {
+        if (startGain == endGain)
+        {
+            block.multiplyBy (endGain);
+            return;
+        }
+
+        auto step = (endGain - startGain) / static_cast<float> (juce::jmax ((size_t) 1, block.getNumSamples()));
+
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            auto* data = block.getChannelPointer (ch);
+
+            for (size_t i = 0; i < block.getNumSamples(); ++i)
+                data[i] *= startGain + step * static_cast<float> (i);
+        }
+    }
+
+    void finishBlock (int numSamples)
+    {
+        writePosition = (writePosition + numSamples) & ringMask;
+        currentFactorIndex = targetFactorIndex;
+        currentDrive = targetDrive;
+        currentMix = targetMix;
+    }
+
+    //==============================================================================
+    std::array<std::unique_ptr<juce::dsp::Oversampling<float>>, numFactors> oversamplers;  // [0] unused: 1x
+    std::array<int, numFactors> latencies {};
+
+    juce::AudioBuffer<float> dryBuffer;     // Ring of recent input for the latency-matched dry path
+    juce::AudioBuffer<float> switchBuffer;  // The new factor's output while switching
+    int writePosition = 0, ringMask = 0;
+
+    int currentFactorIndex = 0, targetFactorIndex = 0;
+    float currentDrive = 1.0f, targetDrive = 1.0f;
+    float currentMix = 0.0f, targetMix = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Distortion)
+};
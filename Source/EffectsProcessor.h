@@ -1,25 +1,95 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include "Bitcrusher.h"
+#include "Distortion.h"
+#include "ScratchArena.h"
+#include "StereoDelay.h"
+#include "RealtimeAllocationGuard.h"
 
 /**
  * Professional effects processor using JUCE DSP
  * Matches the ModularRadio Swift app effect chain
+ *
+ * process() never allocates: the stages' buffers and the bypass dry copy are
+ * all sized in prepare(). Debug builds abort if anything inside process() hits
+ * the heap.
+ *
+ * The setters are safe to call from the message thread while process() runs:
+ * they only store atomic targets, which the audio thread picks up at the top
+ * of each block and ramps towards with SmoothedValue, so knob sweeps and the
+ * FX randomizer never lock and never zipper.
+ *
+ * Bypass is one engine shared by all seven stages: toggling a stage ramps its
+ * input in or out over a few milliseconds while the dry path ramps the other
+ * way, so nothing is reset and delay/reverb tails ring out naturally. Once a
+ * bypassed stage has faded and its tail has gone silent it is skipped entirely.
+ *
+ * The chain order is configurable with setChainOrder(). The audio thread runs
+ * a flat plan holding only the stages that are doing something, rebuilt when
+ * the order or a stage's activity changes, so idle stages cost nothing.
  */
 class EffectsProcessor
 {
 public:
+    // Chain stages, default order = processing order
+    enum class Stage
+    {
+        phaser, delay, chorus, distortion, reverb, filter, bitcrusher
+    };
+
+    static constexpr size_t numStages = 7;
+
     EffectsProcessor()
     {
+        // Initial targets - the JUCE modules' own defaults, plus the reverb room settings
+        setTarget (ParameterId::phaserRate, 1.0f);
+        setTarget (ParameterId::phaserDepth, 0.5f);
+        setTarget (ParameterId::phaserMix, 0.5f);
+        setTarget (ParameterId::phaserFeedback, 0.0f);
+
+        setTarget (ParameterId::delayTime, 0.5f);
+        setTarget (ParameterId::delayFeedback, 0.3f);
+        setTarget (ParameterId::delayMix, 0.5f);
+
+        setTarget (ParameterId::chorusRate, 1.0f);
+        setTarget (ParameterId::chorusDepth, 0.25f);
+        setTarget (ParameterId::chorusMix, 0.5f);
+        setTarget (ParameterId::chorusFeedback, 0.0f);
+
+        setTarget (ParameterId::distortionDrive, 1.0f);
+        setTarget (ParameterId::distortionMix, 0.5f);
+
+        setTarget (ParameterId::reverbSize, 0.8f);
+        setTarget (ParameterId::reverbDamping, 0.5f);
+        setTarget (ParameterId::reverbMix, 0.0f);
+
+        setTarget (ParameterId::filterCutoff, 0.5f);
+        setTarget (ParameterId::filterResonance, 1.0f);
+        setTarget (ParameterId::filterGain, 1.0f);
+
+        setTarget (ParameterId::bitcrusherBitDepth, 16.0f);
+        setTarget (ParameterId::bitcrusherCrush, 1.0f);
+        setTarget (ParameterId::bitcrusherMix, 0.5f);
+
+        // ALL start bypassed by default - user enables them
+        for (auto& bypass : bypassTargets)
+            bypass = true;
+
+        for (size_t i = 0; i < numStages; ++i)
+            stages[i].stage = static_cast<Stage> (i);
+
+        appliedChainOrder = chainOrderTarget.load();
+
         // Initialize reverb parameters
-        reverbParams.roomSize = 0.8f;
-        reverbParams.damping = 0.5f;
-        reverbParams.wetLevel = 0.0f;
-        reverbParams.dryLevel = 1.0f;
         reverbParams.width = 1.0f;
         reverbParams.freezeMode = 0.0f;
     }
 
+    // Message thread, while audio is stopped
     void prepare (const juce::dsp::ProcessSpec& spec)
     {
         // Prepare all effects with the audio spec
@@ -27,268 +97,286 @@ public:
         chorus.prepare (spec);
         reverb.prepare (spec);
 
-        // Delay line setup (max 3 seconds)
-        delayLine.prepare (spec);
-        delayLine.setMaximumDelayInSamples (static_cast<int> (spec.sampleRate * 3.0));
+        // Delay setup (max 3 seconds)
+        stereoDelay.prepare (spec, 3.0);
 
         // Filter setup
         filter.prepare (spec);
         filter.reset();
 
-        // Distortion/waveshaper setup
+        // Distortion setup - builds every oversampling factor up front
         distortion.prepare (spec);
-        distortion.functionToUse = [] (float x)
-        {
-            // Soft clipping distortion
-            return std::tanh (x);
-        };
 
-        // Bitcrusher needs no preparation - simple algorithm
-        bitcrusherHoldSample[0] = 0.0f;
-        bitcrusherHoldSample[1] = 0.0f;
-        bitcrusherCounter = 0;
+        bitcrusher.prepare (spec);
 
         sampleRate = spec.sampleRate;
+
+        // The bypass crossfade's dry copy
+        scratch.prepare (static_cast<int> (spec.numChannels), static_cast<int> (spec.maximumBlockSize), numScratchBuffers);
+
+        // Start every ramp at its target, then push the values into the JUCE modules once
+        for (size_t i = 0; i < numParameters; ++i)
+        {
+            smoothers[i].reset (sampleRate, getRampSeconds (static_cast<ParameterId> (i)));
+            smoothers[i].setCurrentAndTargetValue (parameterTargets[i].load (std::memory_order_relaxed));
+        }
+
+        for (size_t i = 0; i < numStages; ++i)
+        {
+            auto isOn = ! bypassTargets[i].load();
+            stages[i].mix.reset (sampleRate, bypassCrossfadeSeconds.load());
+            stages[i].mix.setCurrentAndTargetValue (isOn ? 1.0f : 0.0f);
+            stages[i].isActive = isOn;
+            stages[i].numSilentSamples = 0;
+        }
+
+        appliedChainOrder = chainOrderTarget.load();
+        reorderGain.reset (sampleRate, bypassCrossfadeSeconds.load());
+        reorderGain.setCurrentAndTargetValue (1.0f);
+        rebuildPlan();
+
+        appliedFilterType = filterTypeTarget.load();
+        applyModuleParameters (0, true);
+
+        // Start at the restored settings rather than gliding to them
+        stereoDelay.reset();
+        distortion.reset();
+        bitcrusher.reset();
+        resetRequested = false;
     }
 
+    // Clears every delay/reverb tail at the start of the next block - safe from any thread
     void reset()
     {
-        phaser.reset();
-        chorus.reset();
-        reverb.reset();
-        delayLine.reset();
-        filter.reset();
-        distortion.reset();
-
-        // Reset bitcrusher state
-        bitcrusherHoldSample[0] = 0.0f;
-        bitcrusherHoldSample[1] = 0.0f;
-        bitcrusherCounter = 0;
+        resetRequested = true;
     }
 
     void process (juce::AudioBuffer<float>& buffer)
     {
-        juce::dsp::AudioBlock<float> block (buffer);
-        juce::dsp::ProcessContextReplacing<float> context (block);
+        const RealtimeAllocationGuard::ScopedNoAllocation noAllocation;
+        const juce::ScopedNoDenormals noDenormals;  // Decaying tails would otherwise go denormal before they idle
 
-        // Process through effects chain
-        // Order: Phaser → Delay → Chorus → Distortion → Reverb → Filter → Time Effect
-        // Note: Main pitch knob is handled at source level via ResamplingAudioSource
+        auto maximumBlockSize = static_cast<size_t> (scratch.getMaximumBlockSize());
 
-        if (!phaserBypassed)
-            phaser.process (context);
+        if (maximumBlockSize == 0)
+            return;  // Not prepared yet
 
-        if (!delayBypassed)
-            processDelay (buffer);
+        pullParameters();
 
-        if (!chorusBypassed)
-            chorus.process (context);
+        juce::dsp::AudioBlock<float> fullBlock (buffer);
+        fullBlock = fullBlock.getSubsetChannelBlock (0, juce::jmin (fullBlock.getNumChannels(),
+                                                                    static_cast<size_t> (scratch.getNumChannels())));
 
-        if (!distortionBypassed)
-            processDistortion (buffer);
+        // Devices occasionally deliver more than the prepared block size - split rather than allocate
+        for (size_t start = 0; start < fullBlock.getNumSamples(); start += maximumBlockSize)
+        {
+            auto block = fullBlock.getSubBlock (start, juce::jmin (maximumBlockSize, fullBlock.getNumSamples() - start));
+            processBlock (block);
+        }
+    }
 
-        if (!reverbBypassed)
-            reverb.process (context);
+    // Any order of all seven stages, e.g. filter before distortion. Returns false (and changes
+    // nothing) if it isn't a permutation. Safe from any thread; audible reorders dip the output
+    // for one bypass crossfade so stages never switch places mid-waveform.
+    bool setChainOrder (const std::array<Stage, numStages>& order)
+    {
+        juce::uint32 encoded = 0, seen = 0;
 
-        if (!filterBypassed)
+        for (size_t position = 0; position < numStages; ++position)
         {
-            filter.process (context);
-            // Apply gain to filter output
-            block.multiplyBy (filterGain);
+            auto index = static_cast<juce::uint32> (order[position]);
+
+            if (index >= numStages || (seen & (1u << index)) != 0)
+            {
+                jassertfalse;  // Every stage has to appear exactly once
+                return false;
+            }
+
+            seen |= 1u << index;
+            encoded |= index << (position * bitsPerStage);
         }
 
-        // Bitcrusher effect: lo-fi digital degradation
-        if (!bitcrusherBypassed)
-            processBitcrusher (buffer);
+        chainOrderTarget = encoded;
+        return true;
+    }
+
+    std::array<Stage, numStages> getChainOrder() const
+    {
+        std::array<Stage, numStages> order;
+        auto encoded = chainOrderTarget.load();
+
+        for (size_t position = 0; position < numStages; ++position)
+            order[position] = getStageAt (encoded, position);
+
+        return order;
+    }
+
+    // How long bypass toggles and reorders crossfade (1 to 200 ms) - applies from the next change
+    void setBypassCrossfadeMilliseconds (float milliseconds)
+    {
+        bypassCrossfadeSeconds = juce::jlimit (1.0f, 200.0f, milliseconds) / 1000.0f;
     }
 
     // Phaser controls
     void setPhaserRate (float rate)
     {
-        phaser.setRate (0.1f + rate * 9.9f);  // 0.1Hz to 10Hz
+        setTarget (ParameterId::phaserRate, 0.1f + rate * 9.9f);  // 0.1Hz to 10Hz
     }
 
     void setPhaserDepth (float depth)
     {
-        phaser.setDepth (depth);
+        setTarget (ParameterId::phaserDepth, depth);
     }
 
     void setPhaserMix (float mix)
     {
-        phaser.setMix (mix);
+        setTarget (ParameterId::phaserMix, mix);
     }
 
     void setPhaserBypassed (bool bypassed)
     {
-        if (bypassed != phaserBypassed)
-        {
-            phaserBypassed = bypassed;
-            phaser.reset();  // Clear internal state to prevent pops
-        }
+        setBypassTarget (Stage::phaser, bypassed);
     }
 
     void setPhaserFeedback (float feedback)
     {
-        phaser.setFeedback (feedback);
+        setTarget (ParameterId::phaserFeedback, feedback);
     }
 
     // Delay controls
     void setDelayTime (float seconds)
     {
-        delayTime = juce::jlimit (0.0f, 3.0f, seconds);
+        setTarget (ParameterId::delayTime, juce::jlimit (0.0f, 3.0f, seconds));
     }
 
     void setDelayFeedback (float feedback)
     {
-        delayFeedback = juce::jlimit (0.0f, 0.95f, feedback);
+        setTarget (ParameterId::delayFeedback, juce::jlimit (0.0f, 0.95f, feedback));
     }
 
     void setDelayMix (float mix)
     {
-        delayMix = juce::jlimit (0.0f, 1.0f, mix);
+        setTarget (ParameterId::delayMix, juce::jlimit (0.0f, 1.0f, mix));
     }
 
     void setDelayBypassed (bool bypassed)
     {
-        if (bypassed != delayBypassed)
-        {
-            delayBypassed = bypassed;
-            delayLine.reset();  // Clear delay buffer to prevent pops
-        }
+        setBypassTarget (Stage::delay, bypassed);
+    }
+
+    // Repeats bounce between left and right
+    void setDelayPingPong (bool shouldPingPong)
+    {
+        delayPingPongTarget = shouldPingPong;
+    }
+
+    // Each repeat loses some top and bottom end, like an analogue delay
+    void setDelayFeedbackFiltered (bool shouldFilter)
+    {
+        delayFeedbackFilteredTarget = shouldFilter;
     }
 
     // Chorus controls
     void setChorusRate (float rate)
     {
-        chorus.setRate (rate * 10.0f);  // 0-10 Hz
+        setTarget (ParameterId::chorusRate, rate * 10.0f);  // 0-10 Hz
     }
 
     void setChorusDepth (float depth)
     {
-        chorus.setDepth (depth);
+        setTarget (ParameterId::chorusDepth, depth);
     }
 
     void setChorusMix (float mix)
     {
-        chorus.setMix (mix);
+        setTarget (ParameterId::chorusMix, mix);
     }
 
     void setChorusBypassed (bool bypassed)
     {
-        if (bypassed != chorusBypassed)
-        {
-            chorusBypassed = bypassed;
-            chorus.reset();  // Clear internal state to prevent pops
-        }
+        setBypassTarget (Stage::chorus, bypassed);
     }
 
     void setChorusFeedback (float feedback)
     {
-        chorus.setFeedback (feedback);
+        setTarget (ParameterId::chorusFeedback, feedback);
     }
 
     // Distortion controls
     void setDistortionDrive (float drive)
     {
-        distortionDrive = 1.0f + drive * 10.0f;  // 1x to 11x gain
+        setTarget (ParameterId::distortionDrive, 1.0f + drive * 10.0f);  // 1x to 11x gain
     }
 
     void setDistortionMix (float mix)
     {
-        distortionMix = juce::jlimit (0.0f, 1.0f, mix);
+        setTarget (ParameterId::distortionMix, juce::jlimit (0.0f, 1.0f, mix));
     }
 
     void setDistortionBypassed (bool bypassed)
     {
-        if (bypassed != distortionBypassed)
-        {
-            distortionBypassed = bypassed;
-            distortion.reset();  // Clear internal state to prevent pops
-        }
+        setBypassTarget (Stage::distortion, bypassed);
+    }
+
+    // 1, 2, 4 or 8 - higher factors alias less at high drive but cost more CPU and latency
+    void setDistortionOversampling (int factor)
+    {
+        distortionOversamplingTarget = factor;
+    }
+
+    // How far the distortion stage delays the signal at the selected factor, once prepared
+    int getDistortionLatencySamples() const
+    {
+        return distortion.getLatencySamples (distortionOversamplingTarget.load());
     }
 
     // Reverb controls
     void setReverbSize (float size)
     {
-        reverbParams.roomSize = size;
-        reverb.setParameters (reverbParams);
+        setTarget (ParameterId::reverbSize, size);
     }
 
     void setReverbDamping (float damping)
     {
-        reverbParams.damping = damping;
-        reverb.setParameters (reverbParams);
+        setTarget (ParameterId::reverbDamping, damping);
     }
 
     void setReverbMix (float mix)
     {
-        reverbParams.wetLevel = mix;
-        reverbParams.dryLevel = 1.0f - mix;
-        reverb.setParameters (reverbParams);
+        setTarget (ParameterId::reverbMix, mix);  // Dry level follows as 1 - mix
     }
 
     void setReverbBypassed (bool bypassed)
     {
-        if (bypassed != reverbBypassed)
-        {
-            reverbBypassed = bypassed;
-            reverb.reset();  // Clear reverb tail to prevent pops
-        }
+        setBypassTarget (Stage::reverb, bypassed);
     }
 
     // Filter controls
     void setFilterCutoff (float cutoff)
     {
-        // Store normalized value for when filter type changes
-        filterCutoffNormalized = juce::jlimit (0.0f, 1.0f, cutoff);
-
-        // Different mapping based on filter type for intuitive control
-        switch (filterType)
-        {
-            case 0:  // Low-pass: 0=muffled(100Hz), 1=open(20kHz)
-                filterCutoff = 100.0f * std::pow (200.0f, filterCutoffNormalized);
-                break;
-            case 1:  // High-pass: 0=open(20Hz), 1=thin(10kHz) - REVERSED for natural feel
-                filterCutoff = 20.0f * std::pow (500.0f, 1.0f - filterCutoffNormalized);  // Inverted mapping
-                break;
-            case 2:  // Band-pass: 0=low band, 1=high band
-                filterCutoff = 100.0f * std::pow (200.0f, filterCutoffNormalized);
-                break;
-        }
-        updateFilter();
+        // Stored normalized (0-1) and mapped per filter type on the audio thread, so type switches remap it
+        setTarget (ParameterId::filterCutoff, juce::jlimit (0.0f, 1.0f, cutoff));
     }
 
     void setFilterResonance (float resonance)
     {
-        filterResonance = 0.5f + resonance * 9.5f;  // 0.5 to 10.0
-        updateFilter();
+        setTarget (ParameterId::filterResonance, 0.5f + resonance * 9.5f);  // 0.5 to 10.0
     }
 
     void setFilterType (int type)
     {
         // 0 = Low-pass, 1 = High-pass, 2 = Band-pass
-        if (type != filterType)
-        {
-            filterType = type;
-            // Recalculate cutoff frequency with new type-specific mapping
-            setFilterCutoff (filterCutoffNormalized);  // Use stored normalized value
-            updateFilter();
-            filter.reset();  // Clear filter state to prevent pops when changing type
-        }
+        filterTypeTarget = juce::jlimit (0, 2, type);
     }
 
     void setFilterGain (float gain)
     {
-        filterGain = 0.1f + gain * 1.9f;  // 0.1x to 2.0x gain
+        setTarget (ParameterId::filterGain, 0.1f + gain * 1.9f);  // 0.1x to 2.0x gain
     }
 
     void setFilterBypassed (bool bypassed)
     {
-        if (bypassed != filterBypassed)
-        {
-            filterBypassed = bypassed;
-            filter.reset();  // Clear filter state to prevent pops
-        }
+        setBypassTarget (Stage::filter, bypassed);
     }
 
     // Pitch shift controls (for main knob) - PITCH ONLY, NO TIME STRETCH
@@ -315,211 +403,570 @@ public:
     void setBitcrusherBitDepth (float depth)
     {
         // Map 0-1 to 16 bits down to 1 bit
-        bitcrusherBitDepth = 1.0f + depth * 15.0f;  // 1 to 16 bits
+        setTarget (ParameterId::bitcrusherBitDepth, 1.0f + depth * 15.0f);  // 1 to 16 bits
     }
 
     void setBitcrusherCrush (float crush)
     {
         // Map 0-1 to 1x to 32x sample rate reduction
-        bitcrusherCrush = 1.0f + crush * 31.0f;  // 1 to 32
+        setTarget (ParameterId::bitcrusherCrush, 1.0f + crush * 31.0f);  // 1 to 32
     }
 
     void setBitcrusherMix (float mix)
     {
-        bitcrusherMix = juce::jlimit (0.0f, 1.0f, mix);
+        setTarget (ParameterId::bitcrusherMix, juce::jlimit (0.0f, 1.0f, mix));
     }
 
     void setBitcrusherBypassed (bool bypassed)
     {
-        if (bypassed != bitcrusherBypassed)
-        {
-            bitcrusherBypassed = bypassed;
-            // Reset bitcrusher state
-            bitcrusherHoldSample[0] = 0.0f;
-            bitcrusherHoldSample[1] = 0.0f;
-            bitcrusherCounter = 0;
-        }
+        setBypassTarget (Stage::bitcrusher, bypassed);
+    }
+
+    // Triangular dither before quantising: a noise floor instead of gritty harmonics
+    void setBitcrusherDither (bool shouldDither)
+    {
+        bitcrusherDitherTarget = shouldDither;
     }
 
 private:
+    //==============================================================================
+    // Continuous parameters, already mapped to their DSP units by the setters
+    enum class ParameterId
+    {
+        phaserRate, phaserDepth, phaserMix, phaserFeedback,
+        delayTime, delayFeedback, delayMix,
+        chorusRate, chorusDepth, chorusMix, chorusFeedback,
+        distortionDrive, distortionMix,
+        reverbSize, reverbDamping, reverbMix,
+        filterCutoff, filterResonance, filterGain,
+        bitcrusherBitDepth, bitcrusherCrush, bitcrusherMix
+    };
+
+    static constexpr size_t numParameters = 22;
+
+    // Delay time glides slower, so sweeping it sounds like tape rather than a jump
+    static double getRampSeconds (ParameterId id)
+    {
+        return id == ParameterId::delayTime ? 0.2 : 0.05;
+    }
+
+    // Message thread -> audio thread: plain atomics, read once per block
+    std::array<std::atomic<float>, numParameters> parameterTargets {};
+    std::array<std::atomic<bool>, numStages> bypassTargets {};
+    std::atomic<int> filterTypeTarget { 0 };
+    std::atomic<bool> delayPingPongTarget { false }, delayFeedbackFilteredTarget { false };
+    std::atomic<bool> bitcrusherDitherTarget { false };
+    std::atomic<int> distortionOversamplingTarget { 1 };
+    std::atomic<bool> resetRequested { false };
+
+    std::atomic<float> bypassCrossfadeSeconds { 0.01f };
+
+    // Chain order packed 3 bits per position, so the whole order swaps in one atomic store
+    static constexpr juce::uint32 bitsPerStage = 3;
+    std::atomic<juce::uint32> chainOrderTarget { encodeDefaultOrder() };
+
+    static constexpr juce::uint32 encodeDefaultOrder()
+    {
+        juce::uint32 encoded = 0;
+
+        for (juce::uint32 position = 0; position < numStages; ++position)
+            encoded |= position << (position * bitsPerStage);
+
+        return encoded;
+    }
+
+    static Stage getStageAt (juce::uint32 encodedOrder, size_t position)
+    {
+        return static_cast<Stage> ((encodedOrder >> (position * bitsPerStage)) & ((1u << bitsPerStage) - 1));
+    }
+
+    // Bypass engine state for one stage - audio thread only
+    struct StageState
+    {
+        Stage stage = Stage::phaser;
+        juce::SmoothedValue<float> mix;  // How much of the stage's input it gets: 0 = bypassed, 1 = in the chain
+        bool isActive = false;           // False once bypassed, faded and silent - then it costs nothing
+        int numSilentSamples = 0;        // How long a bypassed stage's tail has been below the threshold
+    };
+
+    // Audio thread only
+    std::array<juce::SmoothedValue<float>, numParameters> smoothers;
+    std::array<StageState, numStages> stages;
+    int appliedFilterType = 0;
+
+    // The compiled plan: active stages only, in chain order - audio thread only
+    std::array<StageState*, numStages> plan {};
+    size_t numPlannedStages = 0;
+    bool planNeedsRebuild = true;
+    juce::uint32 appliedChainOrder = 0;
+    juce::SmoothedValue<float> reorderGain;  // Dips to 0 while an audible reorder swaps in
+
     // JUCE DSP effects
     juce::dsp::Phaser<float> phaser;
     juce::dsp::Chorus<float> chorus;
     juce::dsp::Reverb reverb;
-    juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Linear> delayLine;
+    StereoDelay stereoDelay;
     juce::dsp::StateVariableTPTFilter<float> filter;
-    juce::dsp::WaveShaper<float> distortion;
+    Distortion distortion;
 
     // BITCRUSHER effect - lo-fi digital degradation
-    float bitcrusherHoldSample[2] = {0.0f, 0.0f};  // Held samples for sample rate reduction
-    int bitcrusherCounter = 0;  // Counter for sample rate decimation
+    Bitcrusher bitcrusher;
 
     // Effect parameters
     juce::Reverb::Parameters reverbParams;
 
-    float delayTime = 0.5f;
-    float delayFeedback = 0.3f;
-    float delayMix = 0.5f;
+    float pitchShiftSemitones = 0.0f;
+
+    double sampleRate = 44100.0;
 
-    float distortionDrive = 1.0f;
-    float distortionMix = 0.5f;
+    bool pitchBypassed = false;  // Main pitch knob is ALWAYS active (not a toggleable effect)
 
-    float filterCutoff = 1000.0f;
-    float filterCutoffNormalized = 0.5f;  // Stored normalized value (0-1) for type switching
-    float filterResonance = 1.0f;
-    float filterGain = 1.0f;     // Output gain (0.1 to 2.0)
-    int filterType = 0;  // 0=LP, 1=HP, 2=BP
+    // Scratch storage sized in prepare(): the bypass crossfade's dry copy
+    static constexpr int numScratchBuffers = 1;
+    ScratchArena scratch;
 
-    float pitchShiftSemitones = 0.0f;
+    // Filter coefficients are recalculated this often while cutoff/resonance ramp
+    static constexpr size_t filterControlBlockSize = 32;
 
-    float bitcrusherBitDepth = 16.0f;     // Bit depth (1 to 16 bits)
-    float bitcrusherCrush = 1.0f;         // Sample rate reduction factor (1 to 32)
-    float bitcrusherMix = 0.5f;           // Mix amount
+    // A bypassed stage idles once its tail stays below -80 dB for this long (plus the delay time for the delay)
+    static constexpr float tailSilenceThreshold = 1.0e-4f;
+    static constexpr double tailHoldSeconds = 0.05;
 
-    double sampleRate = 44100.0;
+    //==============================================================================
+    void setTarget (ParameterId id, float value)
+    {
+        parameterTargets[static_cast<size_t> (id)].store (value, std::memory_order_relaxed);
+    }
 
-    // Bypass states (ALL start bypassed by default - user enables them)
-    bool phaserBypassed = true;
-    bool delayBypassed = true;
-    bool chorusBypassed = true;
-    bool distortionBypassed = true;
-    bool reverbBypassed = true;
-    bool filterBypassed = true;
-    bool pitchBypassed = false;  // Main pitch knob is ALWAYS active (not a toggleable effect)
-    bool bitcrusherBypassed = true;
+    void setBypassTarget (Stage stage, bool shouldBeBypassed)
+    {
+        bypassTargets[static_cast<size_t> (stage)] = shouldBeBypassed;
+    }
 
-    // Helper functions
-    void processDelay (juce::AudioBuffer<float>& buffer)
+    juce::SmoothedValue<float>& getSmoother (ParameterId id)
+    {
+        return smoothers[static_cast<size_t> (id)];
+    }
+
+    StageState& getStageState (Stage stage)
+    {
+        return stages[static_cast<size_t> (stage)];
+    }
+
+    // Audio thread: pick up everything the message thread changed since the last block
+    void pullParameters()
     {
-        int numSamples = buffer.getNumSamples();
-        int delaySamples = static_cast<int> (delayTime * sampleRate);
+        if (resetRequested.exchange (false))
+            resetStages();
 
-        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        for (size_t i = 0; i < numStages; ++i)
         {
-            auto* channelData = buffer.getWritePointer (channel);
+            auto& state = stages[i];
+            auto targetMix = bypassTargets[i].load() ? 0.0f : 1.0f;
 
-            for (int i = 0; i < numSamples; ++i)
+            if (targetMix == state.mix.getTargetValue())
+                continue;
+
+            // Coming back from idle: its state is stale, and nothing of it is audible yet
+            if (! state.isActive)
             {
-                float input = channelData[i];
-                float delayed = delayLine.popSample (channel);
+                resetStage (state.stage);
+                snapStageParameters (state.stage);
+                state.isActive = true;
+                planNeedsRebuild = true;
+            }
 
-                // Write input + feedback to delay line
-                delayLine.pushSample (channel, input + delayed * delayFeedback);
-                delayLine.setDelay (static_cast<float> (delaySamples));
+            if (! state.mix.isSmoothing())
+                state.mix.reset (sampleRate, bypassCrossfadeSeconds.load());
 
-                // Mix wet/dry
-                channelData[i] = input * (1.0f - delayMix) + delayed * delayMix;
-            }
+            state.mix.setTargetValue (targetMix);
+            state.numSilentSamples = 0;
         }
+
+        for (size_t i = 0; i < numParameters; ++i)
+            smoothers[i].setTargetValue (parameterTargets[i].load (std::memory_order_relaxed));
+
+        pullChainOrder();
+
+        stereoDelay.setPingPong (delayPingPongTarget.load());
+        stereoDelay.setFeedbackFiltered (delayFeedbackFilteredTarget.load());
+        distortion.setOversamplingFactor (distortionOversamplingTarget.load());
+        bitcrusher.setDitherEnabled (bitcrusherDitherTarget.load());
+
+        auto filterType = filterTypeTarget.load();
+
+        if (filterType != appliedFilterType)
+        {
+            appliedFilterType = filterType;
+            updateFilter();
+            filter.reset();  // Clear filter state to prevent pops when changing type
+        }
+    }
+
+    // Block-rate ramps for the JUCE modules and our own stages, which smooth internally between updates
+    void applyModuleParameters (int numSamples, bool force)
+    {
+        auto advance = [numSamples, force, this] (ParameterId id, auto&& apply)
+        {
+            auto& smoother = getSmoother (id);
+
+            if (smoother.isSmoothing())
+                apply (smoother.skip (numSamples));
+            else if (force)
+                apply (smoother.getCurrentValue());
+        };
+
+        advance (ParameterId::phaserRate,     [this] (float v) { phaser.setRate (v); });
+        advance (ParameterId::phaserDepth,    [this] (float v) { phaser.setDepth (v); });
+        advance (ParameterId::phaserMix,      [this] (float v) { phaser.setMix (v); });
+        advance (ParameterId::phaserFeedback, [this] (float v) { phaser.setFeedback (v); });
+
+        // The delay interpolates per sample across each block, so its time still glides like tape
+        advance (ParameterId::delayTime,     [this] (float v) { stereoDelay.setDelayTime (v); });
+        advance (ParameterId::delayFeedback, [this] (float v) { stereoDelay.setFeedback (v); });
+        advance (ParameterId::delayMix,      [this] (float v) { stereoDelay.setMix (v); });
+
+        advance (ParameterId::chorusRate,     [this] (float v) { chorus.setRate (v); });
+        advance (ParameterId::chorusDepth,    [this] (float v) { chorus.setDepth (v); });
+        advance (ParameterId::chorusMix,      [this] (float v) { chorus.setMix (v); });
+        advance (ParameterId::chorusFeedback, [this] (float v) { chorus.setFeedback (v); });
+
+        auto reverbChanged = force;
+        advance (ParameterId::reverbSize,    [this, &reverbChanged] (float v) { reverbParams.roomSize = v; reverbChanged = true; });
+        advance (ParameterId::reverbDamping, [this, &reverbChanged] (float v) { reverbParams.damping = v; reverbChanged = true; });
+        advance (ParameterId::reverbMix,     [this, &reverbChanged] (float v)
+        {
+            reverbParams.wetLevel = v;
+            reverbParams.dryLevel = 1.0f - v;
+            reverbChanged = true;
+        });
+
+        if (reverbChanged)
+            reverb.setParameters (reverbParams);
+
+        advance (ParameterId::distortionDrive, [this] (float v) { distortion.setDrive (v); });
+        advance (ParameterId::distortionMix,   [this] (float v) { distortion.setMix (v); });
+
+        // Bit depth and decimation only move the quantiser, so once per block is enough
+        advance (ParameterId::bitcrusherBitDepth, [this] (float v) { bitcrusher.setBitDepth (v); });
+        advance (ParameterId::bitcrusherCrush,    [this] (float v) { bitcrusher.setDownsampleFactor (v); });
+        advance (ParameterId::bitcrusherMix,      [this] (float v) { bitcrusher.setMix (v); });
+
+        if (force)
+            updateFilter();
+    }
+
+    void resetStage (Stage stage)
+    {
+        switch (stage)
+        {
+            case Stage::phaser:      phaser.reset(); break;
+            case Stage::delay:       stereoDelay.reset(); break;
+            case Stage::chorus:      chorus.reset(); break;
+            case Stage::distortion:  distortion.reset(); break;
+            case Stage::reverb:      reverb.reset(); break;
+            case Stage::filter:      filter.reset(); break;
+            case Stage::bitcrusher:  bitcrusher.reset(); break;
+        }
+    }
+
+    void resetStages()
+    {
+        for (size_t i = 0; i < numStages; ++i)
+            resetStage (static_cast<Stage> (i));
     }
 
-    void processDistortion (juce::AudioBuffer<float>& buffer)
+    void pullChainOrder()
     {
-        if (distortionMix < 0.01f)
-            return;  // Bypassed - do nothing
+        auto order = chainOrderTarget.load();
 
-        // Store REAL dry signal BEFORE any processing
-        juce::AudioBuffer<float> dryBuffer (buffer.getNumChannels(), buffer.getNumSamples());
-        dryBuffer.makeCopyOf (buffer);
+        if (order == appliedChainOrder || reorderGain.getTargetValue() < 1.0f)
+            return;  // Nothing new, or already ducking for a reorder - that picks up the latest order
 
-        // Apply drive to buffer (this will become the wet signal)
-        juce::dsp::AudioBlock<float> block (buffer);
-        block.multiplyBy (distortionDrive);
+        if (planNeedsRebuild)
+            rebuildPlan();
 
-        // Apply waveshaping to driven signal
+        // Only a change in the order of the stages actually running can be heard
+        std::array<StageState*, numStages> newPlan {};
+        auto numNewPlanned = compilePlan (order, newPlan);
+
+        if (numNewPlanned == numPlannedStages && std::equal (plan.begin(), plan.begin() + static_cast<std::ptrdiff_t> (numPlannedStages), newPlan.begin()))
+        {
+            appliedChainOrder = order;
+            return;
+        }
+
+        if (! reorderGain.isSmoothing())
+            reorderGain.reset (sampleRate, bypassCrossfadeSeconds.load());
+
+        reorderGain.setTargetValue (0.0f);
+    }
+
+    // Fills newPlan with the active stages of an encoded order and returns how many there are
+    size_t compilePlan (juce::uint32 encodedOrder, std::array<StageState*, numStages>& newPlan)
+    {
+        size_t numPlanned = 0;
+
+        for (size_t position = 0; position < numStages; ++position)
+        {
+            auto& state = getStageState (getStageAt (encodedOrder, position));
+
+            if (state.isActive)
+                newPlan[numPlanned++] = &state;
+        }
+
+        return numPlanned;
+    }
+
+    void rebuildPlan()
+    {
+        numPlannedStages = compilePlan (appliedChainOrder, plan);
+        planNeedsRebuild = false;
+    }
+
+    // Helper functions
+    void processBlock (juce::dsp::AudioBlock<float>& block)
+    {
+        applyModuleParameters (static_cast<int> (block.getNumSamples()), false);
+
+        if (planNeedsRebuild)
+            rebuildPlan();
+
+        // Process through effects chain - default order:
+        // Phaser → Delay → Chorus → Distortion → Reverb → Filter → Time Effect
+        // Note: Main pitch knob is handled at source level via ResamplingAudioSource
+        for (size_t i = 0; i < numPlannedStages; ++i)
+            processStageWithBypass (*plan[i], block);
+
+        applyReorderFade (block);
+    }
+
+    // Ducks the output while an audible reorder is pending, swaps the plan at silence, then fades back
+    void applyReorderFade (juce::dsp::AudioBlock<float>& block)
+    {
+        if (! reorderGain.isSmoothing() && reorderGain.getCurrentValue() >= 1.0f)
+            return;
+
+        auto startGain = reorderGain.getCurrentValue();
+        auto endGain = reorderGain.skip (static_cast<int> (block.getNumSamples()));
+        applyGainRamp (block, startGain, endGain);
+
+        if (endGain <= 0.0f)
+        {
+            appliedChainOrder = chainOrderTarget.load();
+            planNeedsRebuild = true;
+            reorderGain.setTargetValue (1.0f);
+        }
+    }
+
+    // The bypass engine: output = stage (input * mix) + input * (1 - mix)
+    // With mix at 0 the stage only outputs its tail, which is how delay/reverb ring out.
+    void processStageWithBypass (StageState& state, juce::dsp::AudioBlock<float>& block)
+    {
+        auto numSamples = static_cast<int> (block.getNumSamples());
+
+        scratch.reset();
+
+        if (! state.mix.isSmoothing() && state.mix.getCurrentValue() >= 1.0f)
+        {
+            processStage (state.stage, block);
+            return;
+        }
+
+        auto startMix = state.mix.getCurrentValue();
+        auto endMix = state.mix.skip (numSamples);
+
+        auto dryBlock = scratch.acquire (block.getNumChannels(), block.getNumSamples());
+        dryBlock.copyFrom (block);
+
+        applyGainRamp (block, startMix, endMix);
+        processStage (state.stage, block);
+
+        if (startMix <= 0.0f && endMix <= 0.0f)
+            trackTail (state, block);
+
+        addWithGainRamp (block, dryBlock, 1.0f - startMix, 1.0f - endMix);
+    }
+
+    // Fully bypassed: the block holds nothing but the stage's tail, so watch for it to die away
+    void trackTail (StageState& state, const juce::dsp::AudioBlock<float>& tail)
+    {
+        if (getPeak (tail) >= tailSilenceThreshold)
+        {
+            state.numSilentSamples = 0;
+            return;
+        }
+
+        state.numSilentSamples += static_cast<int> (tail.getNumSamples());
+
+        // A delay can be silent between repeats, so wait out one full delay time too
+        auto holdSeconds = tailHoldSeconds;
+
+        if (state.stage == Stage::delay)
+            holdSeconds += getSmoother (ParameterId::delayTime).getCurrentValue();
+
+        // Dropped from the plan from the next block on
+        if (state.numSilentSamples >= static_cast<int> (holdSeconds * sampleRate))
+        {
+            state.isActive = false;
+            planNeedsRebuild = true;
+        }
+    }
+
+    void processStage (Stage stage, juce::dsp::AudioBlock<float>& block)
+    {
         juce::dsp::ProcessContextReplacing<float> context (block);
-        distortion.process (context);
 
-        // Mix dry (normal level) with wet (distorted and loud)
-        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        switch (stage)
+        {
+            case Stage::phaser:      phaser.process (context); break;
+            case Stage::delay:       stereoDelay.process (block); break;
+            case Stage::chorus:      chorus.process (context); break;
+            case Stage::distortion:  distortion.process (block); break;
+            case Stage::reverb:      reverb.process (context); break;
+            case Stage::filter:      processFilter (block); break;
+            case Stage::bitcrusher:  bitcrusher.process (block); break;  // Lo-fi digital degradation
+        }
+    }
+
+    // Idle stages aren't run, so their per-sample ramps stand still - jump them to their targets
+    // when the stage comes back. Every other stage's parameters are advanced by
+    // applyModuleParameters() whatever its state.
+    void snapStageParameters (Stage stage)
+    {
+        auto snap = [this] (std::initializer_list<ParameterId> ids)
+        {
+            for (auto id : ids)
+                getSmoother (id).setCurrentAndTargetValue (getSmoother (id).getTargetValue());
+        };
+
+        switch (stage)
         {
-            auto* output = buffer.getWritePointer (ch);
-            auto* dry = dryBuffer.getReadPointer (ch);
+            case Stage::filter:      snap ({ ParameterId::filterCutoff, ParameterId::filterResonance, ParameterId::filterGain }); break;
+            case Stage::phaser:
+            case Stage::delay:
+            case Stage::chorus:
+            case Stage::distortion:
+            case Stage::reverb:
+            case Stage::bitcrusher:
+                break;
+        }
+    }
 
-            for (int i = 0; i < buffer.getNumSamples(); ++i)
+    void processFilter (juce::dsp::AudioBlock<float>& block)
+    {
+        auto& cutoff = getSmoother (ParameterId::filterCutoff);
+        auto& resonance = getSmoother (ParameterId::filterResonance);
+
+        if (! cutoff.isSmoothing() && ! resonance.isSmoothing())
+        {
+            juce::dsp::ProcessContextReplacing<float> context (block);
+            filter.process (context);
+        }
+        else
+        {
+            // Sweeps move the coefficients every few samples instead of once per block
+            for (size_t start = 0; start < block.getNumSamples(); start += filterControlBlockSize)
             {
-                // Wet signal is already amplified by distortionDrive and distorted
-                // Mix with original dry signal at normal level
-                output[i] = dry[i] * (1.0f - distortionMix) + output[i] * distortionMix;
+                auto numThisTime = juce::jmin (filterControlBlockSize, block.getNumSamples() - start);
+                cutoff.skip (static_cast<int> (numThisTime));
+                resonance.skip (static_cast<int> (numThisTime));
+                updateFilter();
+
+                auto subBlock = block.getSubBlock (start, numThisTime);
+                juce::dsp::ProcessContextReplacing<float> context (subBlock);
+                filter.process (context);
             }
         }
+
+        // Apply gain to filter output
+        applySmoothedGain (block, getSmoother (ParameterId::filterGain));
     }
 
     void updateFilter()
     {
         using FilterType = juce::dsp::StateVariableTPTFilterType;
 
-        switch (filterType)
+        auto cutoffNormalized = getSmoother (ParameterId::filterCutoff).getCurrentValue();
+        float cutoffHz = 1000.0f;
+
+        // Different mapping based on filter type for intuitive control
+        switch (appliedFilterType)
         {
-            case 0:
+            case 0:  // Low-pass: 0=muffled(100Hz), 1=open(20kHz)
                 filter.setType (FilterType::lowpass);
+                cutoffHz = 100.0f * std::pow (200.0f, cutoffNormalized);
                 break;
-            case 1:
+            case 1:  // High-pass: 0=open(20Hz), 1=thin(10kHz) - REVERSED for natural feel
                 filter.setType (FilterType::highpass);
+                cutoffHz = 20.0f * std::pow (500.0f, 1.0f - cutoffNormalized);  // Inverted mapping
                 break;
-            case 2:
+            case 2:  // Band-pass: 0=low band, 1=high band
                 filter.setType (FilterType::bandpass);
+                cutoffHz = 100.0f * std::pow (200.0f, cutoffNormalized);
                 break;
         }
 
-        filter.setCutoffFrequency (filterCutoff);
-        filter.setResonance (filterResonance);
+        filter.setCutoffFrequency (juce::jmin (cutoffHz, static_cast<float> (sampleRate * 0.45)));
+        filter.setResonance (getSmoother (ParameterId::filterResonance).getCurrentValue());
     }
 
-    // Process BITCRUSHER effect - lo-fi digital degradation
-    void processBitcrusher (juce::AudioBuffer<float>& buffer)
+    static void applyGainRamp (juce::dsp::AudioBlock<float>& block, float startGain, float endGain)
     {
-        int numSamples = buffer.getNumSamples();
-        int numChannels = buffer.getNumChannels();
+        auto increment = (endGain - startGain) / static_cast<float> (juce::jmax ((size_t) 1, block.getNumSamples()));
 
-        // Store dry signal for mixing
-        juce::AudioBuffer<float> dryBuffer (numChannels, numSamples);
-        dryBuffer.makeCopyOf (buffer);
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            auto* data = block.getChannelPointer (ch);
 
-        // Calculate quantization step size based on bit depth
-        float levels = std::pow (2.0f, bitcrusherBitDepth);  // e.g., 16 bits = 65536 levels
-        float stepSize = 2.0f / levels;  // Audio range is -1.0 to +1.0
+            for (size_t i = 0; i < block.getNumSamples(); ++i)
+                data[i] *= startGain + increment * static_cast<float> (i);
+        }
+    }
 
-        int crushFactor = static_cast<int> (bitcrusherCrush);  // Sample rate reduction factor
+    static void addWithGainRamp (juce::dsp::AudioBlock<float>& block, const juce::dsp::AudioBlock<float>& source,
+                                 float startGain, float endGain)
+    {
+        auto increment = (endGain - startGain) / static_cast<float> (juce::jmax ((size_t) 1, block.getNumSamples()));
 
-        // Process each channel
-        for (int ch = 0; ch < numChannels; ++ch)
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
         {
-            auto* channelData = buffer.getWritePointer (ch);
+            auto* data = block.getChannelPointer (ch);
+            auto* input = source.getChannelPointer (ch);
 
-            for (int i = 0; i < numSamples; ++i)
-            {
-                // Sample rate reduction (hold samples)
-                if (bitcrusherCounter == 0)
-                {
-                    // Update held sample
-                    float input = channelData[i];
+            for (size_t i = 0; i < block.getNumSamples(); ++i)
+                data[i] += input[i] * (startGain + increment * static_cast<float> (i));
+        }
+    }
 
-                    // Bit depth reduction (quantization)
-                    float quantized = std::floor (input / stepSize) * stepSize;
-                    quantized = juce::jlimit (-1.0f, 1.0f, quantized);
+    static float getPeak (const juce::dsp::AudioBlock<float>& block)
+    {
+        auto peak = 0.0f;
 
-                    bitcrusherHoldSample[ch] = quantized;
-                }
+        for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        {
+            auto range = juce::FloatVectorOperations::findMinAndMax (block.getChannelPointer (ch),
+                                                                    static_cast<int> (block.getNumSamples()));
+            peak = juce::jmax (peak, -range.getStart(), range.getEnd());
+        }
 
-                // Output the held sample
-                channelData[i] = bitcrusherHoldSample[ch];
+        return peak;
+    }
 
-                // Increment counter
-                bitcrusherCounter = (bitcrusherCounter + 1) % crushFactor;
-            }
+    static void applySmoothedGain (juce::dsp::AudioBlock<float>& block, juce::SmoothedValue<float>& gain)
+    {
+        if (! gain.isSmoothing())
+        {
+            block.multiplyBy (gain.getCurrentValue());
+            return;
         }
 
-        // Mix wet/dry
-        for (int ch = 0; ch < numChannels; ++ch)
+        for (size_t i = 0; i < block.getNumSamples(); ++i)
         {
-            auto* out = buffer.getWritePointer (ch);
-            auto* dry = dryBuffer.getReadPointer (ch);
+            auto g = gain.getNextValue();
 
-            for (int i = 0; i < numSamples; ++i)
-            {
-                out[i] = dry[i] * (1.0f - bitcrusherMix) + out[i] * bitcrusherMix;
-            }
+            for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+                block.getChannelPointer (ch)[i] *= g;
         }
     }
 
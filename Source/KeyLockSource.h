@@ -0,0 +1,588 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <vector>
+#include "SoundTouch/SoundTouch.h"
+
+//==============================================================================
+/**
+ * Key-lock stage: SoundTouch time-stretching run on a background thread
+ *
+ * Sits between the read-ahead buffer and the turntable resampler. With key
+ * lock off it passes audio straight through. With it on, SoundTouch stretches
+ * the track by the pitch ratio before the resampler shortens it again, so the
+ * pitch knob changes the key and the tempo stays put. Both modes share the
+ * same resampler, so the pitch itself never jumps.
+ *
+ * The audio thread only copies: it reads the input into a history ring,
+ * pushes it into a lock-free FIFO for the stretcher and pulls finished audio
+ * from a second FIFO. SoundTouch runs on a shared TimeSliceThread and is
+ * kept a fixed amount of input ahead of what's being heard.
+ *
+ * Switching on keeps the plain signal playing until the stretcher has caught
+ * up to the same position, then crossfades. Switching off picks the plain
+ * signal up from the history ring wherever the stretched one had got to.
+ */
+class KeyLockSource : public juce::PositionableAudioSource,
+                      private juce::TimeSliceClient
+{
+public:
+    KeyLockSource (juce::PositionableAudioSource* inputSource, bool deleteInputWhenDeleted,
+                   juce::TimeSliceThread& thread, double sourceSampleRateToUse)
+        : input (inputSource, deleteInputWhenDeleted),
+          backgroundThread (thread),
+          sourceSampleRate (sourceSampleRateToUse > 0.0 ? sourceSampleRateToUse : 44100.0)
+    {
+        stretcher.setChannels (numChannels);
+        stretcher.setSampleRate (static_cast<juce::uint32> (sourceSampleRate));
+    }
+
+    ~KeyLockSource() override
+    {
+        releaseResources();
+    }
+
+    // Any thread - the switch starts at the next block
+    void setEnabled (bool shouldBeEnabled)  { enabled = shouldBeEnabled; }
+    bool isEnabled() const noexcept         { return enabled.load(); }
+
+    // Source samples consumed per output sample while key-locked: the inverse of the resampler's pitch ratio
+    void setTempo (double newTempo)  { tempo = juce::jlimit (minimumTempo, maximumTempo, newTempo); }
+
+    // Audio thread: source samples the audible output advanced by per sample in the last block
+    double getInputSamplesPerOutputSample() const noexcept
+    {
+        return stage == Stage::stretched || stage == Stage::fadingIn ? tempo.load() : 1.0;
+    }
+
+    // How far ahead of the audible position the stretcher reads, in source samples. Valid after prepareToPlay().
+    int getLatencySamples() const noexcept  { return latencySamples.load(); }
+
+    int getNumUnderruns() const noexcept               { return numUnderruns.load(); }
+    juce::int64 getNumUnderrunSamples() const noexcept { return numUnderrunSamples.load(); }
+
+    //==============================================================================
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        backgroundThread.removeTimeSliceClient (this);
+
+        input->prepareToPlay (samplesPerBlockExpected, sampleRate);
+        chunkSize = juce::jmax (1, samplesPerBlockExpected);
+
+        // The stretcher needs the most look-ahead at its fastest tempo
+        stretcher.setTempo (maximumTempo);
+        auto stretcherLatency = stretcher.getSetting (SETTING_INITIAL_LATENCY)
+                                  + stretcher.getSetting (SETTING_NOMINAL_INPUT_SEQUENCE);
+        stretcher.setTempo (1.0);
+        stretcher.clear();
+        appliedTempo = 1.0;
+
+        backlogSamples = stretcherLatency + static_cast<int> (std::ceil (2.0 * chunkSize * maximumTempo));
+        latencySamples = backlogSamples;
+        fadeSamples = static_cast<int> (fadeSeconds * sourceSampleRate);
+
+        // Enough history for the switch back to plain playback to find the stretcher's position
+        auto ringSize = juce::nextPowerOfTwo (2 * (backlogSamples + fadeSamples) + 4 * chunkSize);
+        historyRing.setSize (numChannels, ringSize);
+        ringMask = ringSize - 1;
+
+        inputFifoBuffer.setSize (numChannels, ringSize);
+        inputFifo.setTotalSize (ringSize);
+        outputFifoBuffer.setSize (numChannels, 2 * ringSize);
+        outputFifo.setTotalSize (2 * ringSize);
+        blendBuffer.setSize (numChannels, chunkSize);
+        interleaved.assign (static_cast<size_t> (workerChunkSize * numChannels), 0.0f);
+
+        stage = Stage::direct;
+        active = false;
+        acknowledgedGeneration = workerGeneration = generation.load();
+        isPrepared = true;
+
+        // Carry on from wherever the input is - seeking it again would throw away its priming
+        historyEnd = directPosition = input->getNextReadPosition();
+
+        backgroundThread.addTimeSliceClient (this);
+    }
+
+    void releaseResources() override
+    {
+        backgroundThread.removeTimeSliceClient (this);
+
+        if (isPrepared)
+        {
+            isPrepared = false;
+            input->releaseResources();
+        }
+
+        historyRing.setSize (numChannels, 0);
+        inputFifoBuffer.setSize (numChannels, 0);
+        outputFifoBuffer.setSize (numChannels, 0);
+        inputFifo.reset();
+        outputFifo.reset();
+    }
+
+    // Audio thread: copies and FIFO traffic only, SoundTouch never runs here
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& info) override
+    {
+        if (! isPrepared)
+        {
+            info.clearActiveBufferRegion();
+            return;
+        }
+
+        jassert (info.buffer->getNumChannels() >= numChannels);
+
+        updateStage (enabled.load());
+
+        // Larger requests than prepared for are split rather than allocating
+        for (int start = 0; start < info.numSamples; start += chunkSize)
+            renderChunk (*info.buffer, info.startSample + start, juce::jmin (chunkSize, info.numSamples - start));
+
+        for (int ch = numChannels; ch < info.buffer->getNumChannels(); ++ch)
+            info.buffer->copyFrom (ch, info.startSample, *info.buffer, ch % numChannels, info.startSample, info.numSamples);
+    }
+
+    //==============================================================================
+    void setNextReadPosition (juce::int64 newPosition) override
+    {
+        input->setNextReadPosition (newPosition);
+
+        historyEnd = directPosition = newPosition;
+
+        if (stage != Stage::direct)
+        {
+            // Nothing stretched from the old position is any use - play plain until the stretcher catches up
+            stopStretcher();
+
+            if (enabled.load())
+                startStretcher();
+        }
+    }
+
+    // The audible position, not how far ahead the stretcher has read
+    juce::int64 getNextReadPosition() const override
+    {
+        if (stage == Stage::stretched || stage == Stage::fadingIn)
+            return static_cast<juce::int64> (stretchPosition);
+
+        return directPosition;
+    }
+
+    juce::int64 getTotalLength() const override     { return input->getTotalLength(); }
+    bool isLooping() const override                 { return input->isLooping(); }
+    void setLooping (bool shouldLoop) override      { input->setLooping (shouldLoop); }
+
+private:
+    //==============================================================================
+    enum class Stage
+    {
+        direct,     // Plain input, stretcher idle
+        warming,    // Plain input audible, stretcher catching up
+        fadingIn,   // Crossfading plain -> stretched
+        stretched,  // Stretched only
+        fadingOut   // Crossfading stretched -> plain
+    };
+
+    void updateStage (bool wantsKeyLock)
+    {
+        switch (stage)
+        {
+            case Stage::direct:
+                if (wantsKeyLock)
+                    startStretcher();
+                break;
+
+            case Stage::warming:
+                if (! wantsKeyLock)
+                    stopStretcher();
+                break;
+
+            case Stage::stretched:
+                if (! wantsKeyLock)
+                {
+                    // Plain playback resumes from the history ring at the stretched position
+                    directPosition = static_cast<juce::int64> (std::llround (stretchPosition));
+                    stage = Stage::fadingOut;
+                    fadePosition = 0;
+                }
+                break;
+
+            case Stage::fadingIn:
+                if (! wantsKeyLock)
+                {
+                    stage = Stage::fadingOut;
+                    fadePosition = fadeSamples - fadePosition;
+                }
+                break;
+
+            case Stage::fadingOut:
+                if (wantsKeyLock)
+                {
+                    stage = Stage::fadingIn;
+                    fadePosition = fadeSamples - fadePosition;
+                }
+                break;
+        }
+    }
+
+    void renderChunk (juce::AudioBuffer<float>& output, int outputStart, int numSamples)
+    {
+        if (stage == Stage::direct)
+        {
+            readDirect (output, outputStart, numSamples);
+            return;
+        }
+
+        auto currentTempo = tempo.load();
+
+        if (stage == Stage::warming && ! alignStretcher (numSamples, currentTempo))
+        {
+            feedStretcher (numSamples, currentTempo);
+            readDirect (output, outputStart, numSamples);
+            return;
+        }
+
+        feedStretcher (numSamples, currentTempo);
+
+        if (stage == Stage::stretched)
+        {
+            readStretched (output, outputStart, numSamples, currentTempo);
+            return;
+        }
+
+        // The two paths play the same music in step, so a linear fade keeps the level
+        readDirect (output, outputStart, numSamples);
+        readStretched (blendBuffer, 0, numSamples, currentTempo);
+
+        auto numFading = juce::jmin (numSamples, fadeSamples - fadePosition);
+        auto startGain = static_cast<float> (fadePosition) / static_cast<float> (fadeSamples);
+        auto endGain = static_cast<float> (fadePosition + numFading) / static_cast<float> (fadeSamples);
+
+        if (stage == Stage::fadingOut)
+        {
+            startGain = 1.0f - startGain;
+            endGain = 1.0f - endGain;
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            output.applyGainRamp (ch, outputStart, numFading, 1.0f - startGain, 1.0f - endGain);
+            output.addFromWithRamp (ch, outputStart, blendBuffer.getReadPointer (ch), numFading, startGain, endGain);
+
+            // Whatever's left of the chunk after the fade belongs to the path being faded to
+            if (numFading < numSamples)
+            {
+                if (stage == Stage::fadingIn)
+                    output.copyFrom (ch, outputStart + numFading, blendBuffer, ch, numFading, numSamples - numFading);
+            }
+        }
+
+        fadePosition += numFading;
+
+        if (fadePosition >= fadeSamples)
+        {
+            if (stage == Stage::fadingIn)
+                stage = Stage::stretched;
+            else
+                stopStretcher();
+        }
+    }
+
+    //==============================================================================
+    // Plain path: straight out of the history ring, topping it up from the input as needed
+    void readDirect (juce::AudioBuffer<float>& output, int outputStart, int numSamples)
+    {
+        fillHistory (directPosition + numSamples);
+        copyFromHistory (output, outputStart, directPosition, numSamples);
+        directPosition += numSamples;
+    }
+
+    void fillHistory (juce::int64 end)
+    {
+        while (historyEnd < end)
+        {
+            auto ringIndex = static_cast<int> (historyEnd & ringMask);
+            auto numThisTime = static_cast<int> (juce::jmin (end - historyEnd, static_cast<juce::int64> (historyRing.getNumSamples() - ringIndex)));
+
+            input->getNextAudioBlock (juce::AudioSourceChannelInfo (&historyRing, ringIndex, numThisTime));
+            historyEnd += numThisTime;
+        }
+    }
+
+    void copyFromHistory (juce::AudioBuffer<float>& destination, int destinationStart, juce::int64 position, int numSamples)
+    {
+        jassert (position >= historyEnd - historyRing.getNumSamples() && position + numSamples <= historyEnd);
+
+        for (int done = 0; done < numSamples;)
+        {
+            auto ringIndex = static_cast<int> ((position + done) & ringMask);
+            auto numThisTime = juce::jmin (numSamples - done, historyRing.getNumSamples() - ringIndex);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                destination.copyFrom (ch, destinationStart + done, historyRing, ch, ringIndex, numThisTime);
+
+            done += numThisTime;
+        }
+    }
+
+    //==============================================================================
+    // Restarts the stretcher from the plain path's position. It catches up in the warming stage.
+    void startStretcher()
+    {
+        ++generation;
+        active = true;
+        isStretcherReady = false;
+        stretchPosition = static_cast<double> (directPosition);
+        stretchFeedPosition = directPosition;
+        stage = Stage::warming;
+    }
+
+    void stopStretcher()
+    {
+        ++generation;  // Clears SoundTouch and whatever is still queued for it
+        active = false;
+        isStretcherReady = false;
+        stage = Stage::direct;
+    }
+
+    // Warming up: returns true once the stretched output has caught up with the plain path
+    bool alignStretcher (int numSamples, double currentTempo)
+    {
+        // Only happens if the machine can't stretch in real time - start again from here rather than fall off the history
+        if (directPosition - stretchFeedPosition > backlogSamples)
+        {
+            startStretcher();
+            return false;
+        }
+
+        if (! isStretcherReady)
+        {
+            if (acknowledgedGeneration.load() != generation.load())
+                return false;
+
+            // Anything still in the output FIFO came from before the restart
+            int start1, size1, start2, size2;
+            outputFifo.prepareToRead (outputFifo.getNumReady(), start1, size1, start2, size2);
+            outputFifo.finishedRead (size1 + size2);
+            isStretcherReady = true;
+        }
+
+        // Output from before the plain path's position has already been heard - drop it
+        auto behind = static_cast<double> (directPosition) - stretchPosition;
+
+        if (behind > 0.0)
+        {
+            auto numToSkip = juce::jmin (outputFifo.getNumReady(), static_cast<int> (std::ceil (behind / currentTempo)));
+
+            int start1, size1, start2, size2;
+            outputFifo.prepareToRead (numToSkip, start1, size1, start2, size2);
+            outputFifo.finishedRead (size1 + size2);
+            stretchPosition += (size1 + size2) * currentTempo;
+        }
+
+        if (stretchPosition < static_cast<double> (directPosition) || outputFifo.getNumReady() < numSamples)
+            return false;
+
+        stage = Stage::fadingIn;
+        fadePosition = 0;
+        return true;
+    }
+
+    // Keeps the stretcher a fixed backlog ahead of what's about to be heard
+    void feedStretcher (int numSamples, double currentTempo)
+    {
+        if (! isStretcherReady)
+            return;  // Still clearing out the previous run
+
+        auto heardUpTo = juce::jmax (stretchPosition, static_cast<double> (directPosition));
+        auto target = static_cast<juce::int64> (std::ceil (heardUpTo + numSamples * currentTempo)) + backlogSamples;
+        auto numToPush = static_cast<int> (juce::jmin (target - stretchFeedPosition, static_cast<juce::int64> (inputFifo.getFreeSpace())));
+
+        if (numToPush > 0)
+        {
+            fillHistory (stretchFeedPosition + numToPush);
+
+            int start1, size1, start2, size2;
+            inputFifo.prepareToWrite (numToPush, start1, size1, start2, size2);
+
+            if (size1 > 0)
+                copyFromHistory (inputFifoBuffer, start1, stretchFeedPosition, size1);
+
+            if (size2 > 0)
+                copyFromHistory (inputFifoBuffer, start2, stretchFeedPosition + size1, size2);
+
+            inputFifo.finishedWrite (size1 + size2);
+            stretchFeedPosition += size1 + size2;
+        }
+    }
+
+    void readStretched (juce::AudioBuffer<float>& destination, int destinationStart, int numSamples, double currentTempo)
+    {
+        int start1, size1, start2, size2;
+        outputFifo.prepareToRead (numSamples, start1, size1, start2, size2);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            if (size1 > 0)
+                destination.copyFrom (ch, destinationStart, outputFifoBuffer, ch, start1, size1);
+
+            if (size2 > 0)
+                destination.copyFrom (ch, destinationStart + size1, outputFifoBuffer, ch, start2, size2);
+        }
+
+        auto numRead = size1 + size2;
+        outputFifo.finishedRead (numRead);
+
+        if (numRead < numSamples)
+        {
+            // The stretcher fell behind - rare, since it runs a whole backlog ahead
+            destination.clear (destinationStart + numRead, numSamples - numRead);
+            ++numUnderruns;
+            numUnderrunSamples += numSamples - numRead;
+        }
+
+        stretchPosition += numRead * currentTempo;
+    }
+
+    //==============================================================================
+    // Background thread: runs SoundTouch on whatever the audio thread has queued.
+    // Never woken by the audio thread - it polls every couple of milliseconds while
+    // key lock is on, which is well within the backlog it keeps ahead.
+    int useTimeSlice() override
+    {
+        auto requestedGeneration = generation.load();
+
+        if (requestedGeneration != workerGeneration)
+        {
+            stretcher.clear();
+
+            int start1, size1, start2, size2;
+            inputFifo.prepareToRead (inputFifo.getNumReady(), start1, size1, start2, size2);
+            inputFifo.finishedRead (size1 + size2);
+
+            workerGeneration = requestedGeneration;
+            acknowledgedGeneration = requestedGeneration;
+        }
+
+        if (! active.load())
+            return 20;
+
+        auto newTempo = tempo.load();
+
+        if (newTempo != appliedTempo)
+        {
+            stretcher.setTempo (newTempo);
+            appliedTempo = newTempo;
+        }
+
+        auto didWork = drainStretcher();
+
+        // Only take more input while there's room for what it turns into
+        while (inputFifo.getNumReady() > 0 && static_cast<int> (stretcher.numSamples()) < outputFifo.getFreeSpace())
+        {
+            int start1, size1, start2, size2;
+            inputFifo.prepareToRead (juce::jmin (workerChunkSize, inputFifo.getNumReady()), start1, size1, start2, size2);
+
+            interleave (start1, size1, 0);
+            interleave (start2, size2, size1);
+            stretcher.putSamples (interleaved.data(), static_cast<juce::uint32> (size1 + size2));
+            inputFifo.finishedRead (size1 + size2);
+
+            drainStretcher();
+            didWork = true;
+        }
+
+        return didWork ? 0 : 2;
+    }
+
+    void interleave (int fifoStart, int numSamples, int destinationOffset)
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* source = inputFifoBuffer.getReadPointer (ch, fifoStart);
+            auto* destination = interleaved.data() + destinationOffset * numChannels + ch;
+
+            for (int i = 0; i < numSamples; ++i)
+                destination[i * numChannels] = source[i];
+        }
+    }
+
+    void deinterleave (int sourceOffset, int fifoStart, int numSamples)
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* source = interleaved.data() + sourceOffset * numChannels + ch;
+            auto* destination = outputFifoBuffer.getWritePointer (ch, fifoStart);
+
+            for (int i = 0; i < numSamples; ++i)
+                destination[i] = source[i * numChannels];
+        }
+    }
+
+    // Moves finished audio into the output FIFO. Returns true if there was any.
+    bool drainStretcher()
+    {
+        auto didWork = false;
+
+        for (;;)
+        {
+            auto numToMove = juce::jmin (static_cast<int> (stretcher.numSamples()), outputFifo.getFreeSpace(), workerChunkSize);
+
+            if (numToMove <= 0)
+                return didWork;
+
+            numToMove = static_cast<int> (stretcher.receiveSamples (interleaved.data(), static_cast<juce::uint32> (numToMove)));
+
+            int start1, size1, start2, size2;
+            outputFifo.prepareToWrite (numToMove, start1, size1, start2, size2);
+
+            deinterleave (0, start1, size1);
+            deinterleave (size1, start2, size2);
+
+            outputFifo.finishedWrite (size1 + size2);
+            didWork = true;
+        }
+    }
+
+    //==============================================================================
+    static constexpr int numChannels = 2;
+    static constexpr int workerChunkSize = 1024;
+    static constexpr double minimumTempo = 0.5, maximumTempo = 2.0;  // The resampler's pitch range
+    static constexpr double fadeSeconds = 0.03;
+
+    juce::OptionalScopedPointer<juce::PositionableAudioSource> input;
+    juce::TimeSliceThread& backgroundThread;
+    const double sourceSampleRate;
+    bool isPrepared = false;
+
+    std::atomic<bool> enabled { false };
+    std::atomic<double> tempo { 1.0 };
+    std::atomic<int> latencySamples { 0 };
+
+    // Audio thread
+    Stage stage = Stage::direct;
+    juce::AudioBuffer<float> historyRing;  // Input read so far, the plain path plays from here
+    juce::AudioBuffer<float> blendBuffer;  // Stretched audio while crossfading
+    int ringMask = 0, chunkSize = 0, backlogSamples = 0, fadeSamples = 1, fadePosition = 0;
+    juce::int64 historyEnd = 0, directPosition = 0, stretchFeedPosition = 0;
+    double stretchPosition = 0.0;  // Source position of the next stretched sample to be heard
+    bool isStretcherReady = false;
+
+    // Audio thread -> background thread
+    juce::AudioBuffer<float> inputFifoBuffer, outputFifoBuffer;
+    juce::AbstractFifo inputFifo { 1 }, outputFifo { 1 };
+    std::atomic<int> generation { 0 }, acknowledgedGeneration { 0 };  // Bumped to clear the stretcher
+    std::atomic<bool> active { false };
+
+    // Background thread
+    soundtouch::SoundTouch stretcher;
+    std::vector<float> interleaved;
+    int workerGeneration = 0;
+    double appliedTempo = 1.0;
+
+    std::atomic<int> numUnderruns { 0 };
+    std::atomic<juce::int64> numUnderrunSamples { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (KeyLockSource)
+};
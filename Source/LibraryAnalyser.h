@@ -0,0 +1,236 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <set>
+#include <vector>
+#include "LibraryIndex.h"
+#include "LoudnessMeter.h"
+#include "SoundTouch/BPMDetect.h"
+
+//==============================================================================
+/**
+ * Works out loudness, tempo and a peak overview for every track in the library
+ *
+ * Each track is one job on a pool of background-priority threads, so idle
+ * threads just pick up the next track and a big library spreads over every
+ * core given. A job decodes its track once and feeds each block to the
+ * R128 loudness meter, SoundTouch's BPMDetect and the peak overview, then
+ * stores the results in the LibraryIndex.
+ *
+ * Tracks are streamed from their files rather than through the decoded
+ * track cache, so a pass over the whole library doesn't push out what's
+ * about to play. setMaxConcurrentJobs() throttles it, down to 0 to pause.
+ */
+class LibraryAnalyser
+{
+public:
+    LibraryAnalyser (juce::AudioFormatManager& formatManagerToUse, LibraryIndex& indexToUpdate,
+                     int numThreads = juce::jmax (1, juce::SystemStats::getNumCpus() - 1))
+        : formatManager (formatManagerToUse),
+          index (indexToUpdate),
+          maxConcurrentJobs (numThreads),
+          pool (juce::ThreadPoolOptions()
+                    .withThreadName ("Library Analysis")
+                    .withNumberOfThreads (numThreads)
+                    .withDesiredThreadPriority (juce::Thread::Priority::background))
+    {
+    }
+
+    ~LibraryAnalyser()
+    {
+        pool.removeAllJobs (true, 4000);
+    }
+
+    // Queues whichever of the files aren't queued already
+    void analyse (const juce::Array<juce::File>& files)
+    {
+        for (auto& file : files)
+        {
+            {
+                const juce::ScopedLock sl (lock);
+
+                if (! queuedPaths.insert (file.getFullPathName()).second)
+                    continue;
+            }
+
+            pool.addJob (new AnalysisJob (*this, file), true);
+        }
+    }
+
+    // How many tracks may be analysed at once - 0 pauses, anything above the thread count has no effect
+    void setMaxConcurrentJobs (int maxJobs)   { maxConcurrentJobs = juce::jmax (0, maxJobs); }
+    int getMaxConcurrentJobs() const noexcept { return maxConcurrentJobs.load(); }
+
+    int getNumTracksPending() const           { return pool.getNumJobs(); }
+    int getNumTracksAnalysed() const noexcept { return numAnalysed.load(); }
+
+private:
+    //==============================================================================
+    class AnalysisJob : public juce::ThreadPoolJob
+    {
+    public:
+        AnalysisJob (LibraryAnalyser& a, const juce::File& f)
+            : juce::ThreadPoolJob ("Analyse " + f.getFileName()), analyser (a), file (f) {}
+
+        JobStatus runJob() override
+        {
+            // Throttled: give the thread back for a bit and try again
+            if (! analyser.tryStartJob())
+            {
+                juce::Thread::sleep (throttledRetryMs);
+                return jobNeedsRunningAgain;
+            }
+
+            LibraryIndex::Analysis result;
+
+            if (analyser.analyseFile (file, result, *this))
+            {
+                analyser.index.setAnalysis (file, result);
+                ++analyser.numAnalysed;
+            }
+
+            analyser.finishJob (file);
+            return jobHasFinished;
+        }
+
+    private:
+        LibraryAnalyser& analyser;
+        juce::File file;
+    };
+
+    //==============================================================================
+    bool tryStartJob()
+    {
+        auto running = runningJobs.load();
+
+        do
+        {
+            if (running >= maxConcurrentJobs.load())
+                return false;
+        }
+        while (! runningJobs.compare_exchange_weak (running, running + 1));
+
+        return true;
+    }
+
+    void finishJob (const juce::File& file)
+    {
+        --runningJobs;
+
+        const juce::ScopedLock sl (lock);
+        queuedPaths.erase (file.getFullPathName());
+    }
+
+    // One decode pass with every analysis fed from the same blocks. False if the file can't be read or the job was stopped.
+    bool analyseFile (const juce::File& file, LibraryIndex::Analysis& result, const juce::ThreadPoolJob& job)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+        if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+            return false;
+
+        auto numChannels = static_cast<int> (juce::jmax (1u, reader->numChannels));
+        auto length = reader->lengthInSamples;
+
+        LoudnessMeter loudness (numChannels, reader->sampleRate);
+        soundtouch::BPMDetect tempo (numChannels, static_cast<int> (reader->sampleRate));
+        std::array<float, LibraryIndex::numPeaks> peaks {};
+
+        juce::AudioBuffer<float> buffer (numChannels, chunkSize);
+        std::vector<float> interleaved (static_cast<size_t> (numChannels * chunkSize));
+
+        for (juce::int64 position = 0; position < length; position += chunkSize)
+        {
+            if (job.shouldExit())
+                return false;
+
+            auto numThisTime = static_cast<int> (juce::jmin ((juce::int64) chunkSize, length - position));
+
+            if (! reader->read (&buffer, 0, numThisTime, position, true, true))
+                return false;
+
+            loudness.process (buffer, numThisTime);
+
+            // A chunk spans one or more peak bins; each bin covers the samples that map onto it
+            for (int i = 0; i < numThisTime;)
+            {
+                auto bin = (position + i) * LibraryIndex::numPeaks / length;
+                auto binEnd = ((bin + 1) * length + LibraryIndex::numPeaks - 1) / LibraryIndex::numPeaks;
+                auto numInBin = static_cast<int> (juce::jmin ((juce::int64) numThisTime, binEnd - position)) - i;
+                auto& peak = peaks[static_cast<size_t> (bin)];
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                {
+                    auto range = juce::FloatVectorOperations::findMinAndMax (buffer.getReadPointer (ch, i), numInBin);
+                    peak = juce::jmax (peak, -range.getStart(), range.getEnd());
+                }
+
+                i += numInBin;
+            }
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                const auto* samples = buffer.getReadPointer (ch);
+
+                for (int i = 0; i < numThisTime; ++i)
+                    interleaved[static_cast<size_t> (i * numChannels + ch)] = samples[i];
+            }
+
+            tempo.inputSamples (interleaved.data(), numThisTime);
+        }
+
+        // Silence has no loudness at all; keep it well clear of the "not analysed" marker
+        result.loudness = static_cast<float> (juce::jmax (-100.0, loudness.getIntegratedLoudness()));
+        result.bpm = juce::jmax (0.0f, tempo.getBpm());
+        result.firstBeatSeconds = result.bpm > 0.0f ? findBeatPhase (tempo, 60.0f / result.bpm) : 0.0f;
+
+        for (size_t i = 0; i < peaks.size(); ++i)
+            result.peaks[i] = static_cast<juce::uint8> (juce::roundToInt (juce::jlimit (0.0f, 1.0f, peaks[i]) * 255.0f));
+
+        return true;
+    }
+
+    // Where the beat grid sits: the strength-weighted average position of the detected beats within one beat period
+    static float findBeatPhase (soundtouch::BPMDetect& tempo, float beatPeriod)
+    {
+        auto numBeats = tempo.getBeats (nullptr, nullptr, 0);
+
+        if (numBeats <= 0)
+            return 0.0f;
+
+        std::vector<float> positions (static_cast<size_t> (numBeats)), strengths (static_cast<size_t> (numBeats));
+        numBeats = tempo.getBeats (positions.data(), strengths.data(), numBeats);
+
+        double x = 0.0, y = 0.0;
+
+        for (int i = 0; i < numBeats; ++i)
+        {
+            auto angle = juce::MathConstants<double>::twoPi * positions[(size_t) i] / beatPeriod;
+            x += strengths[(size_t) i] * std::cos (angle);
+            y += strengths[(size_t) i] * std::sin (angle);
+        }
+
+        if (x == 0.0 && y == 0.0)
+            return 0.0f;
+
+        auto phase = std::atan2 (y, x) / juce::MathConstants<double>::twoPi;
+        return static_cast<float> ((phase < 0.0 ? phase + 1.0 : phase) * beatPeriod);
+    }
+
+    //==============================================================================
+    static constexpr int chunkSize = 16384;
+    static constexpr int throttledRetryMs = 200;
+
+    juce::AudioFormatManager& formatManager;
+    LibraryIndex& index;
+
+    juce::CriticalSection lock;
+    std::set<juce::String> queuedPaths;
+
+    std::atomic<int> maxConcurrentJobs, runningJobs { 0 }, numAnalysed { 0 };
+
+    juce::ThreadPool pool;  // Last, so its threads are gone before anything they use
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibraryAnalyser)
+};
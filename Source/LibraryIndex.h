@@ -0,0 +1,343 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <map>
+#include <set>
+
+//==============================================================================
+/**
+ * Everything known about the library, saved between sessions
+ *
+ * One entry per audio file: size and modification time to tell whether it
+ * changed, plus length, sample rate, channels and analysis results so none
+ * of that needs the file opened. Loaded from a flat binary file at start-up,
+ * so the tracks from last time are playable straight away.
+ *
+ * scan() walks a folder on the index's own low-priority thread and only
+ * opens files that are new or have changed since they were indexed; files
+ * that have gone are dropped, wherever they were. A change message goes out when a scan changed
+ * anything, and the index is saved again.
+ */
+class LibraryIndex : public juce::ChangeBroadcaster
+{
+public:
+    static constexpr float notAnalysed = -1000.0f;
+    static constexpr int numPeaks = 256;
+
+    // Filled in by LibraryAnalyser, and cleared whenever the file changes
+    struct Analysis
+    {
+        float loudness = notAnalysed;  // Integrated LUFS (EBU R128)
+        float bpm = 0.0f;              // 0 if no tempo was found
+        float firstBeatSeconds = 0.0f; // Beat grid: beats fall at firstBeatSeconds + n * 60 / bpm
+        std::array<juce::uint8, numPeaks> peaks {};  // Overview of the peak level across the track, 255 = full scale
+
+        bool isAnalysed() const noexcept  { return loudness != notAnalysed; }
+    };
+
+    struct Entry
+    {
+        juce::File file;
+        juce::int64 sizeInBytes = 0, modificationTime = 0;  // As the file was when indexed
+        juce::int64 lengthInSamples = 0;                    // 0 if the file couldn't be read
+        double sampleRate = 0.0;
+        int numChannels = 0;
+
+        Analysis analysis;
+
+        bool isPlayable() const noexcept      { return lengthInSamples > 0 && sampleRate > 0.0; }
+        double getLengthSeconds() const       { return sampleRate > 0.0 ? lengthInSamples / sampleRate : 0.0; }
+    };
+
+    static constexpr const char* audioFileWildcard = "*.mp3;*.wav;*.aiff;*.aif;*.m4a;*.flac";
+
+    // Loads whatever was saved at indexFileToUse last time
+    LibraryIndex (juce::AudioFormatManager& formatManagerToUse, const juce::File& indexFileToUse)
+        : formatManager (formatManagerToUse),
+          indexFile (indexFileToUse),
+          scanner (*this)
+    {
+        load();
+    }
+
+    ~LibraryIndex() override
+    {
+        scanner.stopThread (4000);
+
+        if (needsSaving)
+            save();
+    }
+
+    // Rescans in the background; a newer call replaces a scan that's still queued
+    void scan (const juce::File& folder)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+            folderToScan = folder;
+        }
+
+        if (! scanner.isThreadRunning())
+            scanner.startThread (juce::Thread::Priority::low);
+
+        scanner.notify();
+    }
+
+    // Playable files under the folder, in path order
+    juce::Array<juce::File> getFiles (const juce::File& folder) const
+    {
+        juce::Array<juce::File> files;
+        const juce::ScopedLock sl (lock);
+
+        for (auto& item : entries)
+            if (item.second.isPlayable() && item.second.file.isAChildOf (folder))
+                files.add (item.second.file);
+
+        return files;
+    }
+
+    // Playable files under the folder that haven't been analysed yet
+    juce::Array<juce::File> getFilesNeedingAnalysis (const juce::File& folder) const
+    {
+        juce::Array<juce::File> files;
+        const juce::ScopedLock sl (lock);
+
+        for (auto& item : entries)
+            if (item.second.isPlayable() && ! item.second.analysis.isAnalysed() && item.second.file.isAChildOf (folder))
+                files.add (item.second.file);
+
+        return files;
+    }
+
+    // False if the file isn't indexed
+    bool getEntry (const juce::File& file, Entry& result) const
+    {
+        const juce::ScopedLock sl (lock);
+        auto found = entries.find (file.getFullPathName());
+
+        if (found == entries.end())
+            return false;
+
+        result = found->second;
+        return true;
+    }
+
+    // Kept until the file changes. Saved with the next scan or on shutdown.
+    void setAnalysis (const juce::File& file, const Analysis& analysis)
+    {
+        const juce::ScopedLock sl (lock);
+        auto found = entries.find (file.getFullPathName());
+
+        if (found == entries.end())
+            return;
+
+        found->second.analysis = analysis;
+        needsSaving = true;
+    }
+
+    int getNumEntries() const
+    {
+        const juce::ScopedLock sl (lock);
+        return static_cast<int> (entries.size());
+    }
+
+private:
+    //==============================================================================
+    class Scanner : public juce::Thread
+    {
+    public:
+        explicit Scanner (LibraryIndex& i) : juce::Thread ("Library Scanner"), index (i) {}
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                index.scanPendingFolder();
+                wait (-1);
+            }
+        }
+
+    private:
+        LibraryIndex& index;
+    };
+
+    //==============================================================================
+    // Scanner thread
+    void scanPendingFolder()
+    {
+        juce::File folder;
+
+        {
+            const juce::ScopedLock sl (lock);
+            std::swap (folder, folderToScan);
+        }
+
+        if (folder == juce::File())
+            return;
+
+        std::set<juce::String> seen;
+        bool changed = false;
+
+        // The iterator has each file's size and time already, so unchanged files cost no extra stat
+        for (auto& item : juce::RangedDirectoryIterator (folder, true, audioFileWildcard, juce::File::findFiles))
+        {
+            if (scanner.threadShouldExit())
+                return;
+
+            auto path = item.getFile().getFullPathName();
+            auto size = item.getFileSize();
+            auto modified = item.getModificationTime().toMilliseconds();
+            seen.insert (path);
+
+            {
+                const juce::ScopedLock sl (lock);
+                auto found = entries.find (path);
+
+                if (found != entries.end() && found->second.sizeInBytes == size && found->second.modificationTime == modified)
+                    continue;
+            }
+
+            auto entry = readEntry (item.getFile(), size, modified);
+
+            const juce::ScopedLock sl (lock);
+            entries[path] = entry;
+            changed = true;
+        }
+
+        {
+            const juce::ScopedLock sl (lock);
+
+            for (auto it = entries.begin(); it != entries.end();)
+            {
+                // Entries from other folders only go once their file has (e.g. an app update moved the bundle)
+                auto isGone = it->second.file.isAChildOf (folder) ? seen.count (it->first) == 0
+                                                                  : ! it->second.file.existsAsFile();
+
+                if (isGone)
+                {
+                    it = entries.erase (it);
+                    changed = true;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        if (changed || needsSaving)
+            save();
+
+        if (changed)
+            sendChangeMessage();
+    }
+
+    // Unreadable files are indexed too, so they aren't tried again until they change
+    Entry readEntry (const juce::File& file, juce::int64 size, juce::int64 modified) const
+    {
+        Entry entry;
+        entry.file = file;
+        entry.sizeInBytes = size;
+        entry.modificationTime = modified;
+
+        std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (file));
+
+        if (reader != nullptr)
+        {
+            entry.lengthInSamples = reader->lengthInSamples;
+            entry.sampleRate = reader->sampleRate;
+            entry.numChannels = static_cast<int> (reader->numChannels);
+        }
+
+        return entry;
+    }
+
+    //==============================================================================
+    static constexpr int fileMagic = 0x5849524d;  // "MRIX"
+    static constexpr int fileVersion = 2;  // Other versions are ignored and rebuilt by the next scan
+
+    // One read into memory, so a big library isn't thousands of small file reads
+    void load()
+    {
+        juce::MemoryBlock data;
+
+        if (! indexFile.loadFileAsData (data))
+            return;
+
+        juce::MemoryInputStream in (data, false);
+
+        if (in.readInt() != fileMagic || in.readInt() != fileVersion)
+            return;
+
+        auto numEntries = in.readInt();
+        const juce::ScopedLock sl (lock);
+
+        for (int i = 0; i < numEntries && ! in.isExhausted(); ++i)
+        {
+            Entry entry;
+            auto path = in.readString();
+            entry.file = juce::File (path);
+            entry.sizeInBytes = in.readInt64();
+            entry.modificationTime = in.readInt64();
+            entry.lengthInSamples = in.readInt64();
+            entry.sampleRate = in.readDouble();
+            entry.numChannels = in.readInt();
+            entry.analysis.loudness = in.readFloat();
+            entry.analysis.bpm = in.readFloat();
+            entry.analysis.firstBeatSeconds = in.readFloat();
+            in.read (entry.analysis.peaks.data(), numPeaks);
+
+            entries[path] = entry;
+        }
+    }
+
+    // Written in full and swapped in, so a crash mid-save leaves the old index intact
+    void save()
+    {
+        juce::MemoryOutputStream out;
+
+        {
+            const juce::ScopedLock sl (lock);
+
+            out.writeInt (fileMagic);
+            out.writeInt (fileVersion);
+            out.writeInt (static_cast<int> (entries.size()));
+
+            for (auto& item : entries)
+            {
+                auto& entry = item.second;
+                out.writeString (item.first);
+                out.writeInt64 (entry.sizeInBytes);
+                out.writeInt64 (entry.modificationTime);
+                out.writeInt64 (entry.lengthInSamples);
+                out.writeDouble (entry.sampleRate);
+                out.writeInt (entry.numChannels);
+                out.writeFloat (entry.analysis.loudness);
+                out.writeFloat (entry.analysis.bpm);
+                out.writeFloat (entry.analysis.firstBeatSeconds);
+                out.write (entry.analysis.peaks.data(), numPeaks);
+            }
+
+            needsSaving = false;
+        }
+
+        indexFile.getParentDirectory().createDirectory();
+
+        if (! indexFile.replaceWithData (out.getData(), out.getDataSize()))
+            DBG ("LibraryIndex: couldn't save " << indexFile.getFullPathName());
+    }
+
+    //==============================================================================
+    juce::AudioFormatManager& formatManager;
+    juce::File indexFile;
+
+    juce::CriticalSection lock;
+    std::map<juce::String, Entry> entries;  // By full path
+    juce::File folderToScan;
+    std::atomic<bool> needsSaving { false };
+
+    Scanner scanner;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibraryIndex)
+};
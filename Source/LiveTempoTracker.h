@@ -0,0 +1,276 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "SoundTouch/BPMDetect.h"
+
+//==============================================================================
+/**
+ * Tempo and beat phase of whatever is playing, worked out as it plays
+ *
+ * The audio thread only copies: push() downmixes each block into a
+ * lock-free FIFO. SoundTouch's BPMDetect reads it on the tracker's own
+ * low-priority thread, and the tempo and beat grid come back through
+ * atomics, so any thread can read them for the price of a load.
+ *
+ * Because the analysis hears the deck's output, it follows the pitch knob
+ * on its own. setTempoRatio() just saves waiting for that: the last tempo is
+ * rescaled straight away and the detector starts afresh, so the old speed
+ * doesn't linger in its history. restart() does the same for a new track,
+ * optionally seeded with a tempo already known from the library.
+ *
+ * Positions count samples pushed, so beat phase is as of the block last
+ * rendered - add the output latency to line it up with what's heard.
+ */
+class LiveTempoTracker : private juce::TimeSliceClient
+{
+public:
+    LiveTempoTracker()
+    {
+        thread.startThread (juce::Thread::Priority::low);
+    }
+
+    ~LiveTempoTracker() override
+    {
+        thread.removeTimeSliceClient (this);
+        thread.stopThread (4000);
+    }
+
+    //==============================================================================
+    // Before playback starts - analysis begins again from nothing
+    void prepare (double newSampleRate)
+    {
+        thread.removeTimeSliceClient (this);
+
+        sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+        fifoBuffer.assign (static_cast<size_t> (juce::nextPowerOfTwo (static_cast<int> (fifoSeconds * sampleRate))), 0.0f);
+        fifo.setTotalSize (static_cast<int> (fifoBuffer.size()));
+        chunk.assign (static_cast<size_t> (workerChunkSize), 0.0f);
+
+        samplesPushed = 0;
+        workerPosition = 0;
+        handledDroppedBlocks = numDroppedBlocks.load();
+        workerGeneration = generation.load();
+        appliedTempoRatio = tempoRatio.load();
+        startDetector();
+
+        bpm = seedBpm.load();
+        beatAnchor = -1.0;
+
+        thread.addTimeSliceClient (this);
+    }
+
+    // Any thread: a new track is playing. knownBpm, if there is one, is published until the detector has its own.
+    void restart (float knownBpm = 0.0f)
+    {
+        seedBpm = knownBpm;
+        ++generation;
+    }
+
+    // Any thread: how fast the deck plays the music, relative to its own tempo (the pitch ratio, or 1 with key lock)
+    void setTempoRatio (double ratio)  { tempoRatio = ratio; }
+
+    //==============================================================================
+    // Beats per minute of the playing output, 0 until there's an estimate
+    float getBpm() const noexcept  { return bpm.load(); }
+
+    // Where the last pushed sample sits within its beat: 0 on the beat, rising towards 1
+    double getBeatPhase() const noexcept
+    {
+        auto currentBpm = bpm.load();
+        auto anchor = beatAnchor.load();
+
+        if (currentBpm <= 0.0f || anchor < 0.0)
+            return 0.0;
+
+        auto beats = (static_cast<double> (samplesPushed.load()) - anchor) * currentBpm / (60.0 * sampleRate.load());
+        return beats - std::floor (beats);
+    }
+
+    bool hasBeatPhase() const noexcept  { return bpm.load() > 0.0f && beatAnchor.load() >= 0.0; }
+
+    //==============================================================================
+    // Audio thread: copies a mono mix of the block for the analysis, nothing more
+    void push (const juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+    {
+        if (fifo.getFreeSpace() < numSamples)
+        {
+            // The analysis has fallen far behind; skip rather than wait, and it starts over
+            ++numDroppedBlocks;
+            return;
+        }
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (numSamples, start1, size1, start2, size2);
+
+        downmix (buffer, startSample, start1, size1);
+        downmix (buffer, startSample + size1, start2, size2);
+
+        fifo.finishedWrite (size1 + size2);
+        samplesPushed += numSamples;
+    }
+
+private:
+    //==============================================================================
+    void downmix (const juce::AudioBuffer<float>& buffer, int startSample, int fifoStart, int numSamples)
+    {
+        if (numSamples <= 0)
+            return;
+
+        auto* destination = fifoBuffer.data() + fifoStart;
+        auto numChannels = buffer.getNumChannels();
+
+        juce::FloatVectorOperations::copy (destination, buffer.getReadPointer (0, startSample), numSamples);
+
+        for (int ch = 1; ch < numChannels; ++ch)
+            juce::FloatVectorOperations::add (destination, buffer.getReadPointer (ch, startSample), numSamples);
+
+        if (numChannels > 1)
+            juce::FloatVectorOperations::multiply (destination, 1.0f / static_cast<float> (numChannels), numSamples);
+    }
+
+    //==============================================================================
+    // Tracker thread
+    int useTimeSlice() override
+    {
+        auto requestedGeneration = generation.load();
+        auto ratio = tempoRatio.load();
+        auto dropped = numDroppedBlocks.load();
+
+        if (requestedGeneration != workerGeneration)
+        {
+            workerGeneration = requestedGeneration;
+            appliedTempoRatio = ratio;
+            startDetector();
+
+            bpm = seedBpm.load();
+            beatAnchor = -1.0;
+        }
+        else if (ratio != appliedTempoRatio)
+        {
+            // Carry the beat grid over at the new speed from where it is now, then let the detector confirm it
+            auto phase = getBeatPhase();
+            auto scale = appliedTempoRatio > 0.0 ? ratio / appliedTempoRatio : 1.0;
+            appliedTempoRatio = ratio;
+            startDetector();
+
+            auto newBpm = static_cast<float> (bpm.load() * scale);
+            bpm = newBpm;
+
+            if (newBpm > 0.0f && beatAnchor.load() >= 0.0)
+                beatAnchor = static_cast<double> (samplesPushed.load()) - phase * 60.0 * sampleRate / newBpm;
+        }
+
+        if (dropped != handledDroppedBlocks)
+        {
+            // A gap in the audio puts the detector's beat positions out of step with the sample count
+            handledDroppedBlocks = dropped;
+            startDetector();
+            beatAnchor = -1.0;
+        }
+
+        auto didWork = false;
+
+        while (fifo.getNumReady() > 0)
+        {
+            int start1, size1, start2, size2;
+            fifo.prepareToRead (juce::jmin (fifo.getNumReady(), workerChunkSize), start1, size1, start2, size2);
+
+            std::copy_n (fifoBuffer.data() + start1, size1, chunk.data());
+            std::copy_n (fifoBuffer.data() + start2, size2, chunk.data() + size1);
+            fifo.finishedRead (size1 + size2);
+
+            detector->inputSamples (chunk.data(), size1 + size2);
+            workerPosition += size1 + size2;
+            samplesSinceUpdate += size1 + size2;
+            didWork = true;
+        }
+
+        if (samplesSinceUpdate >= updateSeconds * sampleRate
+             && workerPosition - detectorStart >= minimumDetectionSeconds * sampleRate)
+        {
+            samplesSinceUpdate = 0;
+            publishResults();
+        }
+
+        return didWork ? 0 : idleWaitMs;
+    }
+
+    void startDetector()
+    {
+        detector = std::make_unique<soundtouch::BPMDetect> (1, juce::roundToInt (sampleRate.load()));
+        detectorStart = workerPosition;
+        samplesSinceUpdate = 0;
+    }
+
+    void publishResults()
+    {
+        auto detected = detector->getBpm();
+
+        if (detected <= 0.0f)
+            return;
+
+        auto numBeats = detector->getBeats (nullptr, nullptr, 0);
+        beatPositions.resize (static_cast<size_t> (numBeats));
+        beatStrengths.resize (static_cast<size_t> (numBeats));
+        numBeats = detector->getBeats (beatPositions.data(), beatStrengths.data(), numBeats);
+
+        // The strength-weighted mean position of the recent beats within one beat period
+        auto period = 60.0 / detected;
+        auto since = static_cast<double> (workerPosition - detectorStart) / sampleRate - recentBeatsSeconds;
+        double x = 0.0, y = 0.0;
+
+        for (int i = numBeats; --i >= 0 && beatPositions[(size_t) i] >= since;)
+        {
+            auto angle = juce::MathConstants<double>::twoPi * beatPositions[(size_t) i] / period;
+            x += beatStrengths[(size_t) i] * std::cos (angle);
+            y += beatStrengths[(size_t) i] * std::sin (angle);
+        }
+
+        bpm = detected;
+
+        if (x != 0.0 || y != 0.0)
+        {
+            auto phase = std::atan2 (y, x) / juce::MathConstants<double>::twoPi;
+            beatAnchor = static_cast<double> (detectorStart) + (phase < 0.0 ? phase + 1.0 : phase) * period * sampleRate;
+        }
+    }
+
+    //==============================================================================
+    static constexpr double fifoSeconds = 4.0;
+    static constexpr double updateSeconds = 0.5;
+    static constexpr double minimumDetectionSeconds = 6.0;  // Before that the detector's own tempo isn't worth publishing
+    static constexpr double recentBeatsSeconds = 8.0;       // Beats that place the grid, so it follows drift
+    static constexpr int workerChunkSize = 4096;
+    static constexpr int idleWaitMs = 20;
+
+    juce::TimeSliceThread thread { "Live Tempo" };
+    std::atomic<double> sampleRate { 44100.0 };
+
+    // Published to any thread
+    std::atomic<float> bpm { 0.0f };
+    std::atomic<double> beatAnchor { -1.0 };  // A sample position on a beat, -1 if there's no grid yet
+
+    // Any thread -> tracker thread
+    std::atomic<int> generation { 0 };
+    std::atomic<float> seedBpm { 0.0f };
+    std::atomic<double> tempoRatio { 1.0 };
+
+    // Audio thread -> tracker thread
+    std::vector<float> fifoBuffer;
+    juce::AbstractFifo fifo { 1 };
+    std::atomic<juce::int64> samplesPushed { 0 };
+    std::atomic<int> numDroppedBlocks { 0 };
+
+    // Tracker thread
+    std::unique_ptr<soundtouch::BPMDetect> detector;
+    std::vector<float> chunk, beatPositions, beatStrengths;
+    juce::int64 workerPosition = 0, detectorStart = 0, samplesSinceUpdate = 0;
+    int workerGeneration = 0, handledDroppedBlocks = 0;
+    double appliedTempoRatio = 1.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LiveTempoTracker)
+};
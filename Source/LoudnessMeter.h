@@ -0,0 +1,163 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+//==============================================================================
+/**
+ * EBU R128 / ITU-R BS.1770 integrated loudness of a whole track
+ *
+ * Feed every sample through process(), then read getIntegratedLoudness().
+ * K-weighting is the standard high shelf and high-pass pair, with
+ * coefficients worked out for the track's own sample rate. 400 ms blocks
+ * overlap by 75% and are gated at -70 LUFS and then 10 LU under the
+ * ungated level. All channels count fully, as left and right do in the
+ * standard.
+ */
+class LoudnessMeter
+{
+public:
+    LoudnessMeter (int numChannelsToMeasure, double sampleRate)
+        : numChannels (numChannelsToMeasure),
+          subBlockLength (juce::jmax (1, juce::roundToInt (sampleRate * 0.1))),
+          filters (static_cast<size_t> (numChannelsToMeasure)),
+          subBlockSums (static_cast<size_t> (numChannelsToMeasure), 0.0)
+    {
+        // Stage one: high shelf modelling the head
+        {
+            const double f0 = 1681.974450955533, gainDb = 3.999843853973347, q = 0.7071752369554196;
+            auto k = std::tan (juce::MathConstants<double>::pi * f0 / sampleRate);
+            auto vh = std::pow (10.0, gainDb / 20.0);
+            auto vb = std::pow (vh, 0.4996667741545416);
+            auto a0 = 1.0 + k / q + k * k;
+
+            shelf = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                      2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+        }
+
+        // Stage two: the RLB high-pass
+        {
+            const double f0 = 38.13547087602444, q = 0.5003270373238773;
+            auto k = std::tan (juce::MathConstants<double>::pi * f0 / sampleRate);
+            auto a0 = 1.0 + k / q + k * k;
+
+            highPass = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+        }
+    }
+
+    void process (const juce::AudioBuffer<float>& buffer, int numSamples)
+    {
+        for (int start = 0; start < numSamples;)
+        {
+            auto numThisTime = juce::jmin (numSamples - start, subBlockLength - subBlockPosition);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                auto& state = filters[static_cast<size_t> (ch)];
+                const auto* samples = buffer.getReadPointer (juce::jmin (ch, buffer.getNumChannels() - 1), start);
+                double sum = 0.0;
+
+                for (int i = 0; i < numThisTime; ++i)
+                {
+                    auto weighted = highPass.process (state.highPass, shelf.process (state.shelf, samples[i]));
+                    sum += weighted * weighted;
+                }
+
+                subBlockSums[static_cast<size_t> (ch)] += sum;
+            }
+
+            subBlockPosition += numThisTime;
+            start += numThisTime;
+
+            if (subBlockPosition == subBlockLength)
+                finishSubBlock();
+        }
+    }
+
+    // -infinity for silence or anything shorter than one 400 ms block
+    double getIntegratedLoudness() const
+    {
+        const double absoluteGate = energyForLoudness (-70.0);
+        std::vector<double> blocks;
+
+        for (size_t i = 3; i < subBlockEnergies.size(); ++i)
+        {
+            auto energy = (subBlockEnergies[i - 3] + subBlockEnergies[i - 2] + subBlockEnergies[i - 1] + subBlockEnergies[i]) * 0.25;
+
+            if (energy > absoluteGate)
+                blocks.push_back (energy);
+        }
+
+        if (blocks.empty())
+            return -std::numeric_limits<double>::infinity();
+
+        auto relativeGate = mean (blocks, 0.0) * std::pow (10.0, -10.0 / 10.0);
+        auto gatedMean = mean (blocks, relativeGate);
+
+        return gatedMean > 0.0 ? -0.691 + 10.0 * std::log10 (gatedMean) : -std::numeric_limits<double>::infinity();
+    }
+
+private:
+    struct Biquad
+    {
+        double b0, b1, b2, a1, a2;
+
+        double process (double (&z)[2], double x) const noexcept
+        {
+            auto y = b0 * x + z[0];
+            z[0] = b1 * x - a1 * y + z[1];
+            z[1] = b2 * x - a2 * y;
+            return y;
+        }
+    };
+
+    struct ChannelState
+    {
+        double shelf[2] = {}, highPass[2] = {};
+    };
+
+    void finishSubBlock()
+    {
+        double energy = 0.0;
+
+        for (auto& sum : subBlockSums)
+        {
+            energy += sum / subBlockLength;
+            sum = 0.0;
+        }
+
+        subBlockEnergies.push_back (energy);
+        subBlockPosition = 0;
+    }
+
+    static double energyForLoudness (double lufs)   { return std::pow (10.0, (lufs + 0.691) / 10.0); }
+
+    static double mean (const std::vector<double>& values, double above)
+    {
+        double sum = 0.0;
+        int count = 0;
+
+        for (auto v : values)
+        {
+            if (v > above)
+            {
+                sum += v;
+                ++count;
+            }
+        }
+
+        return count > 0 ? sum / count : 0.0;
+    }
+
+    int numChannels;
+    int subBlockLength, subBlockPosition = 0;  // 100 ms: four make a gating block, one apart
+
+    Biquad shelf {}, highPass {};
+    std::vector<ChannelState> filters;
+    std::vector<double> subBlockSums;
+    std::vector<double> subBlockEnergies;  // Mean square summed over channels, one per 100 ms
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LoudnessMeter)
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "TrackSource.h"
+
+//==============================================================================
+/**
+ * Per-track loudness normalisation folded into the master volume
+ *
+ * Each track's gain comes from its measured integrated loudness and goes out
+ * with the volume as one multiply, so normalising costs no extra pass over
+ * the buffer. Changes ramp: over the crossfade when a new track's gain comes
+ * in, and over 50 ms for the volume knob and settings. Tracks that haven't
+ * been measured yet play at unity.
+ */
+class LoudnessNormaliser
+{
+public:
+    static constexpr float maximumBoostDb = 12.0f;
+    static constexpr float peakCeilingDb = -1.0f;
+
+    void setEnabled (bool shouldBeEnabled)     { enabled = shouldBeEnabled; }
+    bool isEnabled() const noexcept            { return enabled.load(); }
+
+    // -14 LUFS by default, roughly where streaming services sit
+    void setTargetLoudness (float lufs)        { targetLoudness = juce::jlimit (-40.0f, 0.0f, lufs); }
+    float getTargetLoudness() const noexcept   { return targetLoudness.load(); }
+
+    // Never raise a track so far that its loudest sample goes over -1 dBFS
+    void setPeakSafe (bool shouldBePeakSafe)   { peakSafe = shouldBePeakSafe; }
+    bool isPeakSafe() const noexcept           { return peakSafe.load(); }
+
+    // Gain that brings the track to the target, before the volume
+    static float computeGain (const TrackSource::Loudness& loudness, float targetLufs, bool limitToPeak)
+    {
+        if (! loudness.isMeasured)
+            return 1.0f;
+
+        auto gainDb = juce::jmin (maximumBoostDb, targetLufs - loudness.lufs);
+        auto gain = juce::Decibels::decibelsToGain (gainDb);
+
+        if (limitToPeak && loudness.peak > 0.0f)
+            gain = juce::jmin (gain, juce::Decibels::decibelsToGain (peakCeilingDb) / loudness.peak);
+
+        return gain;
+    }
+
+    //==============================================================================
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        currentGain = -1.0f;  // Jump straight to the first block's gain
+        rampRemaining = 0;
+    }
+
+    // Audio thread
+    void apply (juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                float volume, const TrackSource::Loudness& trackLoudness, double crossfadeSeconds)
+    {
+        auto trackGain = enabled.load() ? computeGain (trackLoudness, targetLoudness.load(), peakSafe.load()) : 1.0f;
+        auto target = volume * trackGain;
+
+        if (currentGain < 0.0f)
+        {
+            currentGain = rampTarget = target;
+            appliedTrackGain = trackGain;
+        }
+        else if (target != rampTarget)
+        {
+            // A new track's level comes in with the crossfade, so it doesn't jump under the fade
+            auto seconds = trackGain != appliedTrackGain ? juce::jmax (settingRampSeconds, crossfadeSeconds) : settingRampSeconds;
+            appliedTrackGain = trackGain;
+
+            rampTarget = target;
+            rampRemaining = juce::jmax (1, juce::roundToInt (seconds * sampleRate));
+            rampStep = (rampTarget - currentGain) / static_cast<float> (rampRemaining);
+        }
+
+        if (rampRemaining > 0)
+        {
+            auto numRamped = juce::jmin (numSamples, rampRemaining);
+            rampRemaining -= numRamped;
+
+            auto endGain = rampRemaining > 0 ? currentGain + rampStep * static_cast<float> (numRamped) : rampTarget;
+            buffer.applyGainRamp (startSample, numRamped, currentGain, endGain);
+            currentGain = endGain;
+
+            startSample += numRamped;
+            numSamples -= numRamped;
+        }
+
+        if (numSamples > 0)
+            buffer.applyGain (startSample, numSamples, currentGain);
+    }
+
+private:
+    static constexpr double settingRampSeconds = 0.05;
+
+    std::atomic<bool> enabled { true }, peakSafe { true };
+    std::atomic<float> targetLoudness { -14.0f };
+
+    // Audio thread only
+    double sampleRate = 44100.0;
+    float currentGain = -1.0f, rampTarget = 1.0f, rampStep = 0.0f, appliedTrackGain = 1.0f;
+    int rampRemaining = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LoudnessNormaliser)
+};
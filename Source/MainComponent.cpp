@@ -1,12 +1,14 @@
 #include "MainComponent.h"
 #include <random>
 #include <algorithm>
+#include <set>
 
 MainComponent::MainComponent()
 {
     // Register audio formats
     formatManager.registerBasicFormats();
-    transportSource.addChangeListener (this);
+    trackDeck.addChangeListener (this);
+    libraryIndex.addChangeListener (this);
 
     // Load images
     auto resourcesFolder = juce::File::getSpecialLocation (juce::File::currentApplicationFile)
@@ -93,8 +95,8 @@ MainComponent::MainComponent()
         currentPitchSemitones = semitones;
 
         // Update resampling ratio in REAL-TIME (smooth, click-free!)
-        if (pitchShifter != nullptr)
-            pitchShifter->setPitchSemitones (semitones);
+        trackDeck.setPitchSemitones (semitones);
+        updateLiveTempoRatio();
 
         DBG("Pitch: " << semitones << " semitones - REAL-TIME ResamplingAudioSource");
     };
@@ -330,6 +332,9 @@ MainComponent::MainComponent()
     });
     addAndMakeVisible (volumeKnob.get());
 
+    // Played tracks are kept as PCM on disk so later sessions skip the AAC decode
+    transcodeCache.setDirectory (getTranscodeCacheDirectory());
+
     // Load bundled music
     loadBundledMusic();
 
@@ -409,11 +414,15 @@ MainComponent::~MainComponent()
     resetButton.setLookAndFeel (nullptr);
     draggableFilterButtons.reset();
     shutdownAudio();
+    trackDeck.removeChangeListener (this);
+    libraryIndex.removeChangeListener (this);
 }
 
 void MainComponent::prepareToPlay (int samplesPerBlockExpected, double sampleRate)
 {
-    transportSource.prepareToPlay (samplesPerBlockExpected, sampleRate);
+    trackDeck.prepareToPlay (samplesPerBlockExpected, sampleRate);
+    loudnessNormaliser.prepare (sampleRate);
+    liveTempo.prepare (sampleRate);
 
     juce::dsp::ProcessSpec spec;
     spec.sampleRate = sampleRate;
@@ -458,22 +467,22 @@ void MainComponent::prepareToPlay (int samplesPerBlockExpected, double sampleRat
 
 void MainComponent::getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill)
 {
-    if (readerSource.get() == nullptr)
-    {
-        bufferToFill.clearActiveBufferRegion();
-        return;
-    }
+    // Outputs silence until the first track has been loaded and primed
+    trackDeck.getNextAudioBlock (bufferToFill);
+
+    // Tempo is tracked on the music itself, before the effects smear its beats
+    liveTempo.push (*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples);
 
-    transportSource.getNextAudioBlock (bufferToFill);
     effectsProcessor.process (*bufferToFill.buffer);
 
-    // Apply master volume
-    bufferToFill.buffer->applyGain (masterGain);
+    // Master volume and the track's loudness normalisation, in one multiply
+    loudnessNormaliser.apply (*bufferToFill.buffer, bufferToFill.startSample, bufferToFill.numSamples,
+                              masterGain, trackDeck.getCurrentLoudness(), trackDeck.getCrossfadeSeconds());
 }
 
 void MainComponent::releaseResources()
 {
-    transportSource.releaseResources();
+    trackDeck.releaseResources();
     effectsProcessor.reset();
 }
 
@@ -711,13 +720,35 @@ void MainComponent::layoutForPhone(juce::Rectangle<int> bounds, float deviceScal
 
 void MainComponent::changeListenerCallback (juce::ChangeBroadcaster* source)
 {
-    if (source == &transportSource)
+    if (source == &trackDeck)
     {
-        if (transportSource.isPlaying())
+        auto transitions = trackDeck.getNumQueuedTrackTransitions();
+
+        // The deck moved on to the preloaded track by itself (gapless or crossfaded)
+        if (transitions > handledTrackTransitions)
+        {
+            handledTrackTransitions = transitions;
+            followingTrackPending = false;
+            showQueuedTrack();
+            queueFollowingTrack();
+        }
+        // ...or made the switch that nextButtonClicked() already showed
+        else if (followingTrackPending && transitions == handledTrackTransitions)
+        {
+            followingTrackPending = false;
+            queueFollowingTrack();
+        }
+
+        if (trackDeck.isPlaying())
             state = Playing;
-        else if (state == Playing)
+        else if (state == Playing && trackDeck.hasStreamFinished())
             nextButtonClicked();
     }
+    else if (source == &libraryIndex)
+    {
+        // A background scan found new, changed or deleted files
+        updateTracksFromIndex();
+    }
 }
 
 void MainComponent::timerCallback()
@@ -744,76 +775,132 @@ void MainComponent::loadTrack (int index)
     if (index < 0 || index >= trackFiles.size())
         return;
 
-    transportSource.stop();
-    transportSource.setSource (nullptr);
-    pitchShifter.reset();
-    readerSource.reset();
-
     // RESET pitch knob to center (0 semitones) when changing tracks
     pitchKnob.setValue (0.0, juce::dontSendNotification);
     currentPitchSemitones = 0.0;
+    trackDeck.setPitchSemitones (currentPitchSemitones);
+    updateLiveTempoRatio();
 
     // Reset effects to clear any delay/reverb tail from previous track
     effectsProcessor.reset();
     DBG ("Effects reset on track change - no residue");
 
+    // Opened, primed and swapped in by the deck's loader thread - the current track
+    // keeps playing until the new one is ready, so this never blocks the UI
     auto file = trackFiles[index];
-    auto* reader = formatManager.createReaderFor (file);
+    trackDeck.loadTrack (file, getTrackLoudness (file));
+    liveTempo.restart (getTrackBpm (file));
+    handledTrackTransitions = trackDeck.getNumQueuedTrackTransitions();
+    followingTrackPending = false;
 
-    if (reader != nullptr)
-    {
-        readerSource.reset (new juce::AudioFormatReaderSource (reader, true));
+    currentTrackIndex = index;
+    currentTrackName = file.getFileNameWithoutExtension();
+    trackNameLabel.setText (currentTrackName, juce::dontSendNotification);
 
-        // Wrap reader source in ResamplingAudioSource for smooth, click-free pitch shifting
-        pitchShifter.reset (new SmoothResamplingSource (readerSource.get(), false));
-        pitchShifter->prepareToPlay (512, reader->sampleRate);
-        pitchShifter->setPitchSemitones (currentPitchSemitones);  // Start at 0 (normal pitch)
+    DBG ("Loading: " << currentTrackName << " (0 semitones)");
 
-        // Connect pitch shifter to transport (now implements PositionableAudioSource)
-        transportSource.setSource (pitchShifter.get(), 0, nullptr, reader->sampleRate);
+    queueFollowingTrack();
+}
 
-        currentTrackIndex = index;
-        currentTrackName = file.getFileNameWithoutExtension();
-        trackNameLabel.setText (currentTrackName, juce::dontSendNotification);
+void MainComponent::queueFollowingTrack()
+{
+    if (trackFiles.isEmpty())
+        return;
 
-        DBG ("Loaded: " << currentTrackName << " with ResamplingAudioSource (0 semitones)");
-    }
+    // Decoded ahead so the switch is gapless (or crossfaded) with no file I/O
+    queuedTrackIndex = (currentTrackIndex + 1) % trackFiles.size();
+    trackDeck.queueNextTrack (trackFiles[queuedTrackIndex], getTrackLoudness (trackFiles[queuedTrackIndex]));
+}
+
+void MainComponent::showQueuedTrack()
+{
+    if (queuedTrackIndex < 0 || queuedTrackIndex >= trackFiles.size())
+        return;
+
+    // The deck starts every track at 0 semitones, same as loadTrack()
+    pitchKnob.setValue (0.0, juce::dontSendNotification);
+    currentPitchSemitones = 0.0;
+    updateLiveTempoRatio();
+
+    currentTrackIndex = queuedTrackIndex;
+    currentTrackName = trackFiles[currentTrackIndex].getFileNameWithoutExtension();
+    trackNameLabel.setText (currentTrackName, juce::dontSendNotification);
+    liveTempo.restart (getTrackBpm (trackFiles[currentTrackIndex]));
+
+    DBG ("Now playing: " << currentTrackName << " (preloaded)");
 }
 
 void MainComponent::loadTracksFromFolder (const juce::File& folder)
 {
     trackFiles.clear();
+    libraryFolder = folder;
 
     DBG ("Loading tracks from folder: " + folder.getFullPathName());
-    DBG ("Folder exists: " + juce::String(folder.exists() ? "true" : "false"));
-    DBG ("Folder is directory: " + juce::String(folder.isDirectory() ? "true" : "false"));
 
-    juce::Array<juce::File> files;
-    folder.findChildFiles (files, juce::File::findFiles, true, "*.mp3;*.wav;*.aiff;*.aif;*.m4a;*.flac");
+    // Whatever the index had last session is playable straight away. The scan only
+    // opens new or changed files, and reports back through changeListenerCallback.
+    updateTracksFromIndex();
+    libraryIndex.scan (folder);
 
-    DBG ("Found " + juce::String(files.size()) + " files in folder scan");
+    DBG ("Tracks from the library index: " + juce::String (trackFiles.size()));
+}
 
-    // Log first few files for debugging
-    for (int i = 0; i < juce::jmin(5, files.size()); ++i)
-    {
-        DBG ("File " + juce::String(i) + ": " + files[i].getFullPathName());
-    }
+void MainComponent::updateTracksFromIndex()
+{
+    auto indexed = libraryIndex.getFiles (libraryFolder);
+    libraryAnalyser.analyse (libraryIndex.getFilesNeedingAnalysis (libraryFolder));
 
-    trackFiles.addArray (files);
+    std::random_device rd;
+    std::mt19937 rng (rd());
 
     // SHUFFLE tracks randomly on every startup for randomized playbook order
-    if (!trackFiles.isEmpty())
+    if (trackFiles.isEmpty())
     {
-        std::random_device rd;
-        std::mt19937 rng (rd());
+        trackFiles.addArray (indexed);
         std::shuffle (trackFiles.begin(), trackFiles.end(), rng);
         DBG ("Shuffled " + juce::String(trackFiles.size()) + " tracks into random order");
+
+        if (!trackFiles.isEmpty())
+            loadTrack (0);
+
+        return;
     }
 
-    DBG ("Final loaded track count: " + juce::String(trackFiles.size()));
+    // Otherwise keep playing what's playing, and fold the changes into the rest of the running order
+    auto currentFile = trackFiles[currentTrackIndex];
+    auto queuedFile = trackFiles[queuedTrackIndex];
 
-    if (!trackFiles.isEmpty())
-        loadTrack (0);
+    std::set<juce::String> indexedPaths, knownPaths;
+
+    for (auto& file : indexed)
+        indexedPaths.insert (file.getFullPathName());
+
+    for (int i = trackFiles.size(); --i >= 0;)
+        if (trackFiles[i] != currentFile && indexedPaths.count (trackFiles[i].getFullPathName()) == 0)
+            trackFiles.remove (i);
+
+    for (auto& file : trackFiles)
+        knownPaths.insert (file.getFullPathName());
+
+    for (auto& file : indexed)
+        if (knownPaths.count (file.getFullPathName()) == 0)
+            trackFiles.add (file);
+
+    if (trackFiles.isEmpty())
+        return;
+
+    // New tracks get shuffled in among the ones still to come
+    currentTrackIndex = juce::jmax (0, trackFiles.indexOf (currentFile));
+    std::shuffle (trackFiles.begin() + currentTrackIndex + 1, trackFiles.end(), rng);
+
+    // A skip the deck hasn't made yet queues the following track when it does
+    if (followingTrackPending)
+        return;
+
+    if (trackFiles[(currentTrackIndex + 1) % trackFiles.size()] != queuedFile)
+        queueFollowingTrack();
+    else
+        queuedTrackIndex = (currentTrackIndex + 1) % trackFiles.size();
 }
 
 void MainComponent::loadBundledMusic()
@@ -881,13 +968,13 @@ void MainComponent::playButtonClicked()
 {
     if (state == Stopped || state == Paused)
     {
-        transportSource.start();
+        trackDeck.start();
         state = Playing;
         playButton.setButtonText ("Pause");  // Changes icon to pause bars
     }
     else if (state == Playing)
     {
-        transportSource.stop();
+        trackDeck.stop();
         state = Paused;
         playButton.setButtonText ("Play");  // Changes icon to play triangle
 
@@ -899,8 +986,8 @@ void MainComponent::playButtonClicked()
 
 void MainComponent::stopButtonClicked()
 {
-    transportSource.stop();
-    transportSource.setPosition (0);
+    trackDeck.stop();
+    trackDeck.setPosition (0);
     state = Stopped;
     playButton.setButtonText ("Play");
 
@@ -915,10 +1002,28 @@ void MainComponent::nextButtonClicked()
         return;
 
     int nextIndex = (currentTrackIndex + 1) % trackFiles.size();
-    loadTrack (nextIndex);
+
+    // Already decoded - switch without reopening the file
+    if (nextIndex == queuedTrackIndex && trackDeck.isNextTrackReady())
+    {
+        // Reset effects to clear any delay/reverb tail, same as loadTrack()
+        effectsProcessor.reset();
+        trackDeck.skipToNextTrack();
+
+        // Show it now so another press before the deck switches moves on again,
+        // rather than reloading the track that's just starting. Queueing the one
+        // after waits for the switch, or it would replace the track being skipped to.
+        ++handledTrackTransitions;
+        followingTrackPending = true;
+        showQueuedTrack();
+    }
+    else
+    {
+        loadTrack (nextIndex);
+    }
 
     if (state == Playing)
-        transportSource.start();
+        trackDeck.start();
 }
 
 void MainComponent::previousButtonClicked()
@@ -933,15 +1038,97 @@ void MainComponent::previousButtonClicked()
     loadTrack (prevIndex);
 
     if (state == Playing)
-        transportSource.start();
+        trackDeck.start();
+}
+
+void MainComponent::setReadAheadSeconds (double seconds)
+{
+    trackDeck.setReadAheadSeconds (seconds);
+}
+
+void MainComponent::setCrossfadeSeconds (double seconds)
+{
+    trackDeck.setCrossfadeSeconds (seconds);
+}
+
+void MainComponent::setDecodedCacheMegabytes (int megabytes)
+{
+    decodedTrackCache.setMemoryBudget (static_cast<size_t> (juce::jmax (0, megabytes)) * 1024 * 1024);
+}
+
+void MainComponent::setTranscodeCacheMegabytes (int megabytes)
+{
+    if (megabytes <= 0)
+        transcodeCache.setDirectory ({});
+    else
+        transcodeCache.setDirectory (getTranscodeCacheDirectory(), static_cast<juce::int64> (megabytes) * 1024 * 1024);
+}
+
+TrackSource::Loudness MainComponent::getTrackLoudness (const juce::File& file) const
+{
+    TrackSource::Loudness loudness;
+    LibraryIndex::Entry entry;
+
+    if (libraryIndex.getEntry (file, entry) && entry.analysis.isAnalysed())
+    {
+        auto& peaks = entry.analysis.peaks;
+        loudness.lufs = entry.analysis.loudness;
+        loudness.peak = *std::max_element (peaks.begin(), peaks.end()) / 255.0f;
+        loudness.isMeasured = true;
+    }
+
+    return loudness;
+}
+
+// The library's tempo for the track, 0 if it hasn't been analysed or has no clear beat
+float MainComponent::getTrackBpm (const juce::File& file) const
+{
+    LibraryIndex::Entry entry;
+    return libraryIndex.getEntry (file, entry) ? entry.analysis.bpm : 0.0f;
+}
+
+void MainComponent::updateLiveTempoRatio()
+{
+    // The turntable pitch speeds the music up with the key, unless key lock holds the tempo
+    liveTempo.setTempoRatio (trackDeck.isKeyLockEnabled() ? 1.0 : std::pow (2.0, currentPitchSemitones / 12.0));
+}
+
+juce::File MainComponent::getLibraryIndexFile()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("Modular Radio")
+               .getChildFile ("Library.index");
+}
+
+juce::File MainComponent::getTranscodeCacheDirectory()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("Modular Radio")
+               .getChildFile ("Transcoded Tracks");
+}
+
+void MainComponent::setKeyLockEnabled (bool shouldBeEnabled)
+{
+    trackDeck.setKeyLockEnabled (shouldBeEnabled);
+    updateLiveTempoRatio();
+}
+
+int MainComponent::getReadAheadUnderruns() const
+{
+    return trackDeck.getNumUnderruns();
+}
+
+juce::int64 MainComponent::getReadAheadUnderrunSamples() const
+{
+    return trackDeck.getNumUnderrunSamples();
 }
 
 void MainComponent::updateTimeDisplay()
 {
-    if (readerSource.get() != nullptr)
+    if (trackDeck.hasTrack())
     {
-        auto currentPos = transportSource.getCurrentPosition();
-        auto totalLength = transportSource.getLengthInSeconds();
+        auto currentPos = trackDeck.getCurrentPosition();
+        auto totalLength = trackDeck.getLengthInSeconds();
 
         auto formatTime = [] (double seconds) -> juce::String
         {
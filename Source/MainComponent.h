@@ -2,89 +2,14 @@
 
 #include <JuceHeader.h>
 #include "EffectsProcessor.h"
+#include "TrackDeck.h"
+#include "LibraryAnalyser.h"
+#include "LoudnessNormaliser.h"
+#include "LiveTempoTracker.h"
 #include "ModularRadioLookAndFeel.h"
 #include "DeviceDetection.h"
 #include "AdaptiveLayout.h"
 
-//==============================================================================
-// ResamplingAudioSource wrapper that implements PositionableAudioSource
-// This provides smooth, click-free pitch shifting (changes pitch AND tempo like a turntable)
-class SmoothResamplingSource : public juce::PositionableAudioSource
-{
-public:
-    SmoothResamplingSource (juce::PositionableAudioSource* inputSource, bool deleteSourceWhenDeleted)
-        : source (inputSource),
-          deleteSource (deleteSourceWhenDeleted),
-          resampler (inputSource, false, 2)  // 2 channels
-    {
-        // Start at normal pitch (1.0 = no change)
-        resampler.setResamplingRatio (1.0);
-    }
-
-    ~SmoothResamplingSource() override
-    {
-        if (deleteSource)
-            delete source;
-    }
-
-    void setPitchSemitones (double semitones)
-    {
-        // Convert semitones to playback ratio: ratio = 2^(semitones/12)
-        double ratio = std::pow (2.0, semitones / 12.0);
-
-        // Clamp to reasonable range
-        ratio = juce::jlimit (0.5, 2.0, ratio);
-
-        // This is inherently smooth - ResamplingAudioSource handles all smoothing internally
-        resampler.setResamplingRatio (ratio);
-    }
-
-    // AudioSource methods
-    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
-    {
-        resampler.prepareToPlay (samplesPerBlockExpected, sampleRate);
-    }
-
-    void releaseResources() override
-    {
-        resampler.releaseResources();
-    }
-
-    void getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill) override
-    {
-        resampler.getNextAudioBlock (bufferToFill);
-    }
-
-    // PositionableAudioSource methods - delegate to source
-    void setNextReadPosition (juce::int64 newPosition) override
-    {
-        if (source != nullptr)
-            source->setNextReadPosition (newPosition);
-    }
-
-    juce::int64 getNextReadPosition() const override
-    {
-        return source != nullptr ? source->getNextReadPosition() : 0;
-    }
-
-    juce::int64 getTotalLength() const override
-    {
-        return source != nullptr ? source->getTotalLength() : 0;
-    }
-
-    bool isLooping() const override
-    {
-        return source != nullptr ? source->isLooping() : false;
-    }
-
-private:
-    juce::PositionableAudioSource* source;
-    bool deleteSource;
-    juce::ResamplingAudioSource resampler;
-
-    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SmoothResamplingSource)
-};
-
 // DraggableComponent class COMPLETELY REMOVED - all components are now in FIXED positions
 
 //==============================================================================
@@ -109,22 +34,69 @@ public:
     void changeListenerCallback (juce::ChangeBroadcaster* source) override;
     void timerCallback() override;
 
+    //==============================================================================
+    // Read-ahead depth for the decode thread (0.5 to 10 seconds) - applies from the next track load
+    void setReadAheadSeconds (double seconds);
+    double getReadAheadSeconds() const { return trackDeck.getReadAheadSeconds(); }
+
+    // Underruns of the current track's read-ahead buffer (audio thread found no decoded PCM)
+    int getReadAheadUnderruns() const;
+    juce::int64 getReadAheadUnderrunSamples() const;
+
+    // Equal-power crossfade between tracks in seconds - 0 plays them back to back, gapless
+    void setCrossfadeSeconds (double seconds);
+    double getCrossfadeSeconds() const { return trackDeck.getCrossfadeSeconds(); }
+
+    // Memory for fully decoded tracks, least recently played dropped first
+    void setDecodedCacheMegabytes (int megabytes);
+    int getDecodedCacheMegabytes() const { return static_cast<int> (decodedTrackCache.getMemoryBudget() / (1024 * 1024)); }
+
+    // Compressed by default, which fits more tracks; floats save a little CPU during playback
+    void setDecodedCacheStorage (DecodedTrackCache::Storage storage) { decodedTrackCache.setStorage (storage); }
+
+    // Disk space for tracks transcoded to memory-mappable PCM - 0 switches the transcode cache off
+    void setTranscodeCacheMegabytes (int megabytes);
+
+    // Loudness normalisation from the library analysis, applied with the master volume
+    void setNormalisationEnabled (bool shouldBeEnabled)  { loudnessNormaliser.setEnabled (shouldBeEnabled); }
+    void setNormalisationTarget (float lufs)             { loudnessNormaliser.setTargetLoudness (lufs); }
+    void setNormalisationPeakSafe (bool shouldBeSafe)    { loudnessNormaliser.setPeakSafe (shouldBeSafe); }
+
+    // Background library analysis: how many tracks at once, 0 pauses it
+    void setAnalysisThreads (int numThreads) { libraryAnalyser.setMaxConcurrentJobs (numThreads); }
+
+    // Tempo and beat phase of what's playing, tracked live - cheap enough to poll from anywhere
+    float getLiveBpm() const noexcept           { return liveTempo.getBpm(); }
+    double getLiveBeatPhase() const noexcept    { return liveTempo.getBeatPhase(); }
+
+    // Key lock: the pitch knob changes the key but leaves the tempo alone
+    void setKeyLockEnabled (bool shouldBeEnabled);
+    bool isKeyLockEnabled() const { return trackDeck.isKeyLockEnabled(); }
+
 private:
     //==============================================================================
     // Audio playback
     juce::AudioFormatManager formatManager;
-    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
-    std::unique_ptr<SmoothResamplingSource> pitchShifter;  // Real-time pitch shifting (turntable-style)
-    juce::AudioTransportSource transportSource;
+    DecodedTrackCache decodedTrackCache { formatManager };  // Recently played and upcoming tracks as PCM
+    TranscodeCache transcodeCache { formatManager };        // Every played track as PCM on disk, across sessions
+    TrackDeck trackDeck { formatManager, decodedTrackCache, transcodeCache };  // Loads tracks off the audio thread and swaps them in lock-free
+    LibraryIndex libraryIndex { formatManager, getLibraryIndexFile() };         // What's in the library, kept between sessions
+    LibraryAnalyser libraryAnalyser { formatManager, libraryIndex };            // Loudness, tempo and peaks for the index
     double currentPitchSemitones = 0.0;  // Current pitch in semitones
 
     // Track management
+    juce::File libraryFolder;
     juce::Array<juce::File> trackFiles;
     int currentTrackIndex = 0;
+    int queuedTrackIndex = -1;        // Preloaded by the deck to play after the current track
+    int handledTrackTransitions = 0;  // Deck transitions to the queued track already shown in the UI
+    bool followingTrackPending = false;  // Skipped ahead; queue the next track once the deck has switched
     juce::String currentTrackName;
 
     // Audio parameters
     float masterGain = 0.7f;
+    LoudnessNormaliser loudnessNormaliser;  // Per-track gain, folded into masterGain
+    LiveTempoTracker liveTempo;             // BPM and beat phase of the deck's output
 
     // Professional effects processor
     EffectsProcessor effectsProcessor;
@@ -179,8 +151,16 @@ private:
 
     //==============================================================================
     void loadTrack (int index);
+    void queueFollowingTrack();
+    void showQueuedTrack();
     void loadTracksFromFolder (const juce::File& folder);
+    void updateTracksFromIndex();
+    TrackSource::Loudness getTrackLoudness (const juce::File& file) const;
+    float getTrackBpm (const juce::File& file) const;
+    void updateLiveTempoRatio();
     void loadBundledMusic();
+    static juce::File getTranscodeCacheDirectory();
+    static juce::File getLibraryIndexFile();
     void playButtonClicked();
     void stopButtonClicked();
     void nextButtonClicked();
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "ResamplingKernels.h"
+#include <array>
+#include <atomic>
+
+//==============================================================================
+/**
+ * Drop-in replacement for juce::ResamplingAudioSource with selectable quality
+ *
+ *  - linear:  two taps, cheapest, dull and aliasing
+ *  - cubic:   four-tap Catmull-Rom, SoundTouch's InterpolateCubic
+ *  - shannon: eight-tap Kaiser-windowed sinc, SoundTouch's InterpolateShannon
+ *  - sinc:    band-limited polyphase windowed sinc whose cutoff follows the ratio,
+ *             so pitching up doesn't fold everything above the new Nyquist back down
+ *
+ * Only the sinc mode filters. The fixed kernels alias when the ratio goes above 1,
+ * just like the SoundTouch versions they're taken from.
+ *
+ * The kernels themselves are in ResamplingKernels.h. Works on planar float
+ * buffers sized in prepareToPlay(), so nothing allocates on the audio thread.
+ * Ratio changes are ramped across the next block like ResamplingAudioSource
+ * does. The ratio and quality can be set from any thread.
+ */
+class QualityResamplingSource : public juce::AudioSource
+{
+public:
+    using Quality = ResamplingKernels::Quality;
+
+    // Source samples per output sample are clamped to this - 2x pitch on top of a 4x rate conversion
+    static constexpr double maximumRatio = 8.0;
+
+    QualityResamplingSource (juce::AudioSource* inputSource, bool deleteInputWhenDeleted, int numChannelsToUse = 2)
+        : input (inputSource, deleteInputWhenDeleted),
+          numChannels (juce::jmax (1, numChannelsToUse))
+    {
+        ResamplingKernels::getSincTable();  // Built once, here rather than on the audio thread
+    }
+
+    // Source samples consumed per output sample
+    void setResamplingRatio (double samplesInPerOutputSample)
+    {
+        ratio = juce::jlimit (1.0 / maximumRatio, maximumRatio, samplesInPerOutputSample);
+    }
+
+    double getResamplingRatio() const noexcept  { return ratio.load(); }
+
+    // Applied from the next block
+    void setQuality (Quality newQuality)  { quality = static_cast<int> (newQuality); }
+    Quality getQuality() const noexcept   { return static_cast<Quality> (quality.load()); }
+
+    // Forget the interpolation history, e.g. after a seek. Audio thread, or while stopped.
+    void flushBuffers()
+    {
+        buffer.clear();
+        numBuffered = historyLength;
+        position = static_cast<double> (historyLength);
+        lastRatio = ratio.load();
+    }
+
+    //==============================================================================
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        // The input is pulled for about a block's worth at the current ratio
+        auto inputBlockSize = static_cast<int> (std::ceil (samplesPerBlockExpected * juce::jmax (1.0, ratio.load())));
+        input->prepareToPlay (inputBlockSize, sampleRate);
+
+        chunkSize = juce::jmax (1, samplesPerBlockExpected);
+
+        // History behind the read position, a whole chunk at the fastest ratio, and the taps ahead of it
+        auto size = historyLength + static_cast<int> (std::ceil (chunkSize * maximumRatio)) + historyLength + 4;
+        buffer.setSize (numChannels, size);
+
+        flushBuffers();
+    }
+
+    void releaseResources() override
+    {
+        input->releaseResources();
+        buffer.setSize (numChannels, 0);
+    }
+
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& info) override
+    {
+        if (buffer.getNumSamples() == 0)
+        {
+            info.clearActiveBufferRegion();
+            return;
+        }
+
+        auto targetRatio = ratio.load();
+        auto ratioStep = (targetRatio - lastRatio) / static_cast<double> (juce::jmax (1, info.numSamples));
+        auto currentQuality = static_cast<Quality> (quality.load());
+
+        // Devices occasionally ask for more than the prepared block size - split rather than allocate
+        for (int start = 0; start < info.numSamples; start += chunkSize)
+        {
+            auto numThisTime = juce::jmin (chunkSize, info.numSamples - start);
+            auto chunkRatio = lastRatio + ratioStep * start;
+
+            renderChunk (*info.buffer, info.startSample + start, numThisTime, chunkRatio, ratioStep, currentQuality);
+        }
+
+        lastRatio = targetRatio;
+
+        for (int ch = numChannels; ch < info.buffer->getNumChannels(); ++ch)
+            info.buffer->clear (ch, info.startSample, info.numSamples);
+    }
+
+private:
+    // Taps either side of the read position, at the widest the sinc kernel gets
+    static constexpr int historyLength = ResamplingKernels::getHalfWidth (maximumRatio);
+
+    //==============================================================================
+    void renderChunk (juce::AudioBuffer<float>& output, int outputStart, int numSamples,
+                      double startRatio, double ratioStep, Quality kernel)
+    {
+        // Pull enough source audio for the last output sample's taps
+        auto furthestRatio = juce::jmax (startRatio, startRatio + ratioStep * numSamples);
+        auto needed = static_cast<int> (position + furthestRatio * numSamples) + historyLength + 2;
+        fillBuffer (juce::jmin (needed, buffer.getNumSamples()));
+
+        auto sincScale = ResamplingKernels::getSincScale (furthestRatio);
+        auto numOutputChannels = juce::jmin (numChannels, output.getNumChannels());
+
+        auto currentRatio = startRatio;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto index = static_cast<int> (position);
+
+            // The weights only depend on the position, so every channel shares them
+            auto taps = ResamplingKernels::computeWeights (kernel, static_cast<float> (position - index), sincScale,
+                                                           weights.data());
+
+            for (int ch = 0; ch < numOutputChannels; ++ch)
+                output.getWritePointer (ch, outputStart)[i]
+                    = ResamplingKernels::dotProduct (buffer.getReadPointer (ch, index + taps.first), weights.data(), taps.count);
+
+            position += currentRatio;
+            currentRatio += ratioStep;
+        }
+
+        discardConsumed();
+    }
+
+    //==============================================================================
+    void fillBuffer (int numWanted)
+    {
+        if (numWanted <= numBuffered)
+            return;
+
+        input->getNextAudioBlock (juce::AudioSourceChannelInfo (&buffer, numBuffered, numWanted - numBuffered));
+        numBuffered = numWanted;
+    }
+
+    // Slide what's still needed (history plus anything read ahead) back to the front of the buffer
+    void discardConsumed()
+    {
+        auto firstNeeded = static_cast<int> (position) - historyLength;
+
+        if (firstNeeded <= 0)
+            return;
+
+        auto numToKeep = numBuffered - firstNeeded;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* data = buffer.getWritePointer (ch);
+            std::memmove (data, data + firstNeeded, sizeof (float) * static_cast<size_t> (numToKeep));
+        }
+
+        numBuffered = numToKeep;
+        position -= firstNeeded;
+    }
+
+    //==============================================================================
+    juce::OptionalScopedPointer<juce::AudioSource> input;
+    const int numChannels;
+
+    std::atomic<double> ratio { 1.0 };
+    std::atomic<int> quality { static_cast<int> (Quality::sinc) };
+
+    // Audio thread only
+    juce::AudioBuffer<float> buffer;  // Planar source audio, historyLength samples behind the read position
+    int numBuffered = 0, chunkSize = 0;
+    double position = 0.0;            // Read position in buffer, in source samples
+    double lastRatio = 1.0;
+    std::array<float, 2 * historyLength + 4> weights {};  // Current output sample's kernel
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (QualityResamplingSource)
+};
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+//==============================================================================
+/**
+ * Background read-ahead buffer for compressed track playback
+ *
+ * Decodes the wrapped source on a shared TimeSliceThread into a lock-free
+ * ring buffer, so the audio callback only ever copies already-decoded PCM.
+ * Sits directly under SmoothResamplingSource so pitch changes are heard
+ * immediately instead of after the buffer depth.
+ */
+class ReadAheadAudioSource : public juce::PositionableAudioSource,
+                             private juce::TimeSliceClient
+{
+public:
+    static constexpr double minimumBufferSeconds = 0.5;
+    static constexpr double maximumBufferSeconds = 10.0;
+
+    ReadAheadAudioSource (juce::PositionableAudioSource* inputSource, bool deleteSourceWhenDeleted,
+                          juce::TimeSliceThread& thread, double sourceSampleRateToUse,
+                          double bufferSecondsToUse, int numChannelsToUse = 2)
+        : source (inputSource, deleteSourceWhenDeleted),
+          backgroundThread (thread),
+          sourceSampleRate (sourceSampleRateToUse > 0.0 ? sourceSampleRateToUse : 44100.0),
+          numChannels (juce::jmax (1, numChannelsToUse))
+    {
+        setBufferSeconds (bufferSecondsToUse);
+    }
+
+    ~ReadAheadAudioSource() override
+    {
+        releaseResources();
+    }
+
+    // Buffer depth in seconds of source audio (0.5 to 10s) - applied on the next prepareToPlay
+    void setBufferSeconds (double seconds)
+    {
+        bufferSeconds = juce::jlimit (minimumBufferSeconds, maximumBufferSeconds, seconds);
+    }
+
+    double getBufferSeconds() const noexcept { return bufferSeconds; }
+
+    // Underrun counters - safe to query from any thread
+    int getNumUnderruns() const noexcept               { return numUnderruns.load(); }
+    juce::int64 getNumUnderrunSamples() const noexcept { return numUnderrunSamples.load(); }
+
+    void resetUnderrunCounters() noexcept
+    {
+        numUnderruns = 0;
+        numUnderrunSamples = 0;
+    }
+
+    // How much decoded audio is waiting for the audio thread
+    int getNumBufferedSamples() const noexcept { return fifo.getNumReady(); }
+
+    double getBufferedSeconds() const noexcept
+    {
+        return getNumBufferedSamples() / sourceSampleRate;
+    }
+
+    // Blocks until at least the given number of samples are decoded (or the
+    // source runs out). Never call this from the audio thread.
+    bool waitUntilPrimed (int numSamplesWanted, int timeoutMs)
+    {
+        auto target = juce::jmin (numSamplesWanted, fifo.getTotalSize() - 1);
+        auto endTime = juce::Time::getMillisecondCounter() + static_cast<juce::uint32> (timeoutMs);
+
+        while (fifo.getNumReady() < target && ! isDecodeFinished())
+        {
+            if (juce::Time::getMillisecondCounter() >= endTime)
+                return false;
+
+            backgroundThread.moveToFrontOfQueue (this);
+            juce::Thread::sleep (1);
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        juce::ignoreUnused (sampleRate);
+
+        backgroundThread.removeTimeSliceClient (this);
+
+        auto capacity = juce::jmax (samplesPerBlockExpected * 4,
+                                    static_cast<int> (bufferSeconds * sourceSampleRate));
+
+        buffer.setSize (numChannels, capacity + 1);
+        buffer.clear();
+        fifo.setTotalSize (capacity + 1);
+
+        source->prepareToPlay (decodeChunkSize, sourceSampleRate);
+
+        auto startPosition = pendingSeek.exchange (-1);
+        if (startPosition < 0)
+            startPosition = readPosition.load();
+
+        source->setNextReadPosition (startPosition);
+        decodePosition = startPosition;
+        readPosition = startPosition;
+        isPrepared = true;
+
+        backgroundThread.addTimeSliceClient (this);
+
+        // Prime a couple of blocks so playback starts without an initial underrun
+        waitUntilPrimed (samplesPerBlockExpected * 2, 500);
+    }
+
+    void releaseResources() override
+    {
+        backgroundThread.removeTimeSliceClient (this);
+
+        if (isPrepared)
+        {
+            isPrepared = false;
+            source->releaseResources();
+        }
+
+        buffer.setSize (numChannels, 0);
+        fifo.reset();
+    }
+
+    // Audio thread: copy decoded PCM out of the ring buffer, never touches the decoder
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& info) override
+    {
+        const juce::SpinLock::ScopedTryLockType sl (resetLock);
+
+        if (! sl.isLocked() || pendingSeek.load() >= 0)
+        {
+            // Seek in progress - the background thread is refilling from the new position
+            info.clearActiveBufferRegion();
+            return;
+        }
+
+        auto position = readPosition.load();
+        auto totalLength = source->getTotalLength();
+        auto numWanted = info.numSamples;
+
+        if (! source->isLooping())
+            numWanted = static_cast<int> (juce::jlimit ((juce::int64) 0, (juce::int64) info.numSamples,
+                                                        totalLength - position));
+
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (numWanted, start1, size1, start2, size2);
+
+        auto numRead = size1 + size2;
+        auto numOutputChannels = info.buffer->getNumChannels();
+
+        for (int ch = 0; ch < numOutputChannels; ++ch)
+        {
+            auto sourceChannel = ch % numChannels;
+
+            if (size1 > 0)
+                info.buffer->copyFrom (ch, info.startSample, buffer, sourceChannel, start1, size1);
+
+            if (size2 > 0)
+                info.buffer->copyFrom (ch, info.startSample + size1, buffer, sourceChannel, start2, size2);
+        }
+
+        fifo.finishedRead (numRead);
+
+        if (numRead < info.numSamples)
+            info.buffer->clear (info.startSample + numRead, info.numSamples - numRead);
+
+        if (numRead < numWanted)
+        {
+            ++numUnderruns;
+            numUnderrunSamples += numWanted - numRead;
+        }
+
+        readPosition = position + numRead;
+    }
+
+    //==============================================================================
+    void setNextReadPosition (juce::int64 newPosition) override
+    {
+        if (! isPrepared)
+        {
+            readPosition = newPosition;
+            return;
+        }
+
+        // May be called from the audio thread - the background thread picks this up on its next slice
+        pendingSeek = newPosition;
+    }
+
+    juce::int64 getNextReadPosition() const override
+    {
+        auto seekTarget = pendingSeek.load();
+        auto position = seekTarget >= 0 ? seekTarget : readPosition.load();
+
+        if (source->isLooping() && source->getTotalLength() > 0)
+            return position % source->getTotalLength();
+
+        return position;
+    }
+
+    juce::int64 getTotalLength() const override     { return source->getTotalLength(); }
+    bool isLooping() const override                 { return source->isLooping(); }
+    void setLooping (bool shouldLoop) override      { source->setLooping (shouldLoop); }
+
+private:
+    //==============================================================================
+    int useTimeSlice() override
+    {
+        {
+            const juce::SpinLock::ScopedLockType sl (resetLock);
+            auto seekTarget = pendingSeek.exchange (-1);
+
+            if (seekTarget >= 0)
+            {
+                fifo.reset();
+                source->setNextReadPosition (seekTarget);
+                decodePosition = seekTarget;
+                readPosition = seekTarget;
+            }
+        }
+
+        if (isDecodeFinished())
+            return 20;  // Keep polling so seeks are picked up quickly
+
+        auto numToDecode = juce::jmin (decodeChunkSize, fifo.getFreeSpace());
+
+        if (! source->isLooping())
+            numToDecode = static_cast<int> (juce::jmin ((juce::int64) numToDecode,
+                                                        source->getTotalLength() - decodePosition.load()));
+
+        if (numToDecode <= 0)
+            return 20;  // Buffer full - plenty of decoded audio waiting
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (numToDecode, start1, size1, start2, size2);
+
+        if (size1 > 0)
+            source->getNextAudioBlock (juce::AudioSourceChannelInfo (&buffer, start1, size1));
+
+        if (size2 > 0)
+            source->getNextAudioBlock (juce::AudioSourceChannelInfo (&buffer, start2, size2));
+
+        decodePosition += size1 + size2;
+        fifo.finishedWrite (size1 + size2);
+
+        return 1;
+    }
+
+    bool isDecodeFinished() const
+    {
+        return ! source->isLooping() && decodePosition >= source->getTotalLength();
+    }
+
+    static constexpr int decodeChunkSize = 4096;
+
+    juce::OptionalScopedPointer<juce::PositionableAudioSource> source;
+    juce::TimeSliceThread& backgroundThread;
+    const double sourceSampleRate;
+    const int numChannels;
+    double bufferSeconds = 2.0;
+
+    juce::AudioBuffer<float> buffer;
+    juce::AbstractFifo fifo { 1 };
+    juce::SpinLock resetLock;  // Only contended while a seek flushes the ring buffer
+
+    std::atomic<juce::int64> readPosition { 0 };
+    std::atomic<juce::int64> pendingSeek { -1 };
+    std::atomic<juce::int64> decodePosition { 0 };  // Written by the background thread only
+    bool isPrepared = false;
+
+    std::atomic<int> numUnderruns { 0 };
+    std::atomic<juce::int64> numUnderrunSamples { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ReadAheadAudioSource)
+};
@@ -0,0 +1,116 @@
+#include "RealtimeAllocationGuard.h"
+
+#if MODULARRADIO_CHECK_REALTIME_ALLOCATIONS
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_WINDOWS
+ #include <malloc.h>
+#endif
+
+// Global allocation hooks for the real-time allocation check - debug builds only
+namespace
+{
+    [[noreturn]] void failRealtimeAllocation (const char* what) noexcept
+    {
+        // No DBG/Logger here - they allocate
+        std::fprintf (stderr, "ModularRadio: %s inside a real-time scope (RealtimeAllocationGuard)\n", what);
+        std::fflush (stderr);
+        std::abort();
+    }
+
+    void* allocate (std::size_t size)
+    {
+        if (RealtimeAllocationGuard::isInsideScope())
+            failRealtimeAllocation ("heap allocation");
+
+        if (auto* p = std::malloc (size > 0 ? size : 1))
+            return p;
+
+        throw std::bad_alloc();
+    }
+
+    void* allocateNoThrow (std::size_t size) noexcept
+    {
+        if (RealtimeAllocationGuard::isInsideScope())
+            failRealtimeAllocation ("heap allocation");
+
+        return std::malloc (size > 0 ? size : 1);
+    }
+
+    void release (void* p) noexcept
+    {
+        if (p != nullptr && RealtimeAllocationGuard::isInsideScope())
+            failRealtimeAllocation ("heap free");
+
+        std::free (p);
+    }
+
+   #if __cpp_aligned_new
+    // Over-aligned types (alignas above the default) come through these
+    void* allocateAlignedNoThrow (std::size_t size, std::align_val_t alignment) noexcept
+    {
+        if (RealtimeAllocationGuard::isInsideScope())
+            failRealtimeAllocation ("aligned heap allocation");
+
+        auto align = juce::jmax (static_cast<std::size_t> (alignment), sizeof (void*));
+
+       #if JUCE_WINDOWS
+        return _aligned_malloc (size > 0 ? size : 1, align);
+       #else
+        void* p = nullptr;
+        return posix_memalign (&p, align, size > 0 ? size : 1) == 0 ? p : nullptr;
+       #endif
+    }
+
+    void* allocateAligned (std::size_t size, std::align_val_t alignment)
+    {
+        if (auto* p = allocateAlignedNoThrow (size, alignment))
+            return p;
+
+        throw std::bad_alloc();
+    }
+
+    void releaseAligned (void* p) noexcept
+    {
+        if (p != nullptr && RealtimeAllocationGuard::isInsideScope())
+            failRealtimeAllocation ("aligned heap free");
+
+       #if JUCE_WINDOWS
+        _aligned_free (p);
+       #else
+        std::free (p);
+       #endif
+    }
+   #endif
+}
+
+void* operator new (std::size_t size)                                    { return allocate (size); }
+void* operator new[] (std::size_t size)                                  { return allocate (size); }
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept    { return allocateNoThrow (size); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept  { return allocateNoThrow (size); }
+
+void operator delete (void* p) noexcept                                  { release (p); }
+void operator delete[] (void* p) noexcept                                { release (p); }
+void operator delete (void* p, std::size_t) noexcept                     { release (p); }
+void operator delete[] (void* p, std::size_t) noexcept                   { release (p); }
+void operator delete (void* p, const std::nothrow_t&) noexcept           { release (p); }
+void operator delete[] (void* p, const std::nothrow_t&) noexcept         { release (p); }
+
+#if __cpp_aligned_new
+void* operator new (std::size_t size, std::align_val_t a)                                    { return allocateAligned (size, a); }
+void* operator new[] (std::size_t size, std::align_val_t a)                                  { return allocateAligned (size, a); }
+void* operator new (std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept    { return allocateAlignedNoThrow (size, a); }
+void* operator new[] (std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept  { return allocateAlignedNoThrow (size, a); }
+
+void operator delete (void* p, std::align_val_t) noexcept                                    { releaseAligned (p); }
+void operator delete[] (void* p, std::align_val_t) noexcept                                  { releaseAligned (p); }
+void operator delete (void* p, std::size_t, std::align_val_t) noexcept                       { releaseAligned (p); }
+void operator delete[] (void* p, std::size_t, std::align_val_t) noexcept                     { releaseAligned (p); }
+void operator delete (void* p, std::align_val_t, const std::nothrow_t&) noexcept             { releaseAligned (p); }
+void operator delete[] (void* p, std::align_val_t, const std::nothrow_t&) noexcept           { releaseAligned (p); }
+#endif
+
+#endif
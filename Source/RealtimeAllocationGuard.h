@@ -0,0 +1,45 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Set to 1 (the Debug configuration does) to abort on any heap use inside a ScopedNoAllocation
+#ifndef MODULARRADIO_CHECK_REALTIME_ALLOCATIONS
+ #define MODULARRADIO_CHECK_REALTIME_ALLOCATIONS 0
+#endif
+
+//==============================================================================
+/**
+ * Debug check that real-time code never touches the heap
+ *
+ * With MODULARRADIO_CHECK_REALTIME_ALLOCATIONS enabled, RealtimeAllocationGuard.cpp
+ * replaces the global operator new/delete, and any allocation or free made on a
+ * thread inside a ScopedNoAllocation prints what happened and aborts. In normal
+ * builds the scope is an empty object and costs nothing.
+ */
+struct RealtimeAllocationGuard
+{
+   #if MODULARRADIO_CHECK_REALTIME_ALLOCATIONS
+    static int& getScopeDepth() noexcept
+    {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    static bool isInsideScope() noexcept  { return getScopeDepth() > 0; }
+
+    struct ScopedNoAllocation
+    {
+        ScopedNoAllocation() noexcept   { ++getScopeDepth(); }
+        ~ScopedNoAllocation() noexcept  { --getScopeDepth(); }
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedNoAllocation)
+    };
+   #else
+    static bool isInsideScope() noexcept  { return false; }
+
+    struct ScopedNoAllocation
+    {
+        ScopedNoAllocation() noexcept {}
+    };
+   #endif
+};
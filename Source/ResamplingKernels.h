@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+
+//==============================================================================
+/**
+ * The interpolation kernels behind QualityResamplingSource
+ *
+ * Kept free of JUCE so that Tools/DspBench can measure their aliasing, imaging
+ * and speed on their own. computeWeights() fills in one output sample's weights
+ * and says which source samples they apply to; dotProduct() applies them to a
+ * channel.
+ */
+struct ResamplingKernels
+{
+    enum class Quality
+    {
+        linear, cubic, shannon, sinc
+    };
+
+    // Windowed sinc sampled finely enough that linear interpolation between entries is transparent
+    static constexpr int zeroCrossings = 16;
+    static constexpr int tablePointsPerCrossing = 256;
+    static constexpr float sincCutoff = 0.95f;  // Of the lower Nyquist, leaving room for the transition band
+
+    // Taps either side of the read position at the widest the sinc kernel gets for a ratio of up to maximumRatio
+    static constexpr int getHalfWidth (double maximumRatio)
+    {
+        return static_cast<int> (zeroCrossings * maximumRatio / sincCutoff) + 2;
+    }
+
+    // Below 1 the sinc cutoff stays just under the source Nyquist; above it follows the output's
+    static float getSincScale (double ratio)
+    {
+        return sincCutoff / static_cast<float> (ratio > 1.0 ? ratio : 1.0);
+    }
+
+    // The kernel's taps run from x[index + first] to x[index + first + count - 1]
+    struct Taps
+    {
+        int first, count;
+    };
+
+    // 'w' needs room for 2 * getHalfWidth (ratio) + 2 weights
+    static Taps computeWeights (Quality kernel, float fraction, float sincScale, float* w)
+    {
+        switch (kernel)
+        {
+            case Quality::linear:
+                w[0] = 1.0f - fraction;
+                w[1] = fraction;
+                return { 0, 2 };
+
+            case Quality::cubic:
+            {
+                // Catmull-Rom through x[-1]..x[2], the same coefficients as SoundTouch's InterpolateCubic
+                auto f = fraction, f2 = f * f, f3 = f2 * f;
+
+                w[0] = -0.5f * f3 + 1.0f * f2 - 0.5f * f;
+                w[1] =  1.5f * f3 - 2.5f * f2 + 1.0f;
+                w[2] = -1.5f * f3 + 2.0f * f2 + 0.5f * f;
+                w[3] =  0.5f * f3 - 0.5f * f2;
+                return { -1, 4 };
+            }
+
+            case Quality::shannon:
+                return computeShannonWeights (fraction, w);
+
+            case Quality::sinc:
+                return computeSincWeights (fraction, sincScale, w);
+        }
+
+        return { 0, 0 };
+    }
+
+    // Four running sums so the compiler can keep them in one vector register
+    static float dotProduct (const float* x, const float* w, int numTaps)
+    {
+        float sums[4] = {};
+        int k = 0;
+
+        for (; k + 4 <= numTaps; k += 4)
+            for (int j = 0; j < 4; ++j)
+                sums[j] += x[k + j] * w[k + j];
+
+        for (; k < numTaps; ++k)
+            sums[0] += x[k] * w[k];
+
+        return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    }
+
+    using SincTable = std::array<float, zeroCrossings * tablePointsPerCrossing + 2>;
+
+    static const SincTable& getSincTable()
+    {
+        static const SincTable table = []
+        {
+            SincTable t {};
+            constexpr double beta = 9.0;  // Kaiser window, about -90 dB sidelobes
+            constexpr double pi = 3.14159265358979323846;
+
+            auto besselI0 = [] (double x)
+            {
+                double sum = 1.0, term = 1.0;
+
+                for (int k = 1; k < 32; ++k)
+                {
+                    term *= (x * 0.5 / k) * (x * 0.5 / k);
+                    sum += term;
+                }
+
+                return sum;
+            };
+
+            for (size_t i = 0; i < t.size(); ++i)
+            {
+                auto x = static_cast<double> (i) / tablePointsPerCrossing;
+                auto r = x / zeroCrossings;
+                auto window = x < zeroCrossings ? besselI0 (beta * std::sqrt (1.0 - r * r)) / besselI0 (beta) : 0.0;
+                auto sinc = x > 0.0 ? std::sin (pi * x) / (pi * x) : 1.0;
+                t[i] = static_cast<float> (sinc * window);
+            }
+
+            return t;
+        }();
+
+        return table;
+    }
+
+private:
+    //==============================================================================
+    static constexpr float pi = 3.14159265358979323846f;
+
+    // SoundTouch's InterpolateShannon taps x[-3]..x[4], with one sin() per sample instead of eight:
+    // sin (pi * (k - f)) is just -(-1)^k * sin (pi * f). Normalised so the Kaiser table's 5%
+    // headroom scaling doesn't turn into a level drop.
+    static Taps computeShannonWeights (float fraction, float* w)
+    {
+        static constexpr float kaiser8[8] = { 0.41778693f, 0.64888025f, 0.83508562f, 0.93887858f,
+                                              0.93887858f, 0.83508562f, 0.64888025f, 0.41778693f };
+
+        // On a sample the kernel is just that sample. A fraction just short of 1 can round up to
+        // exactly 1.0f, which would otherwise divide by zero at k = 1.
+        if (fraction < 1.0e-5f || fraction > 1.0f - 1.0e-5f)
+        {
+            w[0] = 1.0f;
+            return { fraction < 0.5f ? 0 : 1, 1 };
+        }
+
+        auto sinPiF = std::sin (pi * fraction);
+        auto weightSum = 0.0f;
+
+        for (int k = -3; k <= 4; ++k)
+        {
+            auto t = static_cast<float> (k) - fraction;
+            auto sign = (k & 1) != 0 ? 1.0f : -1.0f;
+            auto weight = sign * sinPiF / (pi * t) * kaiser8[k + 3];
+
+            w[k + 3] = weight;
+            weightSum += weight;
+        }
+
+        for (int k = 0; k < 8; ++k)
+            w[k] /= weightSum;
+
+        return { -3, 8 };
+    }
+
+    // Band-limited interpolation (Smith/Gossett): the kernel is stretched by 1/scale, so it gets
+    // wider and lower as the ratio goes up and always stops short of the output Nyquist
+    static Taps computeSincWeights (float fraction, float scale, float* w)
+    {
+        auto& table = getSincTable();
+        auto numTaps = static_cast<int> (static_cast<float> (zeroCrossings) / scale);
+        auto tableStep = scale * tablePointsPerCrossing;
+        auto tableEnd = static_cast<float> (zeroCrossings * tablePointsPerCrossing);
+
+        Taps taps { -numTaps, 2 * numTaps + 2 };
+
+        for (int k = 0; k < taps.count; ++k)
+        {
+            auto tablePos = std::abs (static_cast<float> (taps.first + k) - fraction) * tableStep;
+            w[k] = tablePos < tableEnd ? lookUp (table, tablePos) * scale : 0.0f;
+        }
+
+        return taps;
+    }
+
+    static float lookUp (const SincTable& table, float tablePosition)
+    {
+        auto i = static_cast<int> (tablePosition);
+        auto f = tablePosition - static_cast<float> (i);
+        return table[static_cast<size_t> (i)] + f * (table[static_cast<size_t> (i) + 1] - table[static_cast<size_t> (i)]);
+    }
+};
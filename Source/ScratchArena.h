@@ -0,0 +1,63 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * Preallocated scratch buffers for the audio thread
+ *
+ * Sized once in prepare() from the maximum block size and channel count.
+ * acquire() hands out views into that storage and reset() at the top of each
+ * block makes them all available again, so nothing is allocated per block.
+ */
+class ScratchArena
+{
+public:
+    ScratchArena() = default;
+
+    // Message thread, while audio is stopped
+    void prepare (int numChannelsToUse, int maximumBlockSizeToUse, int numBuffersToUse)
+    {
+        numChannels = juce::jmax (1, numChannelsToUse);
+        maximumBlockSize = juce::jmax (0, maximumBlockSizeToUse);
+        numBuffers = juce::jmax (1, numBuffersToUse);
+        numInUse = 0;
+
+        storage.setSize (numChannels * numBuffers, maximumBlockSize);
+        storage.clear();
+    }
+
+    int getNumChannels() const noexcept      { return numChannels; }
+    int getMaximumBlockSize() const noexcept { return maximumBlockSize; }
+
+    // Releases every block handed out since the last reset
+    void reset() noexcept { numInUse = 0; }
+
+    // A block of up to getNumChannels() x getMaximumBlockSize() samples, valid until
+    // the next reset(). Contents are whatever the previous user left there.
+    juce::dsp::AudioBlock<float> acquire (size_t numChannelsWanted, size_t numSamples)
+    {
+        if (numInUse >= numBuffers
+             || numChannelsWanted > static_cast<size_t> (numChannels)
+             || numSamples > static_cast<size_t> (maximumBlockSize))
+        {
+            jassertfalse;  // Block larger than prepared, or more buffers than prepare() asked for
+            return {};
+        }
+
+        auto firstChannel = static_cast<size_t> (numInUse++ * numChannels);
+
+        return juce::dsp::AudioBlock<float> (storage)
+                   .getSubsetChannelBlock (firstChannel, numChannelsWanted)
+                   .getSubBlock (0, numSamples);
+    }
+
+private:
+    juce::AudioBuffer<float> storage;
+    int numChannels = 2;
+    int maximumBlockSize = 0;
+    int numBuffers = 1;
+    int numInUse = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ScratchArena)
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "QualityResamplingSource.h"
+
+//==============================================================================
+// Resampler wrapper that implements PositionableAudioSource
+// This provides smooth, click-free pitch shifting (changes pitch AND tempo like a turntable)
+// with a selectable interpolation quality. The file-to-device rate conversion is folded
+// into the same ratio, so each sample is only interpolated once.
+class SmoothResamplingSource : public juce::PositionableAudioSource
+{
+public:
+    SmoothResamplingSource (juce::PositionableAudioSource* inputSource, bool deleteSourceWhenDeleted)
+        : source (inputSource),
+          deleteSource (deleteSourceWhenDeleted),
+          resampler (inputSource, false, 2)  // 2 channels
+    {
+        // Start at normal pitch (1.0 = no change)
+        updateResamplingRatio();
+    }
+
+    ~SmoothResamplingSource() override
+    {
+        if (deleteSource)
+            delete source;
+    }
+
+    void setPitchSemitones (double semitones)
+    {
+        // Convert semitones to playback ratio: ratio = 2^(semitones/12)
+        double ratio = std::pow (2.0, semitones / 12.0);
+
+        // Clamp to reasonable range
+        pitchRatio = juce::jlimit (0.5, 2.0, ratio);
+
+        // This is inherently smooth - the resampler ramps ratio changes across a block
+        updateResamplingRatio();
+    }
+
+    // Source sample rate / device sample rate. Set before prepareToPlay(), not while playing.
+    void setSampleRateRatio (double sourceRateOverDeviceRate)
+    {
+        sampleRateRatio = sourceRateOverDeviceRate > 0.0 ? sourceRateOverDeviceRate : 1.0;
+        updateResamplingRatio();
+    }
+
+    // Safe from any thread, applied from the next block
+    void setQuality (QualityResamplingSource::Quality quality)
+    {
+        resampler.setQuality (quality);
+    }
+
+    // Pitch factor alone (1.0 = no change)
+    double getPitchRatio() const
+    {
+        return pitchRatio.load();
+    }
+
+    // Source samples consumed per output sample: pitch and rate conversion together
+    double getResamplingRatio() const
+    {
+        return resampler.getResamplingRatio();
+    }
+
+    // AudioSource methods
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        resampler.prepareToPlay (samplesPerBlockExpected, sampleRate);
+    }
+
+    void releaseResources() override
+    {
+        resampler.releaseResources();
+    }
+
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill) override
+    {
+        resampler.getNextAudioBlock (bufferToFill);
+    }
+
+    // PositionableAudioSource methods - delegate to source
+    void setNextReadPosition (juce::int64 newPosition) override
+    {
+        // Drop interpolation history from the old position so a seek doesn't smear
+        resampler.flushBuffers();
+
+        if (source != nullptr)
+            source->setNextReadPosition (newPosition);
+    }
+
+    juce::int64 getNextReadPosition() const override
+    {
+        return source != nullptr ? source->getNextReadPosition() : 0;
+    }
+
+    juce::int64 getTotalLength() const override
+    {
+        return source != nullptr ? source->getTotalLength() : 0;
+    }
+
+    bool isLooping() const override
+    {
+        return source != nullptr ? source->isLooping() : false;
+    }
+
+private:
+    juce::PositionableAudioSource* source;
+    bool deleteSource;
+    QualityResamplingSource resampler;
+    std::atomic<double> pitchRatio { 1.0 }, sampleRateRatio { 1.0 };
+
+    void updateResamplingRatio()
+    {
+        resampler.setResamplingRatio (pitchRatio.load() * sampleRateRatio.load());
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SmoothResamplingSource)
+};
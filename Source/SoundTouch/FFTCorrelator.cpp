@@ -0,0 +1,364 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Cross-correlation of a short sample sequence against every position of a
+/// longer one at once, using a real-input FFT.
+///
+/// Correlating 'compareLength' samples at 'numPositions' positions directly
+/// takes numPositions * compareLength multiply-adds. Here both sequences are
+/// transformed, multiplied bin by bin and transformed back, which costs three
+/// transforms of a length a bit over numPositions + compareLength instead.
+///
+/// The real transforms are done as complex ones of half the length, with even
+/// samples as the real parts and odd samples as the imaginary parts, then
+/// split into the real spectrum. The complex FFT is a plain iterative radix-2
+/// one with a table of twiddles for each stage, so the inner loops run
+/// through contiguous arrays and vectorize.
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <assert.h>
+
+#include "FFTCorrelator.h"
+
+using namespace soundtouch;
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+
+FFTCorrelator::FFTCorrelator()
+{
+    numPositions = compareLength = 0;
+    stride = 1;
+    fftLength = halfLength = 0;
+
+    bitReverse = NULL;
+    stageTwiddles = splitTwiddles = NULL;
+    workRe = workIm = NULL;
+    refRe = refIm = NULL;
+    cmpRe = cmpIm = NULL;
+    result = NULL;
+}
+
+
+FFTCorrelator::~FFTCorrelator()
+{
+    freeBuffers();
+}
+
+
+void FFTCorrelator::freeBuffers()
+{
+    delete[] bitReverse;
+    delete[] stageTwiddles;
+    delete[] splitTwiddles;
+    delete[] workRe;
+    delete[] workIm;
+    delete[] refRe;
+    delete[] refIm;
+    delete[] cmpRe;
+    delete[] cmpIm;
+    delete[] result;
+}
+
+
+bool FFTCorrelator::setLengths(int aNumPositions, int aCompareLength, int aStride)
+{
+    int refLength;
+    int newLength;
+    int i, bits;
+
+    assert(aNumPositions > 0 && aCompareLength > 0 && aStride > 0);
+
+    if (aNumPositions == numPositions && aCompareLength == compareLength && aStride == stride)
+    {
+        return false;
+    }
+
+    numPositions = aNumPositions;
+    compareLength = aCompareLength;
+    stride = aStride;
+
+    // the reference sequence has to fit without wrapping round, so that the
+    // circular correlation equals the linear one at every position needed.
+    // The radix-4 stage of complexFFT needs halfLength of at least 4.
+    refLength = (numPositions - 1) * stride + compareLength;
+    newLength = 8;
+    while (newLength < refLength) newLength *= 2;
+
+    if (newLength == fftLength) return true;
+
+    freeBuffers();
+
+    fftLength = newLength;
+    halfLength = newLength / 2;
+
+    bitReverse = new int[halfLength];
+    stageTwiddles = new float[2 * halfLength];
+    splitTwiddles = new float[2 * halfLength];
+    workRe = new float[halfLength];
+    workIm = new float[halfLength];
+    refRe = new float[halfLength + 1];
+    refIm = new float[halfLength + 1];
+    cmpRe = new float[halfLength + 1];
+    cmpIm = new float[halfLength + 1];
+    result = new float[fftLength];      // numPositions can't exceed refLength
+
+    for (bits = 0; (1 << bits) < halfLength; bits ++) {}
+
+    for (i = 0; i < halfLength; i ++)
+    {
+        int j, rev = 0;
+        for (j = 0; j < bits; j ++)
+        {
+            rev |= ((i >> j) & 1) << (bits - 1 - j);
+        }
+        bitReverse[i] = rev;
+    }
+
+    // stage with butterflies 'len' apart uses exp(-2 pi i j / 2len), j < len;
+    // cosines first, then sines, for each stage in turn
+    float *tw = stageTwiddles;
+    for (int len = 1; len < halfLength; len *= 2)
+    {
+        for (i = 0; i < len; i ++)
+        {
+            double angle = -M_PI * i / len;
+            tw[i] = (float)cos(angle);
+            tw[len + i] = (float)sin(angle);
+        }
+        tw += 2 * len;
+    }
+
+    for (i = 0; i < halfLength; i ++)
+    {
+        double angle = -2.0 * M_PI * i / fftLength;
+        splitTwiddles[i] = (float)cos(angle);
+        splitTwiddles[halfLength + i] = (float)sin(angle);
+    }
+
+    return true;
+}
+
+
+// One run of radix-2 butterflies. The two halves never overlap; saying so
+// lets the compiler vectorize the loop.
+static void butterflies(float * __restrict aRe, float * __restrict aIm,
+                        float * __restrict bRe, float * __restrict bIm,
+                        const float * __restrict twRe, const float * __restrict twIm, int count)
+{
+    for (int j = 0; j < count; j ++)
+    {
+        float vRe = bRe[j] * twRe[j] - bIm[j] * twIm[j];
+        float vIm = bRe[j] * twIm[j] + bIm[j] * twRe[j];
+
+        bRe[j] = aRe[j] - vRe;
+        bIm[j] = aIm[j] - vIm;
+        aRe[j] += vRe;
+        aIm[j] += vIm;
+    }
+}
+
+
+void FFTCorrelator::complexFFT(float *re, float *im) const
+{
+    const float *tw;
+    int len, start;
+
+    assert(halfLength >= 4);
+
+    // the first two stages have twiddles of 1 and -i only, done together
+    // as radix-4 butterflies
+    for (start = 0; start < halfLength; start += 4)
+    {
+        float r0 = re[start] + re[start + 1], i0 = im[start] + im[start + 1];
+        float r1 = re[start] - re[start + 1], i1 = im[start] - im[start + 1];
+        float r2 = re[start + 2] + re[start + 3], i2 = im[start + 2] + im[start + 3];
+        float r3 = re[start + 2] - re[start + 3], i3 = im[start + 2] - im[start + 3];
+
+        re[start] = r0 + r2;
+        im[start] = i0 + i2;
+        re[start + 2] = r0 - r2;
+        im[start + 2] = i0 - i2;
+        // odd half times -i
+        re[start + 1] = r1 + i3;
+        im[start + 1] = i1 - r3;
+        re[start + 3] = r1 - i3;
+        im[start + 3] = i1 + r3;
+    }
+
+    tw = stageTwiddles + 2 * (1 + 2);
+    for (len = 4; len < halfLength; len *= 2)
+    {
+        for (start = 0; start < halfLength; start += 2 * len)
+        {
+            butterflies(re + start, im + start, re + start + len, im + start + len, tw, tw + len, len);
+        }
+        tw += 2 * len;
+    }
+}
+
+
+void FFTCorrelator::loadBitReversed(const float *data, int length, float *re, float *im) const
+{
+    int i;
+    int numPairs = length / 2;
+
+    assert(length <= fftLength);
+
+    for (i = 0; i < numPairs; i ++)
+    {
+        re[bitReverse[i]] = data[2 * i];
+        im[bitReverse[i]] = data[2 * i + 1];
+    }
+    if (length & 1)
+    {
+        re[bitReverse[i]] = data[2 * i];
+        im[bitReverse[i]] = 0;
+        i ++;
+    }
+    for (; i < halfLength; i ++)
+    {
+        re[bitReverse[i]] = 0;
+        im[bitReverse[i]] = 0;
+    }
+}
+
+
+void FFTCorrelator::realFFT(const float *data, int length, float *outRe, float *outIm)
+{
+    int i;
+
+    loadBitReversed(data, length, workRe, workIm);
+    complexFFT(workRe, workIm);
+
+    // split into the spectra of even and odd samples and combine those
+    outRe[0] = workRe[0] + workIm[0];
+    outIm[0] = 0;
+    outRe[halfLength] = workRe[0] - workIm[0];
+    outIm[halfLength] = 0;
+
+    for (i = 1; i < halfLength; i ++)
+    {
+        float aRe = workRe[i], aIm = workIm[i];
+        float bRe = workRe[halfLength - i], bIm = workIm[halfLength - i];
+
+        float evenRe = 0.5f * (aRe + bRe);
+        float evenIm = 0.5f * (aIm - bIm);
+        float oddRe = 0.5f * (aIm + bIm);
+        float oddIm = 0.5f * (bRe - aRe);
+
+        float wRe = splitTwiddles[i];
+        float wIm = splitTwiddles[halfLength + i];
+
+        outRe[i] = evenRe + oddRe * wRe - oddIm * wIm;
+        outIm[i] = evenIm + oddRe * wIm + oddIm * wRe;
+    }
+}
+
+
+const float *FFTCorrelator::correlate(const float *ref, const float *compare)
+{
+    int i;
+    int refLength = (numPositions - 1) * stride + compareLength;
+    float scale = 1.0f / halfLength;
+
+    assert(fftLength > 0);
+
+    if ((stride & 1) == 0)
+    {
+        // With an even stride every position falls on a sample pair, and the
+        // real part of the correlation of the sequences packed as complex
+        // pairs is the whole answer: re(x0 + i x1)(y0 - i y1) = x0 y0 + x1 y1.
+        // That needs no splitting into real spectra at all.
+        loadBitReversed(ref, refLength, refRe, refIm);
+        complexFFT(refRe, refIm);
+        loadBitReversed(compare, compareLength, cmpRe, cmpIm);
+        complexFFT(cmpRe, cmpIm);
+
+        // ref * conj(compare), conjugated so that the forward transform
+        // does the inverse one
+        for (i = 0; i < halfLength; i ++)
+        {
+            workRe[bitReverse[i]] = refRe[i] * cmpRe[i] + refIm[i] * cmpIm[i];
+            workIm[bitReverse[i]] = refRe[i] * cmpIm[i] - refIm[i] * cmpRe[i];
+        }
+
+        complexFFT(workRe, workIm);
+
+        for (i = 0; i < numPositions; i ++)
+        {
+            result[i] = workRe[i * (stride / 2)] * scale;
+        }
+        return result;
+    }
+
+    realFFT(ref, refLength, refRe, refIm);
+    realFFT(compare, compareLength, cmpRe, cmpIm);
+
+    // correlation spectrum = ref * conj(compare), left in 'refRe/Im'
+    for (i = 0; i <= halfLength; i ++)
+    {
+        float pRe = refRe[i] * cmpRe[i] + refIm[i] * cmpIm[i];
+        float pIm = refIm[i] * cmpRe[i] - refRe[i] * cmpIm[i];
+        refRe[i] = pRe;
+        refIm[i] = pIm;
+    }
+
+    // back into the half-length complex form, conjugated again
+    for (i = 0; i < halfLength; i ++)
+    {
+        float aRe = refRe[i], aIm = refIm[i];
+        float bRe = refRe[halfLength - i], bIm = -refIm[halfLength - i];
+
+        float evenRe = 0.5f * (aRe + bRe);
+        float evenIm = 0.5f * (aIm + bIm);
+        float diffRe = 0.5f * (aRe - bRe);
+        float diffIm = 0.5f * (aIm - bIm);
+
+        // odd = diff * exp(+2 pi i k / fftLength)
+        float wRe = splitTwiddles[i];
+        float wIm = -splitTwiddles[halfLength + i];
+        float oddRe = diffRe * wRe - diffIm * wIm;
+        float oddIm = diffRe * wIm + diffIm * wRe;
+
+        // even + i * odd, conjugated
+        workRe[bitReverse[i]] = evenRe - oddIm;
+        workIm[bitReverse[i]] = -(evenIm + oddRe);
+    }
+
+    complexFFT(workRe, workIm);
+
+    // unpack even & odd samples from the real & imaginary parts, taking the
+    // conjugate back and the 1 / halfLength of the inverse transform
+    for (i = 0; i < numPositions; i ++)
+    {
+        int pos = i * stride;
+        result[i] = (pos & 1) ? -workIm[pos >> 1] * scale : workRe[pos >> 1] * scale;
+    }
+
+    return result;
+}
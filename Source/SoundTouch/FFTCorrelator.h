@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Cross-correlation of a short sample sequence against every position of a
+/// longer one at once, using a real-input FFT. TDStretch uses this for the
+/// full overlap position search when it's quicker than correlating each
+/// candidate position in turn.
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FFTCorrelator_H
+#define FFTCorrelator_H
+
+namespace soundtouch
+{
+
+class FFTCorrelator
+{
+protected:
+    int numPositions;
+    int compareLength;
+    int stride;
+
+    /// Transform length (a power of two, at least the length of the reference
+    /// sequence) and the length of the complex transform that computes it
+    int fftLength;
+    int halfLength;
+
+    int *bitReverse;
+    float *stageTwiddles;       ///< Complex FFT twiddles, each stage's run after the other
+    float *splitTwiddles;       ///< exp(-2 pi i k / fftLength), k < halfLength
+
+    float *workRe, *workIm;     ///< Complex transform in place
+    float *refRe, *refIm;       ///< Spectra of the two sequences, halfLength + 1 bins each
+    float *cmpRe, *cmpIm;
+    float *result;
+
+    void freeBuffers();
+
+    /// Transforms 'halfLength' complex values in place, taken in bit-reversed order
+    void complexFFT(float *re, float *im) const;
+
+    /// Packs the 'length' samples of 'data' as complex pairs, zero padded, in
+    /// bit-reversed order for complexFFT
+    void loadBitReversed(const float *data, int length, float *re, float *im) const;
+
+    /// Spectrum of the 'length' samples of 'data', zero padded, into 'outRe/Im'
+    void realFFT(const float *data, int length, float *outRe, float *outIm);
+
+public:
+    FFTCorrelator();
+    ~FFTCorrelator();
+
+    /// Prepares for correlating 'compareLength' samples at 'numPositions'
+    /// positions 'stride' samples apart. Allocates only if that changes the
+    /// transform length, which goes up in powers of two. Returns false if the
+    /// lengths were already these.
+    bool setLengths(int numPositions, int compareLength, int stride);
+
+    /// Length of the transform chosen by setLengths, 0 before it's been called
+    int getFFTLength() const
+    {
+        return fftLength;
+    }
+
+    /// Returns result[i] = sum over k < compareLength of ref[i * stride + k] * compare[k],
+    /// for i < numPositions. 'ref' must hold (numPositions - 1) * stride + compareLength
+    /// samples. The returned buffer is valid until the next call.
+    const float *correlate(const float *ref, const float *compare);
+};
+
+}
+
+#endif // FFTCorrelator_H
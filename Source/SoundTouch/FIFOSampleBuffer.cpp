@@ -9,6 +9,13 @@
 /// outputted samples from the buffer, as well as grows the buffer size 
 /// whenever necessary.
 ///
+/// The samples are kept in a ring, and the buffer is twice the ring size so
+/// that the samples can be read and written contiguously from any position
+/// in the ring. On Linux the second half maps the same memory as the first
+/// so nothing ever needs moving; elsewhere the live samples are copied back
+/// down into the first half whenever the read position passes its end,
+/// which happens once per ring size of output rather than on every write.
+///
 /// Author        : Copyright (c) Olli Parviainen
 /// Author e-mail : oparviai 'at' iki.fi
 /// SoundTouch WWW: http://www.surina.net/soundtouch
@@ -41,10 +48,102 @@
 #include <string.h>
 #include <assert.h>
 
+// Define SOUNDTOUCH_NO_MIRRORED_RING to try the copy-on-wrap fallback on Linux
+#if defined(__linux__) && !defined(__ANDROID__) && !defined(SOUNDTOUCH_NO_MIRRORED_RING)
+    #define SOUNDTOUCH_MIRRORED_RING
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
 #include "FIFOSampleBuffer.h"
 
+#ifdef SOUNDTOUCH_COUNT_BUFFER_OPS
+    // Hooks for the benchmarks in Tools/SoundTouchBench, which define these to
+    // count the samples copied in and out, the samples moved within the
+    // buffers and the allocations
+    void soundtouchCountCopy(unsigned long bytes);
+    void soundtouchCountMove(unsigned long bytes);
+    void soundtouchCountAlloc();
+    #define COUNT_COPY(bytes)   soundtouchCountCopy(bytes)
+    #define COUNT_MOVE(bytes)   soundtouchCountMove(bytes)
+    #define COUNT_ALLOC()       soundtouchCountAlloc()
+#else
+    #define COUNT_COPY(bytes)
+    #define COUNT_MOVE(bytes)
+    #define COUNT_ALLOC()
+#endif
+
 using namespace soundtouch;
 
+
+// Granularity of the ring size, which has to be whole pages to be mirrored
+static uint ringGranularity()
+{
+#ifdef SOUNDTOUCH_MIRRORED_RING
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pageSize > 0) return (uint)pageSize;
+#endif
+    return 4096;
+}
+
+
+// Maps 'bytes' bytes of memory twice in a row. Returns NULL if that isn't
+// possible here, in which case the caller falls back to plain memory.
+static SAMPLETYPE *mapMirrored(uint bytes)
+{
+#ifdef SOUNDTOUCH_MIRRORED_RING
+    const int flags = MAP_SHARED | MAP_FIXED | MAP_POPULATE;
+    char *base;
+    int fd;
+
+    fd = memfd_create("FIFOSampleBuffer", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, bytes) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // reserve address space for both copies, then map the memory over each
+    // half. Populating the pages here keeps page faults out of the audio path.
+    base = (char *)mmap(NULL, 2 * (size_t)bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED)
+    {
+        if (mmap(base, bytes, PROT_READ | PROT_WRITE, flags, fd, 0) == MAP_FAILED ||
+            mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, flags, fd, 0) == MAP_FAILED)
+        {
+            munmap(base, 2 * (size_t)bytes);
+            base = (char *)MAP_FAILED;
+        }
+    }
+    close(fd);      // the mappings keep the memory alive
+
+    return (base == MAP_FAILED) ? NULL : (SAMPLETYPE *)base;
+#else
+    (void)bytes;
+    return NULL;
+#endif
+}
+
+
+// Releases ring memory allocated by 'allocateRing'
+static void releaseRing(SAMPLETYPE *buffer, SAMPLETYPE *bufferUnaligned, uint sizeInBytes, bool mirrored)
+{
+#ifdef SOUNDTOUCH_MIRRORED_RING
+    if (mirrored)
+    {
+        munmap(buffer, 2 * (size_t)sizeInBytes);
+        return;
+    }
+#else
+    (void)buffer;
+    (void)sizeInBytes;
+    (void)mirrored;
+#endif
+    delete[] bufferUnaligned;
+}
+
+
 // Constructor
 FIFOSampleBuffer::FIFOSampleBuffer(int numChannels)
 {
@@ -52,6 +151,7 @@ FIFOSampleBuffer::FIFOSampleBuffer(int numChannels)
     sizeInBytes = 0; // reasonable initial value
     buffer = NULL;
     bufferUnaligned = NULL;
+    mirrored = false;
     samplesInBuffer = 0;
     bufferPos = 0;
     channels = (uint)numChannels;
@@ -62,7 +162,7 @@ FIFOSampleBuffer::FIFOSampleBuffer(int numChannels)
 // destructor
 FIFOSampleBuffer::~FIFOSampleBuffer()
 {
-    delete[] bufferUnaligned;
+    releaseRing(buffer, bufferUnaligned, sizeInBytes, mirrored);
     bufferUnaligned = NULL;
     buffer = NULL;
 }
@@ -81,16 +181,22 @@ void FIFOSampleBuffer::setChannels(int numChannels)
 }
 
 
-// if output location pointer 'bufferPos' isn't zero, 'rewinds' the buffer and
-// zeroes this pointer by copying samples from the 'bufferPos' pointer 
-// location on to the beginning of the buffer.
-void FIFOSampleBuffer::rewind()
+// Once the read position 'bufferPos' has gone past the end of the ring, moves
+// it back by the ring size. If the ring is mirrored the samples are already
+// there; otherwise they're copied down from the second half of the buffer.
+// The buffered samples never exceed the ring size, so the copy can't overlap.
+void FIFOSampleBuffer::wrap()
 {
-    if (buffer && bufferPos) 
+    uint ringSize = sizeInBytes / sizeof(SAMPLETYPE);
+
+    if (bufferPos < ringSize) return;
+
+    if (!mirrored && samplesInBuffer)
     {
-        memmove(buffer, ptrBegin(), sizeof(SAMPLETYPE) * channels * samplesInBuffer);
-        bufferPos = 0;
+        memcpy(buffer + bufferPos - ringSize, buffer + bufferPos, sizeof(SAMPLETYPE) * channels * samplesInBuffer);
+        COUNT_MOVE(sizeof(SAMPLETYPE) * channels * samplesInBuffer);
     }
+    bufferPos -= ringSize;
 }
 
 
@@ -99,6 +205,7 @@ void FIFOSampleBuffer::rewind()
 void FIFOSampleBuffer::putSamples(const SAMPLETYPE *samples, uint nSamples)
 {
     memcpy(ptrEnd(nSamples), samples, sizeof(SAMPLETYPE) * nSamples * channels);
+    COUNT_COPY(sizeof(SAMPLETYPE) * nSamples * channels);
     samplesInBuffer += nSamples;
 }
 
@@ -134,7 +241,7 @@ void FIFOSampleBuffer::putSamples(uint nSamples)
 SAMPLETYPE *FIFOSampleBuffer::ptrEnd(uint slackCapacity) 
 {
     ensureCapacity(samplesInBuffer + slackCapacity);
-    return buffer + samplesInBuffer * channels;
+    return buffer + bufferPos + samplesInBuffer * channels;
 }
 
 
@@ -148,44 +255,71 @@ SAMPLETYPE *FIFOSampleBuffer::ptrEnd(uint slackCapacity)
 SAMPLETYPE *FIFOSampleBuffer::ptrBegin()
 {
     assert(buffer);
-    return buffer + bufferPos * channels;
+    return buffer + bufferPos;
 }
 
 
-// Ensures that the buffer has enough capacity, i.e. space for _at least_
-// 'capacityRequirement' number of samples. The buffer is grown in steps of
-// 4 kilobytes to eliminate the need for frequently growing up the buffer,
-// as well as to round the buffer size up to the virtual memory page size.
-void FIFOSampleBuffer::ensureCapacity(uint capacityRequirement)
+// Allocates a ring of 'bytes' bytes followed by its mirror image, or by a
+// second ring's worth of plain memory if the memory can't be mirrored.
+void FIFOSampleBuffer::allocateRing(uint bytes)
 {
-    SAMPLETYPE *tempUnaligned, *temp;
+    SAMPLETYPE *temp;
 
-    if (capacityRequirement > getCapacity()) 
+    COUNT_ALLOC();
+    temp = mapMirrored(bytes);
+    if (temp)
     {
-        // enlarge the buffer in 4kbyte steps (round up to next 4k boundary)
-        sizeInBytes = (capacityRequirement * channels * sizeof(SAMPLETYPE) + 4095) & (uint)-4096;
-        assert(sizeInBytes % 2 == 0);
-        tempUnaligned = new SAMPLETYPE[sizeInBytes / sizeof(SAMPLETYPE) + 16 / sizeof(SAMPLETYPE)];
-        if (tempUnaligned == NULL)
+        buffer = temp;
+        bufferUnaligned = NULL;
+        mirrored = true;
+    }
+    else
+    {
+        bufferUnaligned = new SAMPLETYPE[2 * bytes / sizeof(SAMPLETYPE) + 16 / sizeof(SAMPLETYPE)];
+        if (bufferUnaligned == NULL)
         {
             ST_THROW_RT_ERROR("Couldn't allocate memory!\n");
         }
         // Align the buffer to begin at 16byte cache line boundary for optimal performance
-        temp = (SAMPLETYPE *)SOUNDTOUCH_ALIGN_POINTER_16(tempUnaligned);
-        if (samplesInBuffer)
-        {
-            memcpy(temp, ptrBegin(), samplesInBuffer * channels * sizeof(SAMPLETYPE));
-        }
-        delete[] bufferUnaligned;
-        buffer = temp;
-        bufferUnaligned = tempUnaligned;
-        bufferPos = 0;
-    } 
-    else 
+        buffer = (SAMPLETYPE *)SOUNDTOUCH_ALIGN_POINTER_16(bufferUnaligned);
+        mirrored = false;
+    }
+    sizeInBytes = bytes;
+}
+
+
+// Ensures that the buffer has enough capacity, i.e. space for _at least_
+// 'capacityRequirement' number of samples. The ring size is rounded up to
+// whole virtual memory pages, and at least doubles each time it grows so
+// that the buffer soon settles at a size that needs no further allocation.
+void FIFOSampleBuffer::ensureCapacity(uint capacityRequirement)
+{
+    SAMPLETYPE *oldBuffer, *oldUnaligned;
+    uint oldSizeInBytes, newSizeInBytes, granularity;
+    bool oldMirrored;
+
+    if (capacityRequirement <= getCapacity()) return;
+
+    granularity = ringGranularity();
+    newSizeInBytes = (capacityRequirement * channels * sizeof(SAMPLETYPE) + granularity - 1) / granularity * granularity;
+    if (newSizeInBytes < 2 * sizeInBytes)
+    {
+        newSizeInBytes = 2 * sizeInBytes;
+    }
+
+    oldBuffer = buffer;
+    oldUnaligned = bufferUnaligned;
+    oldSizeInBytes = sizeInBytes;
+    oldMirrored = mirrored;
+
+    allocateRing(newSizeInBytes);
+    if (samplesInBuffer)
     {
-        // simply rewind the buffer (if necessary)
-        rewind();
+        memcpy(buffer, oldBuffer + bufferPos, samplesInBuffer * channels * sizeof(SAMPLETYPE));
+        COUNT_MOVE(samplesInBuffer * channels * sizeof(SAMPLETYPE));
     }
+    releaseRing(oldBuffer, oldUnaligned, oldSizeInBytes, oldMirrored);
+    bufferPos = 0;
 }
 
 
@@ -215,6 +349,7 @@ uint FIFOSampleBuffer::receiveSamples(SAMPLETYPE *output, uint maxSamples)
     num = (maxSamples > samplesInBuffer) ? samplesInBuffer : maxSamples;
 
     memcpy(output, ptrBegin(), channels * sizeof(SAMPLETYPE) * num);
+    COUNT_COPY(channels * sizeof(SAMPLETYPE) * num);
     return receiveSamples(num);
 }
 
@@ -234,7 +369,8 @@ uint FIFOSampleBuffer::receiveSamples(uint maxSamples)
     }
 
     samplesInBuffer -= maxSamples;
-    bufferPos += maxSamples;
+    bufferPos += maxSamples * channels;
+    wrap();
 
     return maxSamples;
 }
@@ -9,6 +9,12 @@
 /// output samples from the buffer as well as grows the storage size 
 /// whenever necessary.
 ///
+/// The storage is a ring whose memory is mapped twice in a row where the
+/// platform allows (Linux), so that the samples stay contiguous across the
+/// wrap point without being moved. Elsewhere the ring is followed by a
+/// second ring's worth of plain memory and the live samples are copied back
+/// down whenever reading has passed the end of the first.
+///
 /// Author        : Copyright (c) Olli Parviainen
 /// Author e-mail : oparviai 'at' iki.fi
 /// SoundTouch WWW: http://www.surina.net/soundtouch
@@ -45,37 +51,45 @@ namespace soundtouch
 {
 
 /// Sample buffer working in FIFO (first-in-first-out) principle. The class takes
-/// care of storage size adjustment and data moving during input/output operations.
+/// care of storage size adjustment during input/output operations. Data is only
+/// moved when the storage has to grow, or at the wrap point if the memory
+/// couldn't be mirrored.
 ///
 /// Notice that in case of stereo audio, one sample is considered to consist of 
 /// both channel data.
 class FIFOSampleBuffer : public FIFOSamplePipe
 {
 private:
-    /// Sample buffer.
+    /// Sample buffer, two ring sizes long.
     SAMPLETYPE *buffer;
 
-    // Raw unaligned buffer memory. 'buffer' is made aligned by pointing it to first
-    // 16-byte aligned location of this buffer
+    // Raw unaligned buffer memory when the ring isn't mirrored. 'buffer' is made
+    // aligned by pointing it to first 16-byte aligned location of this buffer
     SAMPLETYPE *bufferUnaligned;
 
-    /// Sample buffer size in bytes
+    /// Ring size in bytes
     uint sizeInBytes;
 
+    /// True if the second half of 'buffer' maps the same memory as the first
+    bool mirrored;
+
     /// How many samples are currently in buffer.
     uint samplesInBuffer;
 
     /// Channels, 1=mono, 2=stereo.
     uint channels;
 
-    /// Current position pointer to the buffer. This pointer is increased when samples are 
-    /// removed from the pipe so that it's necessary to actually rewind buffer (move data)
-    /// only new data when is put to the pipe.
+    /// Read position in the buffer, in single sample values (not frames). This is
+    /// increased when samples are removed from the pipe and kept within the first
+    /// ring size by 'wrap'.
     uint bufferPos;
 
-    /// Rewind the buffer by moving data from position pointed by 'bufferPos' to real 
-    /// beginning of the buffer.
-    void rewind();
+    /// Once the read position has passed the end of the ring, moves it back by the
+    /// ring size, copying the samples down first if the ring isn't mirrored.
+    void wrap();
+
+    /// Allocates a ring of 'bytes' bytes, mirrored if possible.
+    void allocateRing(uint bytes);
 
     /// Ensures that the buffer has capacity for at least this many samples.
     void ensureCapacity(uint capacityRequirement);
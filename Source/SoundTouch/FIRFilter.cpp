@@ -313,6 +313,20 @@ FIRFilter * FIRFilter::newInstance()
     else
 #endif // SOUNDTOUCH_ALLOW_MMX
 
+#ifdef SOUNDTOUCH_ALLOW_AVX
+    if (uExtensions & SUPPORT_AVX512F)
+    {
+        // AVX-512 support
+        return ::new FIRFilterAVX512;
+    }
+    else if ((uExtensions & (SUPPORT_AVX2 | SUPPORT_FMA)) == (SUPPORT_AVX2 | SUPPORT_FMA))
+    {
+        // AVX2 + FMA support
+        return ::new FIRFilterAVX;
+    }
+    else
+#endif // SOUNDTOUCH_ALLOW_AVX
+
 #ifdef SOUNDTOUCH_ALLOW_SSE
     if (uExtensions & SUPPORT_SSE)
     {
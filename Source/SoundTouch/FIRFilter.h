@@ -135,6 +135,25 @@ public:
 
 #endif // SOUNDTOUCH_ALLOW_SSE
 
+
+#ifdef SOUNDTOUCH_ALLOW_AVX
+    /// Class that implements AVX2 + FMA optimized functions exclusive for floating point samples type.
+    /// Uses the same coefficient layout as the SSE version.
+    class FIRFilterAVX : public FIRFilterSSE
+    {
+    protected:
+        virtual uint evaluateFilterStereo(float *dest, const float *src, uint numSamples) const override;
+    };
+
+    /// Class that implements AVX-512 optimized functions exclusive for floating point samples type.
+    class FIRFilterAVX512 : public FIRFilterSSE
+    {
+    protected:
+        virtual uint evaluateFilterStereo(float *dest, const float *src, uint numSamples) const override;
+    };
+
+#endif // SOUNDTOUCH_ALLOW_AVX
+
 }
 
 #endif  // FIRFilter_H
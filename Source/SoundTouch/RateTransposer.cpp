@@ -58,6 +58,8 @@ RateTransposer::RateTransposer() : FIFOProcessor(&outputBuffer)
         false;
 #endif
 
+    pOutputTarget = &outputBuffer;
+
     // Instantiates the anti-alias filter
     pAAFilter = new AAFilter(64);
     pTransposer = TransposerBase::newInstance();
@@ -131,18 +133,25 @@ void RateTransposer::putSamples(const SAMPLETYPE *samples, uint nSamples)
 // the 'set_returnBuffer_size' function.
 void RateTransposer::processSamples(const SAMPLETYPE *src, uint nSamples)
 {
-    uint count;
-
     if (nSamples == 0) return;
 
     // Store samples to input buffer
     inputBuffer.putSamples(src, nSamples);
 
+    processInput();
+}
+
+
+// Transposes the samples in the input buffer into 'pOutputTarget'
+void RateTransposer::processInput()
+{
+    FIFOSampleBuffer &dest = *pOutputTarget;
+
     // If anti-alias filter is turned off, simply transpose without applying
     // the filter
     if (bUseAAFilter == false) 
     {
-        count = pTransposer->transpose(outputBuffer, inputBuffer);
+        pTransposer->transpose(dest, inputBuffer);
         return;
     }
 
@@ -158,7 +167,7 @@ void RateTransposer::processSamples(const SAMPLETYPE *src, uint nSamples)
         pTransposer->transpose(midBuffer, inputBuffer);
 
         // Apply the anti-alias filter for transposed samples in midBuffer
-        pAAFilter->evaluate(outputBuffer, midBuffer);
+        pAAFilter->evaluate(dest, midBuffer);
     } 
     else  
     {
@@ -170,11 +179,18 @@ void RateTransposer::processSamples(const SAMPLETYPE *src, uint nSamples)
         pAAFilter->evaluate(midBuffer, inputBuffer);
 
         // Transpose the AA-filtered samples in "midBuffer"
-        pTransposer->transpose(outputBuffer, midBuffer);
+        pTransposer->transpose(dest, midBuffer);
     }
 }
 
 
+// Writes the output straight into 'target' instead of 'outputBuffer'
+void RateTransposer::setOutputTarget(FIFOSampleBuffer *target)
+{
+    pOutputTarget = target ? target : &outputBuffer;
+}
+
+
 // Sets the number of channels, 1 = mono, 2 = stereo
 void RateTransposer::setChannels(int nChannels)
 {
@@ -112,6 +112,10 @@ protected:
     /// Output sample buffer
     FIFOSampleBuffer outputBuffer;
 
+    /// Buffer the transposed samples are written to: 'outputBuffer', or the
+    /// next stage's input buffer when the stages are fused
+    FIFOSampleBuffer *pOutputTarget;
+
     bool bUseAAFilter;
 
 
@@ -129,6 +133,18 @@ public:
     /// Returns the output buffer object
     FIFOSamplePipe *getOutput() { return &outputBuffer; };
 
+    /// Returns the input buffer object
+    FIFOSampleBuffer *getInput() { return &inputBuffer; };
+
+    /// Writes the transposed samples straight into 'target', normally the input
+    /// buffer of the next processing stage, instead of this object's own output
+    /// buffer. NULL goes back to the output buffer.
+    void setOutputTarget(FIFOSampleBuffer *target);
+
+    /// Transposes the samples that the previous stage has written directly into
+    /// the input buffer.
+    void processInput();
+
     /// Return anti-alias filter object
     AAFilter *getAAFilter();
 
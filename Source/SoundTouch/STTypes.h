@@ -156,6 +156,13 @@ namespace soundtouch
         #ifdef SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS
             // Allow SSE optimizations
             #define SOUNDTOUCH_ALLOW_SSE       1
+
+            // Allow AVX2/FMA and AVX-512 optimizations in 64bit builds. These are compiled
+            // for their own ISA function by function and picked at runtime, so the rest of
+            // the library still runs on any x86-64 CPU.
+            #if (__x86_64__ || _M_X64) && (defined(__GNUC__) || defined(_MSC_VER))
+                #define SOUNDTOUCH_ALLOW_AVX   1
+            #endif
         #endif
 
     #endif  // SOUNDTOUCH_INTEGER_SAMPLES
@@ -95,6 +95,7 @@ SoundTouch::SoundTouch()
 
     setOutPipe(pTDStretch);
 
+    bFuseStages = true;
     rate = tempo = 0;
 
     virtualPitch = 
@@ -226,6 +227,9 @@ void SoundTouch::calcEffectiveRateAndTempo()
     if (!TEST_FLOAT_EQUAL(rate,oldRate)) pRateTransposer->setRate(rate);
     if (!TEST_FLOAT_EQUAL(tempo, oldTempo)) pTDStretch->setTempo(tempo);
 
+    // reconnect before any samples get moved between the stages below
+    connectStages();
+
 #ifndef SOUNDTOUCH_PREVENT_CLICK_AT_RATE_CROSSOVER
     if (rate <= 1.0f) 
     {
@@ -295,7 +299,15 @@ void SoundTouch::putSamples(const SAMPLETYPE *samples, uint nSamples)
         // transpose the rate down, output the transposed sound to tempo changer buffer
         assert(output == pTDStretch);
         pRateTransposer->putSamples(samples, nSamples);
-        pTDStretch->moveSamples(*pRateTransposer);
+        if (bFuseStages)
+        {
+            // the transposed samples are in the tempo changer's input already
+            pTDStretch->processInput();
+        }
+        else
+        {
+            pTDStretch->moveSamples(*pRateTransposer);
+        }
     } 
     else 
 #endif
@@ -303,7 +315,40 @@ void SoundTouch::putSamples(const SAMPLETYPE *samples, uint nSamples)
         // evaluate the tempo changer, then transpose the rate up, 
         assert(output == pRateTransposer);
         pTDStretch->putSamples(samples, nSamples);
-        pRateTransposer->moveSamples(*pTDStretch);
+        if (bFuseStages)
+        {
+            pRateTransposer->processInput();
+        }
+        else
+        {
+            pRateTransposer->moveSamples(*pTDStretch);
+        }
+    }
+}
+
+
+// Connects the first processing stage straight to the input buffer of the
+// second one when fused. The stage order follows the rate as in 'putSamples'.
+void SoundTouch::connectStages()
+{
+    if (bFuseStages == false)
+    {
+        pRateTransposer->setOutputTarget(NULL);
+        pTDStretch->setOutputTarget(NULL);
+        return;
+    }
+
+#ifndef SOUNDTOUCH_PREVENT_CLICK_AT_RATE_CROSSOVER
+    if (rate <= 1.0f)
+    {
+        pRateTransposer->setOutputTarget(pTDStretch->getInput());
+        pTDStretch->setOutputTarget(NULL);
+    }
+    else
+#endif
+    {
+        pTDStretch->setOutputTarget(pRateTransposer->getInput());
+        pRateTransposer->setOutputTarget(NULL);
     }
 }
 
@@ -372,6 +417,17 @@ bool SoundTouch::setSetting(int settingId, int value)
             pTDStretch->enableQuickSeek((value != 0) ? true : false);
             return true;
 
+        case SETTING_USE_HIERARCHICALSEEK :
+            // enables / disables tempo routine hierarchical seeking algorithm
+            pTDStretch->enableHierarchicalSeek((value != 0) ? true : false);
+            return true;
+
+        case SETTING_USE_STAGE_FUSION :
+            // enables / disables writing straight into the next stage's input
+            bFuseStages = (value != 0) ? true : false;
+            connectStages();
+            return true;
+
         case SETTING_SEQUENCE_MS:
             // change time-stretch sequence duration parameter
             pTDStretch->setParameters(sampleRate, value, seekWindowMs, overlapMs);
@@ -412,6 +468,12 @@ int SoundTouch::getSetting(int settingId) const
         case SETTING_USE_QUICKSEEK :
             return (uint)pTDStretch->isQuickSeekEnabled();
 
+        case SETTING_USE_HIERARCHICALSEEK :
+            return (uint)pTDStretch->isHierarchicalSeekEnabled();
+
+        case SETTING_USE_STAGE_FUSION :
+            return (uint)bFuseStages;
+
         case SETTING_SEQUENCE_MS:
             pTDStretch->getParameters(NULL, &temp, NULL, NULL);
             return temp;
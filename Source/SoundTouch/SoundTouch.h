@@ -164,6 +164,18 @@ namespace soundtouch
 ///   tempo/pitch/rate/samplerate settings.
 #define SETTING_INITIAL_LATENCY             8
 
+/// Enable/disable hierarchical seeking algorithm in tempo changer routine.
+/// Searches a decimated mono downmix first and refines the best candidates
+/// at full rate: cheaper than quick seek and closer to the full search.
+/// SETTING_USE_QUICKSEEK takes precedence if both are enabled.
+#define SETTING_USE_HIERARCHICALSEEK        9
+
+/// Enable/disable stage fusion. When enabled (default), the rate transposer and
+/// the tempo changer write their output straight into the next stage's input
+/// buffer instead of having it copied over from their own output buffers.
+/// The processed sound is the same either way.
+#define SETTING_USE_STAGE_FUSION            10
+
 
 class SoundTouch : public FIFOProcessor
 {
@@ -186,6 +198,9 @@ private:
     /// Flag: Has sample rate been set?
     bool  bSrateSet;
 
+    /// Flag: Do the processing stages write straight into the next stage's input?
+    bool  bFuseStages;
+
     /// Accumulator for how many samples in total will be expected as output vs. samples put in,
     /// considering current processing settings.
     double samplesExpectedOut;
@@ -197,6 +212,11 @@ private:
     /// 'virtualPitch' parameters.
     void calcEffectiveRateAndTempo();
 
+    /// Points the output of the first processing stage at the input buffer of
+    /// the second one if the stages are fused, and the rest at their own output
+    /// buffers.
+    void connectStages();
+
 protected :
     /// Number of channels
     uint  channels;
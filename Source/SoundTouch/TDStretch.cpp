@@ -54,6 +54,12 @@ using namespace soundtouch;
 
 #define max(x, y) (((x) > (y)) ? (x) : (y))
 
+// Cost of the FFT search per N * log2(N) of its transform length, in the units
+// of getCrossCorrCost. The split-radix real transform is slower when the stride
+// is odd, as with mono, since the positions then don't line up with its pairs.
+#define FFT_SEEK_COST_EVEN_STRIDE   1.0
+#define FFT_SEEK_COST_ODD_STRIDE    1.6
+
 /*****************************************************************************
  *
  * Constant definitions
@@ -83,12 +89,18 @@ const short _scanOffsets[5][24]={
 TDStretch::TDStretch() : FIFOProcessor(&outputBuffer)
 {
     bQuickSeek = false;
+    bHierarchicalSeek = false;
     channels = 2;
 
     pMidBuffer = NULL;
     pMidBufferUnaligned = NULL;
     overlapLength = 0;
 
+    pDecimated = NULL;
+    decimatedCapacity = 0;
+
+    pOutputTarget = &outputBuffer;
+
     bAutoSeqSetting = true;
     bAutoSeekSetting = true;
 
@@ -104,6 +116,7 @@ TDStretch::TDStretch() : FIFOProcessor(&outputBuffer)
 TDStretch::~TDStretch()
 {
     delete[] pMidBufferUnaligned;
+    delete[] pDecimated;
 }
 
 
@@ -248,6 +261,20 @@ bool TDStretch::isQuickSeekEnabled() const
 }
 
 
+// Enables/disables the hierarchical position seeking algorithm
+void TDStretch::enableHierarchicalSeek(bool enable)
+{
+    bHierarchicalSeek = enable;
+}
+
+
+// Returns nonzero if the hierarchical seeking algorithm is enabled.
+bool TDStretch::isHierarchicalSeekEnabled() const
+{
+    return bHierarchicalSeek;
+}
+
+
 // Seeks for the optimal overlap-mixing position.
 int TDStretch::seekBestOverlapPosition(const SAMPLETYPE *refPos)
 {
@@ -255,6 +282,16 @@ int TDStretch::seekBestOverlapPosition(const SAMPLETYPE *refPos)
     {
         return seekBestOverlapPositionQuick(refPos);
     }
+    else if (bHierarchicalSeek)
+    {
+        return seekBestOverlapPositionHierarchical(refPos);
+    }
+#ifdef SOUNDTOUCH_FLOAT_SAMPLES
+    else if (isFFTSeekCheaper())
+    {
+        return seekBestOverlapPositionFFT(refPos);
+    }
+#endif
     else 
     {
         return seekBestOverlapPositionFull(refPos);
@@ -353,6 +390,268 @@ int TDStretch::seekBestOverlapPositionFull(const SAMPLETYPE *refPos)
 }
 
 
+#ifdef SOUNDTOUCH_FLOAT_SAMPLES
+
+// Same search as 'seekBestOverlapPositionFull', with the cross-correlations
+// for all positions calculated at once by FFT. Normalization and the
+// heuristic weighting are the same, so it finds the same position except
+// between candidates that are equal to within float rounding.
+int TDStretch::seekBestOverlapPositionFFT(const SAMPLETYPE *refPos)
+{
+    const float *corrs;
+    int bestOffs;
+    double bestCorr, corr;
+    double norm;
+    int i, j;
+    int ilength = channels * overlapLength;
+
+    corrs = fftCorrelator.correlate(refPos, pMidBuffer);
+
+    norm = 0;
+    for (i = 0; i < ilength; i ++)
+    {
+        norm += refPos[i] * refPos[i];
+    }
+
+    bestCorr = corrs[0] / sqrt((norm < 1e-9 ? 1.0 : norm));
+    bestCorr = (bestCorr + 0.1) * 0.75;
+    bestOffs = 0;
+
+    for (i = 1; i < seekLength; i ++)
+    {
+        const float *mixingPos = refPos + channels * i;
+
+        // slide the normalizer along as 'calcCrossCorrAccumulate' does
+        for (j = 1; j <= channels; j ++)
+        {
+            norm -= mixingPos[-j] * mixingPos[-j];
+            norm += mixingPos[ilength - j] * mixingPos[ilength - j];
+        }
+
+        corr = corrs[i] / sqrt((norm < 1e-9 ? 1.0 : norm));
+
+        // heuristic rule to slightly favour values close to mid of the range
+        double tmp = (double)(2 * i - seekLength) / (double)seekLength;
+        corr = ((corr + 0.1) * (1.0 - 0.25 * tmp * tmp));
+
+        if (corr > bestCorr)
+        {
+            bestCorr = corr;
+            bestOffs = i;
+        }
+    }
+
+    return bestOffs;
+}
+
+
+// Cost of one multiply-add of the cross-correlation routine, relative to the
+// FFT search. Measured on x86-64; the SIMD versions override this.
+double TDStretch::getCrossCorrCost() const
+{
+    return 1.06;
+}
+
+
+// Estimates whether the FFT full search is cheaper than the direct one for the
+// current lengths: the direct search does seekLength * overlapLength * channels
+// multiply-adds, the FFT search costs in proportion to N * log2(N).
+bool TDStretch::isFFTSeekCheaper() const
+{
+    double fftCost, directCost;
+    int fftLength = fftCorrelator.getFFTLength();
+
+    if (fftLength == 0) return false;
+
+    fftCost = fftLength * log2((double)fftLength) *
+              ((channels & 1) ? FFT_SEEK_COST_ODD_STRIDE : FFT_SEEK_COST_EVEN_STRIDE);
+    directCost = (double)seekLength * overlapLength * channels * getCrossCorrCost();
+
+    return fftCost < directCost;
+}
+
+#endif // SOUNDTOUCH_FLOAT_SAMPLES
+
+
+// Dot product of two float vectors, summed in eight independent parts so
+// that the compiler can vectorize it without reassociating anything.
+static float decimatedDot(const float *a, const float *b, int length)
+{
+    float sums[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    float sum;
+    int i, j;
+
+    for (i = 0; i + 8 <= length; i += 8)
+    {
+        for (j = 0; j < 8; j ++)
+        {
+            sums[j] += a[i + j] * b[i + j];
+        }
+    }
+    sum = ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+    for (; i < length; i ++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+
+// Same normalization and weighting towards the middle as the full search,
+// for offset 'offs' of the full rate search range
+static double weightedCorr(double corr, double norm, int offs, int seekLength)
+{
+    corr /= sqrt((norm < 1e-9 ? 1.0 : norm));
+
+    double tmp = (double)(2 * offs - seekLength) / (double)seekLength;
+    return (corr + 0.1) * (1.0 - 0.25 * tmp * tmp);
+}
+
+
+// Hierarchical seek algorithm: finds candidate positions on a mono downmix
+// decimated by 4, refines the best few of them at decimation 2 and then at
+// full rate. Each stage only looks +-HIER_REFINE positions around the previous
+// stage's pick, so most of the work is the coarse scan, which costs 1/16 of
+// the full search for mono and 1/32 for stereo.
+//
+// Decimation is a plain sum of adjacent frames; it only has to keep enough
+// of the signal for the peaks of the correlation to stay roughly in place.
+// Scanning the best HIER_CANDIDATES local peaks rather than just the top one
+// covers those that decimation shifts about.
+int TDStretch::seekBestOverlapPositionHierarchical(const SAMPLETYPE *refPos)
+{
+#define HIER_CANDIDATES 3
+#define HIER_REFINE     2
+
+    int candidates[HIER_CANDIDATES];
+    double candCorr[HIER_CANDIDATES];
+    int numFrames2, numFrames4, length2, length4, numPos4;
+    int bestOffs;
+    double bestCorr;
+    int i, j, c;
+
+    numFrames2 = (seekLength + overlapLength) / 2;
+    numFrames4 = numFrames2 / 2;
+    length2 = overlapLength / 2;
+    length4 = overlapLength / 4;
+
+    float *ref2 = pDecimated;
+    float *ref4 = ref2 + numFrames2;
+    float *mid2 = ref4 + numFrames4;
+    float *mid4 = mid2 + length2;
+
+    // mono downmixes at 1/2 and 1/4 rate
+    for (i = 0; i < numFrames2; i ++)
+    {
+        const SAMPLETYPE *src = refPos + 2 * channels * i;
+        float sum = 0;
+        for (j = 0; j < 2 * channels; j ++) sum += (float)src[j];
+        ref2[i] = sum;
+    }
+    for (i = 0; i < length2; i ++)
+    {
+        const SAMPLETYPE *src = pMidBuffer + 2 * channels * i;
+        float sum = 0;
+        for (j = 0; j < 2 * channels; j ++) sum += (float)src[j];
+        mid2[i] = sum;
+    }
+    for (i = 0; i < numFrames4; i ++) ref4[i] = ref2[2 * i] + ref2[2 * i + 1];
+    for (i = 0; i < length4; i ++) mid4[i] = mid2[2 * i] + mid2[2 * i + 1];
+
+    // coarse scan, keeping the best local peaks
+    for (c = 0; c < HIER_CANDIDATES; c ++)
+    {
+        candidates[c] = -1;
+        candCorr[c] = -FLT_MAX;
+    }
+
+    numPos4 = (seekLength - 1) / 4 + 1;
+    double norm = decimatedDot(ref4, ref4, length4);
+    double prev = -FLT_MAX;
+    double curr = weightedCorr(decimatedDot(ref4, mid4, length4), norm, 0, seekLength);
+    for (i = 0; i < numPos4; i ++)
+    {
+        double next = -FLT_MAX;
+
+        if (i + 1 < numPos4)
+        {
+            // slide the normalizer along
+            norm += ref4[i + length4] * ref4[i + length4] - ref4[i] * ref4[i];
+            next = weightedCorr(decimatedDot(ref4 + i + 1, mid4, length4), norm, 4 * (i + 1), seekLength);
+        }
+
+        if (curr >= prev && curr > next && curr > candCorr[HIER_CANDIDATES - 1])
+        {
+            // insert in order of correlation
+            for (c = HIER_CANDIDATES - 1; c > 0 && curr > candCorr[c - 1]; c --)
+            {
+                candidates[c] = candidates[c - 1];
+                candCorr[c] = candCorr[c - 1];
+            }
+            candidates[c] = 4 * i;
+            candCorr[c] = curr;
+        }
+        prev = curr;
+        curr = next;
+    }
+
+    // refine each candidate at 1/2 rate
+    for (c = 0; c < HIER_CANDIDATES && candidates[c] >= 0; c ++)
+    {
+        int center = candidates[c] / 2;
+        int best = center;
+        double bestHere = -FLT_MAX;
+
+        for (i = center - HIER_REFINE; i <= center + HIER_REFINE; i ++)
+        {
+            if (i < 0 || 2 * i >= seekLength) continue;
+
+            double corr = weightedCorr(decimatedDot(ref2 + i, mid2, length2),
+                                       decimatedDot(ref2 + i, ref2 + i, length2), 2 * i, seekLength);
+            if (corr > bestHere)
+            {
+                bestHere = corr;
+                best = i;
+            }
+        }
+        candidates[c] = 2 * best;
+    }
+
+    // and at full rate, with the same measure as the full search
+    bestCorr = -FLT_MAX;
+    bestOffs = (candidates[0] >= 0) ? candidates[0] : 0;
+
+    for (c = 0; c < HIER_CANDIDATES && candidates[c] >= 0; c ++)
+    {
+        for (i = candidates[c] - HIER_REFINE; i <= candidates[c] + HIER_REFINE; i ++)
+        {
+            double corr;
+
+            if (i < 0 || i >= seekLength) continue;
+
+            corr = calcCrossCorr(refPos + channels * i, pMidBuffer, norm);
+            double tmp = (double)(2 * i - seekLength) / (double)seekLength;
+            corr = ((corr + 0.1) * (1.0 - 0.25 * tmp * tmp));
+
+            if (corr > bestCorr)
+            {
+                bestCorr = corr;
+                bestOffs = i;
+            }
+        }
+    }
+
+    // clear cross correlation routine state if necessary (is so e.g. in MMX routines).
+    clearCrossCorrState();
+
+#ifdef SOUNDTOUCH_INTEGER_SAMPLES
+    adaptNormalizer();
+#endif
+
+    return bestOffs;
+}
+
+
 // Quick seek algorithm for improved runtime-performance: First roughly scans through the 
 // correlation area, and then scan surroundings of two best preliminary correlation candidates
 // with improved precision
@@ -556,6 +855,22 @@ void TDStretch::calcSeqParameters()
         seekWindowLength = 2 * overlapLength;
     }
     seekLength = (sampleRate * seekWindowMs) / 1000;
+
+    // room for the hierarchical search's downmixes; see seekBestOverlapPositionHierarchical
+    if (seekLength + overlapLength > decimatedCapacity)
+    {
+        delete[] pDecimated;
+        decimatedCapacity = seekLength + overlapLength;
+        pDecimated = new float[2 * decimatedCapacity];
+    }
+
+#ifdef SOUNDTOUCH_FLOAT_SAMPLES
+    // set up the FFT search for these lengths
+    if (overlapLength > 0 && seekLength > 0)
+    {
+        fftCorrelator.setLengths(seekLength, channels * overlapLength, channels);
+    }
+#endif
 }
 
 
@@ -633,9 +948,10 @@ void TDStretch::processNominalTempo()
 
 
 // Processes as many processing frames of the samples 'inputBuffer', store
-// the result into 'outputBuffer'
+// the result into 'outputBuffer' (or into 'pOutputTarget' when fused)
 void TDStretch::processSamples()
 {
+    FIFOSampleBuffer &dest = *pOutputTarget;
     int ovlSkip;
     int offset = 0;
     int temp;
@@ -664,8 +980,8 @@ void TDStretch::processSamples()
             // samples in 'midBuffer' using sliding overlapping
             // ... first partially overlap with the end of the previous sequence
             // (that's in 'midBuffer')
-            overlap(outputBuffer.ptrEnd((uint)overlapLength), inputBuffer.ptrBegin(), (uint)offset);
-            outputBuffer.putSamples((uint)overlapLength);
+            overlap(dest.ptrEnd((uint)overlapLength), inputBuffer.ptrBegin(), (uint)offset);
+            dest.putSamples((uint)overlapLength);
             offset += overlapLength;
         }
         else
@@ -703,7 +1019,7 @@ void TDStretch::processSamples()
 
         // length of sequence
         temp = (seekWindowLength - 2 * overlapLength);
-        outputBuffer.putSamples(inputBuffer.ptrBegin() + channels * offset, (uint)temp);
+        dest.putSamples(inputBuffer.ptrBegin() + channels * offset, (uint)temp);
 
         // Copies the end of the current sequence from 'inputBuffer' to 
         // 'midBuffer' for being mixed with the beginning of the next 
@@ -785,6 +1101,20 @@ TDStretch * TDStretch::newInstance()
 #endif // SOUNDTOUCH_ALLOW_MMX
 
 
+#ifdef SOUNDTOUCH_ALLOW_AVX
+    if (uExtensions & SUPPORT_AVX512F)
+    {
+        // AVX-512 support
+        return ::new TDStretchAVX512;
+    }
+    else if ((uExtensions & (SUPPORT_AVX2 | SUPPORT_FMA)) == (SUPPORT_AVX2 | SUPPORT_FMA))
+    {
+        // AVX2 + FMA support
+        return ::new TDStretchAVX;
+    }
+    else
+#endif // SOUNDTOUCH_ALLOW_AVX
+
 #ifdef SOUNDTOUCH_ALLOW_SSE
     if (uExtensions & SUPPORT_SSE)
     {
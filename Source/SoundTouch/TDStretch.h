@@ -41,6 +41,7 @@
 #include "STTypes.h"
 #include "RateTransposer.h"
 #include "FIFOSamplePipe.h"
+#include "FFTCorrelator.h"
 
 namespace soundtouch
 {
@@ -125,6 +126,7 @@ protected:
     double skipFract;
 
     bool bQuickSeek;
+    bool bHierarchicalSeek;
     bool bAutoSeqSetting;
     bool bAutoSeekSetting;
     bool isBeginning;
@@ -132,9 +134,25 @@ protected:
     SAMPLETYPE *pMidBuffer;
     SAMPLETYPE *pMidBufferUnaligned;
 
+    /// Mono downmixes of the search range and of the mid buffer at 1/2 and 1/4
+    /// of the sample rate, for the hierarchical search
+    float *pDecimated;
+    int decimatedCapacity;
+
     FIFOSampleBuffer outputBuffer;
     FIFOSampleBuffer inputBuffer;
 
+    /// Buffer the stretched samples are written to: 'outputBuffer', or the
+    /// next stage's input buffer when the stages are fused
+    FIFOSampleBuffer *pOutputTarget;
+
+#ifdef SOUNDTOUCH_FLOAT_SAMPLES
+    /// The full search can also be done by FFT, which wins with long seek windows
+    /// and slower correlation routines. Which one is used is estimated from the
+    /// lengths and the cost of the correlation routine; see isFFTSeekCheaper.
+    FFTCorrelator fftCorrelator;
+#endif
+
     void acceptNewOverlapLength(int newOverlapLength);
 
     virtual void clearCrossCorrState();
@@ -145,6 +163,12 @@ protected:
 
     virtual int seekBestOverlapPositionFull(const SAMPLETYPE *refPos);
     virtual int seekBestOverlapPositionQuick(const SAMPLETYPE *refPos);
+    int seekBestOverlapPositionHierarchical(const SAMPLETYPE *refPos);
+#ifdef SOUNDTOUCH_FLOAT_SAMPLES
+    int seekBestOverlapPositionFFT(const SAMPLETYPE *refPos);
+    virtual double getCrossCorrCost() const;
+    bool isFFTSeekCheaper() const;
+#endif
     virtual int seekBestOverlapPosition(const SAMPLETYPE *refPos);
 
     virtual void overlapStereo(SAMPLETYPE *output, const SAMPLETYPE *input) const;
@@ -180,7 +204,22 @@ public:
     FIFOSamplePipe *getOutput() { return &outputBuffer; };
 
     /// Returns the input buffer object
-    FIFOSamplePipe *getInput() { return &inputBuffer; };
+    FIFOSampleBuffer *getInput() { return &inputBuffer; };
+
+    /// Writes the stretched samples straight into 'target', normally the input
+    /// buffer of the next processing stage, instead of this object's own output
+    /// buffer. NULL goes back to the output buffer.
+    void setOutputTarget(FIFOSampleBuffer *target)
+    {
+        pOutputTarget = target ? target : &outputBuffer;
+    }
+
+    /// Processes the samples that the previous stage has written directly into
+    /// the input buffer.
+    void processInput()
+    {
+        processSamples();
+    }
 
     /// Sets new target tempo. Normal tempo = 'SCALE', smaller values represent slower 
     /// tempo, larger faster tempo.
@@ -202,6 +241,14 @@ public:
     /// Returns nonzero if the quick seeking algorithm is enabled.
     bool isQuickSeekEnabled() const;
 
+    /// Enables/disables the hierarchical position seeking algorithm, which
+    /// searches a decimated mono downmix first and then refines the best few
+    /// candidates at full rate. Quick seek takes precedence if both are enabled.
+    void enableHierarchicalSeek(bool enable);
+
+    /// Returns nonzero if the hierarchical seeking algorithm is enabled.
+    bool isHierarchicalSeekEnabled() const;
+
     /// Sets routine control parameters. These control are certain time constants
     /// defining how the sound is stretched to the desired duration.
     //
@@ -271,9 +318,32 @@ public:
     protected:
         double calcCrossCorr(const float *mixingPos, const float *compare, double &norm) override;
         double calcCrossCorrAccumulate(const float *mixingPos, const float *compare, double &norm) override;
+        double getCrossCorrCost() const override;
     };
 
 #endif /// SOUNDTOUCH_ALLOW_SSE
 
+
+#ifdef SOUNDTOUCH_ALLOW_AVX
+    /// Class that implements AVX2 + FMA optimized routines for floating point samples type.
+    class TDStretchAVX : public TDStretch
+    {
+    protected:
+        double calcCrossCorr(const float *mixingPos, const float *compare, double &norm) override;
+        double calcCrossCorrAccumulate(const float *mixingPos, const float *compare, double &norm) override;
+        double getCrossCorrCost() const override;
+    };
+
+    /// Class that implements AVX-512 optimized routines for floating point samples type.
+    class TDStretchAVX512 : public TDStretch
+    {
+    protected:
+        double calcCrossCorr(const float *mixingPos, const float *compare, double &norm) override;
+        double calcCrossCorrAccumulate(const float *mixingPos, const float *compare, double &norm) override;
+        double getCrossCorrCost() const override;
+    };
+
+#endif /// SOUNDTOUCH_ALLOW_AVX
+
 }
 #endif  /// TDStretch_H
@@ -0,0 +1,385 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// AVX2 + FMA and AVX-512 optimized routines for x86-64 CPUs that have them.
+/// As with the SSE routines, all of them have been gathered into this single
+/// source code file regardless of their class.
+///
+/// The rest of the library is built for baseline x86-64, so each function here
+/// is compiled for its own instruction set with a function target attribute
+/// (GCC & Clang; Visual C++ allows the intrinsics anywhere). None of them may
+/// be called unless detectCPUextensions() reports the matching SUPPORT_ bits;
+/// TDStretch::newInstance and FIRFilter::newInstance take care of that.
+///
+/// The wider sums are added up in a different order than the plain C
+/// routines, so results match those only within float rounding.
+///
+////////////////////////////////////////////////////////////////////////////////
+//
+// License :
+//
+//  SoundTouch audio processing library
+//  Copyright (c) Olli Parviainen
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "cpu_detect.h"
+#include "STTypes.h"
+
+using namespace soundtouch;
+
+#ifdef SOUNDTOUCH_ALLOW_AVX
+
+#include <immintrin.h>
+#include <math.h>
+
+#if defined(__GNUC__)
+    #define ST_TARGET_AVX2      __attribute__((target("avx2,fma")))
+    #define ST_TARGET_AVX512    __attribute__((target("avx512f")))
+#else
+    #define ST_TARGET_AVX2
+    #define ST_TARGET_AVX512
+#endif
+
+
+// Sum of the 8 floats in 'v'
+ST_TARGET_AVX2 static inline float horizontalSumAVX(__m256 v)
+{
+    __m128 v4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 v2 = _mm_add_ps(v4, _mm_movehl_ps(v4, v4));
+    return _mm_cvtss_f32(_mm_add_ss(v2, _mm_shuffle_ps(v2, v2, 1)));
+}
+
+
+// Halves a 16-float vector into 8 floats by adding its upper and lower halves
+ST_TARGET_AVX512 static inline __m256 foldAVX512(__m512 v)
+{
+    // _mm512_extractf32x8_ps would need AVX512DQ, the 64-bit lane version is plain AVX512F
+    __m256 hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+    return _mm256_add_ps(_mm512_castps512_ps256(v), hi);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// implementation of AVX optimized functions of class 'TDStretch'
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "TDStretch.h"
+
+// Dot product of 'count' floats, count divisible by 8. With pNorm, also the
+// sum of squares of pV1.
+ST_TARGET_AVX2 static inline float dotProductAVX(const float *pV1, const float *pV2, int count, float *pNorm)
+{
+    __m256 vSum1 = _mm256_setzero_ps();
+    __m256 vSum2 = _mm256_setzero_ps();
+    __m256 vNorm1 = _mm256_setzero_ps();
+    __m256 vNorm2 = _mm256_setzero_ps();
+    int i;
+
+    // Two independent accumulators each so consecutive FMAs don't wait on one another
+    for (i = 0; i + 16 <= count; i += 16)
+    {
+        __m256 v1 = _mm256_loadu_ps(pV1 + i);
+        __m256 v2 = _mm256_loadu_ps(pV1 + i + 8);
+        vSum1 = _mm256_fmadd_ps(v1, _mm256_loadu_ps(pV2 + i), vSum1);
+        vSum2 = _mm256_fmadd_ps(v2, _mm256_loadu_ps(pV2 + i + 8), vSum2);
+
+        if (pNorm)
+        {
+            vNorm1 = _mm256_fmadd_ps(v1, v1, vNorm1);
+            vNorm2 = _mm256_fmadd_ps(v2, v2, vNorm2);
+        }
+    }
+
+    if (i < count)
+    {
+        __m256 v1 = _mm256_loadu_ps(pV1 + i);
+        vSum1 = _mm256_fmadd_ps(v1, _mm256_loadu_ps(pV2 + i), vSum1);
+        if (pNorm) vNorm1 = _mm256_fmadd_ps(v1, v1, vNorm1);
+    }
+
+    if (pNorm) *pNorm = horizontalSumAVX(_mm256_add_ps(vNorm1, vNorm2));
+    return horizontalSumAVX(_mm256_add_ps(vSum1, vSum2));
+}
+
+
+// Relative cost of one multiply-add, see TDStretch::getCrossCorrCost
+double TDStretchAVX::getCrossCorrCost() const
+{
+    return 0.125;
+}
+
+
+// Calculates cross correlation of two buffers
+ST_TARGET_AVX2 double TDStretchAVX::calcCrossCorr(const float *pV1, const float *pV2, double &anorm)
+{
+    #ifdef ST_SIMD_AVOID_UNALIGNED
+        // in SIMD mode skip 'mixingPos' positions that aren't aligned to 16-byte boundary
+        if (((ulongptr)pV1) & 15) return -1e50;
+    #endif
+
+    // overlapLength is divisible by 8, so the length is too. Unlike the SSE routine
+    // this covers the whole overlap for mono sound, same as the plain C version.
+    float norm;
+    float corr = dotProductAVX(pV1, pV2, channels * overlapLength, &norm);
+
+    anorm = norm;
+    return corr / sqrt((norm < 1e-9 ? 1.0 : norm));
+}
+
+
+// Update cross-correlation by accumulating "norm" coefficient by previously calculated value
+ST_TARGET_AVX2 double TDStretchAVX::calcCrossCorrAccumulate(const float *pV1, const float *pV2, double &norm)
+{
+    int i;
+    int count = channels * overlapLength;
+
+    // cancel first normalizer tap from previous round
+    for (i = 1; i <= channels; i ++)
+    {
+        norm -= pV1[-i] * pV1[-i];
+    }
+
+    float corr = dotProductAVX(pV1, pV2, count, NULL);
+
+    // update normalizer with last samples of this round
+    for (i = count - channels; i < count; i ++)
+    {
+        norm += pV1[i] * pV1[i];
+    }
+
+    return corr / sqrt((norm < 1e-9 ? 1.0 : norm));
+}
+
+
+// Same as dotProductAVX, 16 floats at a time
+ST_TARGET_AVX512 static inline float dotProductAVX512(const float *pV1, const float *pV2, int count, float *pNorm)
+{
+    __m512 vSum1 = _mm512_setzero_ps();
+    __m512 vSum2 = _mm512_setzero_ps();
+    __m512 vNorm1 = _mm512_setzero_ps();
+    __m512 vNorm2 = _mm512_setzero_ps();
+    int i;
+
+    for (i = 0; i + 32 <= count; i += 32)
+    {
+        __m512 v1 = _mm512_loadu_ps(pV1 + i);
+        __m512 v2 = _mm512_loadu_ps(pV1 + i + 16);
+        vSum1 = _mm512_fmadd_ps(v1, _mm512_loadu_ps(pV2 + i), vSum1);
+        vSum2 = _mm512_fmadd_ps(v2, _mm512_loadu_ps(pV2 + i + 16), vSum2);
+
+        if (pNorm)
+        {
+            vNorm1 = _mm512_fmadd_ps(v1, v1, vNorm1);
+            vNorm2 = _mm512_fmadd_ps(v2, v2, vNorm2);
+        }
+    }
+
+    // The remaining 8, 16 or 24 floats, with the unused lanes masked off
+    for (; i < count; i += 16)
+    {
+        __mmask16 mask = (count - i >= 16) ? (__mmask16)0xffff : (__mmask16)0x00ff;
+        __m512 v1 = _mm512_maskz_loadu_ps(mask, pV1 + i);
+        vSum1 = _mm512_fmadd_ps(v1, _mm512_maskz_loadu_ps(mask, pV2 + i), vSum1);
+        if (pNorm) vNorm1 = _mm512_fmadd_ps(v1, v1, vNorm1);
+    }
+
+    if (pNorm) *pNorm = horizontalSumAVX(foldAVX512(_mm512_add_ps(vNorm1, vNorm2)));
+    float sum = horizontalSumAVX(foldAVX512(_mm512_add_ps(vSum1, vSum2)));
+
+    // GCC leaves this out of AVX-512 functions, and the SSE code that follows would pay for it
+    _mm256_zeroupper();
+    return sum;
+}
+
+
+// Relative cost of one multiply-add, see TDStretch::getCrossCorrCost
+double TDStretchAVX512::getCrossCorrCost() const
+{
+    return 0.115;
+}
+
+
+// Calculates cross correlation of two buffers
+ST_TARGET_AVX512 double TDStretchAVX512::calcCrossCorr(const float *pV1, const float *pV2, double &anorm)
+{
+    #ifdef ST_SIMD_AVOID_UNALIGNED
+        // in SIMD mode skip 'mixingPos' positions that aren't aligned to 16-byte boundary
+        if (((ulongptr)pV1) & 15) return -1e50;
+    #endif
+
+    float norm;
+    float corr = dotProductAVX512(pV1, pV2, channels * overlapLength, &norm);
+
+    anorm = norm;
+    return corr / sqrt((norm < 1e-9 ? 1.0 : norm));
+}
+
+
+// Update cross-correlation by accumulating "norm" coefficient by previously calculated value
+ST_TARGET_AVX512 double TDStretchAVX512::calcCrossCorrAccumulate(const float *pV1, const float *pV2, double &norm)
+{
+    int i;
+    int count = channels * overlapLength;
+
+    // cancel first normalizer tap from previous round
+    for (i = 1; i <= channels; i ++)
+    {
+        norm -= pV1[-i] * pV1[-i];
+    }
+
+    float corr = dotProductAVX512(pV1, pV2, count, NULL);
+
+    // update normalizer with last samples of this round
+    for (i = count - channels; i < count; i ++)
+    {
+        norm += pV1[i] * pV1[i];
+    }
+
+    return corr / sqrt((norm < 1e-9 ? 1.0 : norm));
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// implementation of AVX optimized functions of class 'FIRFilter'
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "FIRFilter.h"
+
+// Adds up the partial sums of two stereo output samples: sum1 and sum2 each hold
+// L R L R ... partial sums. Stores L1 R1 L2 R2 to pDest.
+ST_TARGET_AVX2 static inline void storeStereoPairAVX(float *pDest, __m256 sum1, __m256 sum2)
+{
+    __m128 s1 = _mm_add_ps(_mm256_castps256_ps128(sum1), _mm256_extractf128_ps(sum1, 1));
+    __m128 s2 = _mm_add_ps(_mm256_castps256_ps128(sum2), _mm256_extractf128_ps(sum2, 1));
+
+    // same post-shuffle as the SSE routine
+    _mm_storeu_ps(pDest, _mm_add_ps(
+                _mm_shuffle_ps(s1, s2, _MM_SHUFFLE(1,0,3,2)),   // s2_1 s2_0 s1_3 s1_2
+                _mm_shuffle_ps(s1, s2, _MM_SHUFFLE(3,2,1,0))    // s2_3 s2_2 s1_1 s1_0
+                ));
+}
+
+
+// AVX2 + FMA optimized version of the filter routine for stereo sound
+ST_TARGET_AVX2 uint FIRFilterAVX::evaluateFilterStereo(float *dest, const float *source, uint numSamples) const
+{
+    int count = (int)((numSamples - length) & (uint)-2);
+    int j;
+
+    assert(count % 2 == 0);
+
+    if (count < 2) return 0;
+
+    assert(source != NULL);
+    assert(dest != NULL);
+    assert((length % 8) == 0);
+    assert(filterCoeffsAlign != NULL);
+
+    // filter is evaluated for two stereo samples with each iteration, thus use of 'j += 2'
+    for (j = 0; j < count; j += 2)
+    {
+        const float *pSrc = source + j * 2;
+        const float *pFil = filterCoeffsAlign;  // interleaved for stereo: c0 c0 c1 c1 ...
+        __m256 sum1a = _mm256_setzero_ps();
+        __m256 sum1b = _mm256_setzero_ps();
+        __m256 sum2a = _mm256_setzero_ps();
+        __m256 sum2b = _mm256_setzero_ps();
+        uint i;
+
+        // 8 taps per round: sum1 accumulates the sample at this offset, sum2 the next one
+        for (i = 0; i < length / 8; i ++)
+        {
+            __m256 fil1 = _mm256_loadu_ps(pFil);
+            __m256 fil2 = _mm256_loadu_ps(pFil + 8);
+
+            sum1a = _mm256_fmadd_ps(_mm256_loadu_ps(pSrc),      fil1, sum1a);
+            sum2a = _mm256_fmadd_ps(_mm256_loadu_ps(pSrc + 2),  fil1, sum2a);
+            sum1b = _mm256_fmadd_ps(_mm256_loadu_ps(pSrc + 8),  fil2, sum1b);
+            sum2b = _mm256_fmadd_ps(_mm256_loadu_ps(pSrc + 10), fil2, sum2b);
+
+            pSrc += 16;
+            pFil += 16;
+        }
+
+        storeStereoPairAVX(dest + j * 2, _mm256_add_ps(sum1a, sum1b), _mm256_add_ps(sum2a, sum2b));
+    }
+
+    return (uint)count;
+}
+
+
+// AVX-512 optimized version of the filter routine for stereo sound
+ST_TARGET_AVX512 uint FIRFilterAVX512::evaluateFilterStereo(float *dest, const float *source, uint numSamples) const
+{
+    int count = (int)((numSamples - length) & (uint)-2);
+    int j;
+
+    assert(count % 2 == 0);
+
+    if (count < 2) return 0;
+
+    assert(source != NULL);
+    assert(dest != NULL);
+    assert((length % 8) == 0);
+    assert(filterCoeffsAlign != NULL);
+
+    for (j = 0; j < count; j += 2)
+    {
+        const float *pSrc = source + j * 2;
+        const float *pFil = filterCoeffsAlign;
+        __m512 sum1a = _mm512_setzero_ps();
+        __m512 sum1b = _mm512_setzero_ps();
+        __m512 sum2a = _mm512_setzero_ps();
+        __m512 sum2b = _mm512_setzero_ps();
+        uint i;
+
+        // 16 taps per round, then the last 8 if length isn't divisible by 16
+        for (i = 0; i + 16 <= length; i += 16)
+        {
+            __m512 fil1 = _mm512_loadu_ps(pFil);
+            __m512 fil2 = _mm512_loadu_ps(pFil + 16);
+
+            sum1a = _mm512_fmadd_ps(_mm512_loadu_ps(pSrc),      fil1, sum1a);
+            sum2a = _mm512_fmadd_ps(_mm512_loadu_ps(pSrc + 2),  fil1, sum2a);
+            sum1b = _mm512_fmadd_ps(_mm512_loadu_ps(pSrc + 16), fil2, sum1b);
+            sum2b = _mm512_fmadd_ps(_mm512_loadu_ps(pSrc + 18), fil2, sum2b);
+
+            pSrc += 32;
+            pFil += 32;
+        }
+
+        if (i < length)
+        {
+            __m512 fil = _mm512_loadu_ps(pFil);
+            sum1a = _mm512_fmadd_ps(_mm512_loadu_ps(pSrc),     fil, sum1a);
+            sum2a = _mm512_fmadd_ps(_mm512_loadu_ps(pSrc + 2), fil, sum2a);
+        }
+
+        storeStereoPairAVX(dest + j * 2, foldAVX512(_mm512_add_ps(sum1a, sum1b)),
+                                         foldAVX512(_mm512_add_ps(sum2a, sum2b)));
+    }
+
+    _mm256_zeroupper();
+
+    return (uint)count;
+}
+
+#endif  // SOUNDTOUCH_ALLOW_AVX
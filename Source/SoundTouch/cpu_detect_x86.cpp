@@ -38,10 +38,10 @@
 
 #if defined(SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS)
 
-   #if defined(__GNUC__) && defined(__i386__)
+   #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
        // gcc
        #include "cpuid.h"
-   #elif defined(_M_IX86)
+   #elif defined(_M_IX86) || defined(_M_X64)
        // windows non-gcc
        #include <intrin.h>
    #endif
@@ -49,6 +49,19 @@
    #define bit_MMX     (1 << 23)
    #define bit_SSE     (1 << 25)
    #define bit_SSE2    (1 << 26)
+
+   // cpuid leaf 1 ecx
+   #define ST_BIT_FMA      (1 << 12)
+   #define ST_BIT_OSXSAVE  (1 << 27)
+   #define ST_BIT_AVX      (1 << 28)
+
+   // cpuid leaf 7 ebx
+   #define ST_BIT_AVX2     (1 << 5)
+   #define ST_BIT_AVX512F  (1 << 16)
+
+   // XCR0: register state that the OS saves on context switch
+   #define ST_XCR0_YMM     0x06    // SSE + AVX
+   #define ST_XCR0_ZMM     0xe6    // SSE + AVX + opmask + ZMM0-15 + ZMM16-31
 #endif
 
 
@@ -68,54 +81,87 @@ void disableExtensions(uint dwDisableMask)
 }
 
 
-/// Checks which instruction set extensions are supported by the CPU.
-uint detectCPUextensions(void)
-{
-/// If building for a 64bit system (no Itanium) and the user wants optimizations.
-/// Return the OR of SUPPORT_{MMX,SSE,SSE2}. 11001 or 0x19.
-/// Keep the _dwDisabledISA test (2 more operations, could be eliminated).
-#if ((defined(__GNUC__) && defined(__x86_64__)) \
-    || defined(_M_X64))  \
-    && defined(SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS)
-    return 0x19 & ~_dwDisabledISA;
-
-/// If building for a 32bit system and the user wants optimizations.
-/// Keep the _dwDisabledISA test (2 more operations, could be eliminated).
-#elif ((defined(__GNUC__) && defined(__i386__)) \
-    || defined(_M_IX86))  \
+#if ((defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))) \
+    || defined(_M_IX86) || defined(_M_X64))  \
     && defined(SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS)
 
-    if (_dwDisabledISA == 0xffffffff) return 0;
- 
-    uint res = 0;
- 
+/// Reads cpuid leaf (sub-leaf 0) into reg = eax, ebx, ecx, edx. Returns false
+/// if the CPU doesn't have that leaf.
+static bool readCpuid(uint leaf, uint reg[4])
+{
 #if defined(__GNUC__)
     // GCC version of cpuid. Requires GCC 4.3.0 or later for __cpuid intrinsic support.
-    uint eax, ebx, ecx, edx;  // unsigned int is the standard type. uint is defined by the compiler and not guaranteed to be portable.
-
-    // Check if no cpuid support.
-    if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx)) return 0; // always disable extensions.
-
-    if (edx & bit_MMX)  res = res | SUPPORT_MMX;
-    if (edx & bit_SSE)  res = res | SUPPORT_SSE;
-    if (edx & bit_SSE2) res = res | SUPPORT_SSE2;
-
+    if (__get_cpuid_max(0, NULL) < leaf) return false;
+    __cpuid_count(leaf, 0, reg[0], reg[1], reg[2], reg[3]);
 #else
     // Window / VS version of cpuid. Notice that Visual Studio 2005 or later required 
     // for __cpuid intrinsic support.
-    int reg[4] = {-1};
+    int r[4] = {-1};
+    __cpuid(r, 0);
+    if ((uint)r[0] < leaf) return false;
+    __cpuidex(r, (int)leaf, 0);
+    for (int i = 0; i < 4; i ++) reg[i] = (uint)r[i];
+#endif
+    return true;
+}
 
-    // Check if no cpuid support.
-    __cpuid(reg,0);
-    if ((unsigned int)reg[0] == 0) return 0; // always disable extensions.
 
-    __cpuid(reg,1);
-    if ((unsigned int)reg[3] & bit_MMX)  res = res | SUPPORT_MMX;
-    if ((unsigned int)reg[3] & bit_SSE)  res = res | SUPPORT_SSE;
-    if ((unsigned int)reg[3] & bit_SSE2) res = res | SUPPORT_SSE2;
+/// Reads XCR0, to tell whether the OS preserves the AVX / AVX-512 registers.
+/// Call only if cpuid reports OSXSAVE.
+static unsigned long long readXCR0()
+{
+#if defined(__GNUC__)
+    uint eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#else
+    return _xgetbv(0);
+#endif
+}
 
 #endif
 
+
+/// Checks which instruction set extensions are supported by the CPU.
+uint detectCPUextensions(void)
+{
+/// If building for a x86 system and the user wants optimizations.
+/// Keep the _dwDisabledISA test (2 more operations, could be eliminated).
+#if ((defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))) \
+    || defined(_M_IX86) || defined(_M_X64))  \
+    && defined(SOUNDTOUCH_ALLOW_X86_OPTIMIZATIONS)
+
+    if (_dwDisabledISA == 0xffffffff) return 0;
+ 
+    uint res = 0;
+    uint reg[4];
+
+    // Check if no cpuid support.
+    if (!readCpuid(1, reg)) return 0; // always disable extensions.
+
+    if (reg[3] & bit_MMX)  res = res | SUPPORT_MMX;
+    if (reg[3] & bit_SSE)  res = res | SUPPORT_SSE;
+    if (reg[3] & bit_SSE2) res = res | SUPPORT_SSE2;
+
+    // AVX is only usable if the OS saves the YMM registers on context switch,
+    // and AVX-512 only if it saves the opmask and ZMM registers as well
+    if ((reg[2] & ST_BIT_OSXSAVE) && (reg[2] & ST_BIT_AVX))
+    {
+        unsigned long long xcr0 = readXCR0();
+
+        if ((xcr0 & ST_XCR0_YMM) == ST_XCR0_YMM)
+        {
+            res = res | SUPPORT_AVX;
+            if (reg[2] & ST_BIT_FMA) res = res | SUPPORT_FMA;
+
+            if (readCpuid(7, reg))
+            {
+                if (reg[1] & ST_BIT_AVX2) res = res | SUPPORT_AVX2;
+                if ((reg[1] & ST_BIT_AVX512F) && (xcr0 & ST_XCR0_ZMM) == ST_XCR0_ZMM) res = res | SUPPORT_AVX512F;
+            }
+        }
+    }
+
     return res & ~_dwDisabledISA;
 
 #else
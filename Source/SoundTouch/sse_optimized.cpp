@@ -185,6 +185,13 @@ double TDStretchSSE::calcCrossCorrAccumulate(const float *pV1, const float *pV2,
 }
 
 
+// Relative cost of one multiply-add, see TDStretch::getCrossCorrCost
+double TDStretchSSE::getCrossCorrCost() const
+{
+    return 0.29;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // implementation of SSE optimized functions of class 'FIRFilter'
@@ -14,8 +14,12 @@
 #include "SoundTouch/RateTransposer.cpp"
 #include "SoundTouch/SoundTouch.cpp"  // Main SoundTouch implementation
 #include "SoundTouch/TDStretch.cpp"
+#undef max      // the sources each define their own, which breaks later standard headers
+#include "SoundTouch/FFTCorrelator.cpp"
 #include "SoundTouch/BPMDetect.cpp"
+#undef max
 #include "SoundTouch/PeakFinder.cpp"
+#undef max
 
 // Interpolation files
 #include "SoundTouch/InterpolateCubic.cpp"
@@ -27,6 +31,7 @@
 
 // CPU-specific optimizations
 #include "SoundTouch/sse_optimized.cpp"
+#include "SoundTouch/avx_optimized.cpp"
 #include "SoundTouch/mmx_optimized.cpp"
 
 #pragma clang diagnostic pop
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * Block-based stereo delay for the effects chain
+ *
+ * Reads and writes whole chunks of a power-of-two ring buffer instead of
+ * pushing and popping one sample at a time. Delay time, feedback and mix are
+ * interpolated per sample across each block towards the values last set, so
+ * moving the time slider glides the pitch like tape rather than jumping.
+ *
+ * Ping-pong mode feeds the summed input into the left line and bounces the
+ * repeats between channels. Filtered feedback darkens and thins each repeat
+ * with one-pole low/high cuts in the loop.
+ *
+ * Setters and process() belong to the audio thread.
+ */
+class StereoDelay
+{
+public:
+    StereoDelay() = default;
+
+    void prepare (const juce::dsp::ProcessSpec& spec, double maximumDelaySeconds)
+    {
+        sampleRate = spec.sampleRate;
+        maximumDelaySamples = juce::jmax (2.0f, static_cast<float> (maximumDelaySeconds * sampleRate));
+
+        // Room for the longest delay plus a whole block written ahead of the oldest read
+        ringSize = juce::nextPowerOfTwo (static_cast<int> (maximumDelaySamples) + static_cast<int> (spec.maximumBlockSize) + 2);
+        ringMask = ringSize - 1;
+        delayBuffer.setSize (2, ringSize + 1);  // Plus a guard sample in front mirroring the last one
+        wetBuffer.setSize (2, static_cast<int> (spec.maximumBlockSize));
+        feedbackBuffer.setSize (2, static_cast<int> (spec.maximumBlockSize));
+
+        lowPassCoefficient = std::exp (-juce::MathConstants<float>::twoPi * feedbackLowPassHz / static_cast<float> (sampleRate));
+        highPassCoefficient = std::exp (-juce::MathConstants<float>::twoPi * feedbackHighPassHz / static_cast<float> (sampleRate));
+
+        reset();
+    }
+
+    void reset()
+    {
+        delayBuffer.clear();
+        wetBuffer.clear();
+        feedbackBuffer.clear();
+        writePosition = 0;
+
+        for (auto& state : lowPassState)  state = 0.0f;
+        for (auto& state : highPassState) state = 0.0f;
+
+        currentDelay = targetDelay;
+        currentFeedback = targetFeedback;
+        currentMix = targetMix;
+    }
+
+    // Reached by the end of the next block
+    void setDelayTime (float seconds)
+    {
+        targetDelay = juce::jlimit (1.0f, maximumDelaySamples, seconds * static_cast<float> (sampleRate));
+    }
+
+    void setFeedback (float feedback)  { targetFeedback = juce::jlimit (0.0f, 0.95f, feedback); }
+    void setMix (float mix)            { targetMix = juce::jlimit (0.0f, 1.0f, mix); }
+
+    void setPingPong (bool shouldPingPong)          { pingPong = shouldPingPong; }
+    void setFeedbackFiltered (bool shouldFilter)    { feedbackFiltered = shouldFilter; }
+
+    void process (const juce::dsp::AudioBlock<float>& block)
+    {
+        auto numChannels = static_cast<int> (juce::jmin (block.getNumChannels(), static_cast<size_t> (2)));
+        auto numSamples = static_cast<int> (block.getNumSamples());
+
+        if (numChannels == 0 || numSamples == 0)
+            return;
+
+        jassert (numSamples <= wetBuffer.getNumSamples());  // Larger than the block size given to prepare()
+
+        auto delayStep = (targetDelay - currentDelay) / static_cast<float> (numSamples);
+        auto feedbackStep = (targetFeedback - currentFeedback) / static_cast<float> (numSamples);
+
+        // A chunk may only read what was written before it started, so it's never longer than the delay
+        auto maxChunk = juce::jmax (1, static_cast<int> (std::floor (juce::jmin (currentDelay, targetDelay))));
+
+        for (int start = 0; start < numSamples;)
+        {
+            auto numThisTime = juce::jmin (maxChunk, numSamples - start);
+            auto chunkDelay = currentDelay + delayStep * static_cast<float> (start);
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                readDelayed (ch, start, numThisTime, chunkDelay, delayStep);
+
+            writeWithFeedback (block, numChannels, start, numThisTime,
+                               currentFeedback + feedbackStep * static_cast<float> (start), feedbackStep);
+
+            writePosition = (writePosition + numThisTime) & ringMask;
+            start += numThisTime;
+        }
+
+        mixIntoOutput (block, numChannels, numSamples);
+
+        currentDelay = targetDelay;
+        currentFeedback = targetFeedback;
+        currentMix = targetMix;
+    }
+
+private:
+    //==============================================================================
+    // Ring sample at a (possibly negative or wrapped) index, with the guard making index - 1 valid at 0
+    const float* getRing (int channel) const  { return delayBuffer.getReadPointer (channel) + 1; }
+    float* getRing (int channel)              { return delayBuffer.getWritePointer (channel) + 1; }
+
+    // Linear interpolation between the two ring samples either side of the delayed read position
+    void readDelayed (int channel, int start, int numSamples, float startDelay, float delayStep)
+    {
+        auto* ring = getRing (channel);
+        auto* wet = wetBuffer.getWritePointer (channel, start);
+
+        if (delayStep == 0.0f)
+        {
+            // Steady delay time: the read is contiguous, so interpolate straight along the ring
+            auto delayInt = static_cast<int> (startDelay);
+            auto fraction = startDelay - static_cast<float> (delayInt);
+
+            for (int done = 0; done < numSamples;)
+            {
+                auto index = (writePosition + done - delayInt) & ringMask;
+                auto numThisTime = juce::jmin (numSamples - done, ringSize - index);
+                auto* newer = ring + index;
+
+                for (int i = 0; i < numThisTime; ++i)
+                    wet[done + i] = newer[i] + fraction * (newer[i - 1] - newer[i]);
+
+                done += numThisTime;
+            }
+
+            return;
+        }
+
+        // Gliding: every sample reads from a slightly different distance
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto delay = startDelay + delayStep * static_cast<float> (i);
+            auto delayInt = static_cast<int> (delay);
+            auto fraction = delay - static_cast<float> (delayInt);
+
+            auto index = (writePosition + i - delayInt) & ringMask;
+            wet[i] = ring[index] + fraction * (ring[index - 1] - ring[index]);
+        }
+    }
+
+    void writeWithFeedback (const juce::dsp::AudioBlock<float>& block, int numChannels, int start, int numSamples,
+                            float startFeedback, float feedbackStep)
+    {
+        auto isPingPong = pingPong && numChannels == 2;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            // Ping-pong: each line is fed by the other one, and only the left line hears the input
+            auto* repeats = wetBuffer.getReadPointer (isPingPong ? 1 - ch : ch, start);
+            auto* toWrite = feedbackBuffer.getWritePointer (ch);
+
+            for (int i = 0; i < numSamples; ++i)
+                toWrite[i] = repeats[i] * (startFeedback + feedbackStep * static_cast<float> (i));
+
+            if (feedbackFiltered)
+                filterFeedback (ch, toWrite, numSamples);
+
+            auto* input = block.getChannelPointer (static_cast<size_t> (ch)) + start;
+
+            if (! isPingPong)
+            {
+                juce::FloatVectorOperations::add (toWrite, input, numSamples);
+            }
+            else if (ch == 0)
+            {
+                juce::FloatVectorOperations::addWithMultiply (toWrite, input, 0.5f, numSamples);
+                juce::FloatVectorOperations::addWithMultiply (toWrite, block.getChannelPointer (1) + start, 0.5f, numSamples);
+            }
+
+            writeToRing (ch, toWrite, numSamples);
+        }
+    }
+
+    void writeToRing (int channel, const float* source, int numSamples)
+    {
+        auto* ring = getRing (channel);
+        auto firstPart = juce::jmin (numSamples, ringSize - writePosition);
+
+        juce::FloatVectorOperations::copy (ring + writePosition, source, firstPart);
+
+        if (firstPart < numSamples)
+            juce::FloatVectorOperations::copy (ring, source + firstPart, numSamples - firstPart);
+
+        ring[-1] = ring[ringMask];
+    }
+
+    // One-pole low-pass then one-pole high-pass, so repeats lose top and bottom like an analogue delay
+    void filterFeedback (int channel, float* data, int numSamples)
+    {
+        auto lowPassed = lowPassState[channel];
+        auto rumble = highPassState[channel];
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            lowPassed = data[i] + lowPassCoefficient * (lowPassed - data[i]);
+            rumble = lowPassed + highPassCoefficient * (rumble - lowPassed);
+            data[i] = lowPassed - rumble;
+        }
+
+        lowPassState[channel] = lowPassed;
+        highPassState[channel] = rumble;
+    }
+
+    void mixIntoOutput (const juce::dsp::AudioBlock<float>& block, int numChannels, int numSamples)
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* output = block.getChannelPointer (static_cast<size_t> (ch));
+            auto* wet = wetBuffer.getReadPointer (ch);
+
+            if (currentMix == targetMix)
+            {
+                juce::FloatVectorOperations::multiply (output, 1.0f - targetMix, numSamples);
+                juce::FloatVectorOperations::addWithMultiply (output, wet, targetMix, numSamples);
+            }
+            else
+            {
+                auto mixStep = (targetMix - currentMix) / static_cast<float> (numSamples);
+
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    auto mix = currentMix + mixStep * static_cast<float> (i);
+                    output[i] += mix * (wet[i] - output[i]);
+                }
+            }
+        }
+    }
+
+    //==============================================================================
+    static constexpr float feedbackLowPassHz = 3500.0f;
+    static constexpr float feedbackHighPassHz = 150.0f;
+
+    double sampleRate = 44100.0;
+    float maximumDelaySamples = 2.0f;
+
+    juce::AudioBuffer<float> delayBuffer;     // Ring buffer, power-of-two length after the guard sample
+    juce::AudioBuffer<float> wetBuffer;       // This block's delayed signal
+    juce::AudioBuffer<float> feedbackBuffer;  // What the current chunk writes back into the ring
+    int writePosition = 0, ringSize = 0, ringMask = 0;
+
+    float currentDelay = 1.0f, targetDelay = 1.0f;  // In samples
+    float currentFeedback = 0.0f, targetFeedback = 0.0f;
+    float currentMix = 0.0f, targetMix = 0.0f;
+
+    bool pingPong = false, feedbackFiltered = false;
+    float lowPassCoefficient = 0.0f, highPassCoefficient = 0.0f;
+    float lowPassState[2] = {}, highPassState[2] = {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StereoDelay)
+};
@@ -0,0 +1,774 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "TrackSource.h"
+
+//==============================================================================
+/**
+ * Playback deck with a lock-free "current / incoming" track handoff
+ *
+ * loadTrack() returns immediately: a loader thread opens, prepares and primes
+ * the new TrackSource, then publishes it with a single atomic exchange. The
+ * audio thread adopts it at the top of its next block, crossfades out of the
+ * old track over a few milliseconds and pushes the old one onto a retire
+ * queue. A garbage thread deletes retired tracks, so no allocation, file I/O
+ * or destruction ever happens on the audio thread or blocks the UI.
+ *
+ * queueNextTrack() preloads the following track into a separate "upcoming"
+ * slot while the current one plays. The audio thread switches to it either
+ * sample-accurately at the end of the current track (gapless) or with an
+ * equal-power crossfade, mixing two already-decoded tracks with no file I/O
+ * at the switch point.
+ *
+ * Tracks found in the shared DecodedTrackCache play straight from memory.
+ * Anything that had to be streamed is queued for the cache once it's
+ * playing, so going back to it or replaying it later skips the decoder.
+ * Streamed tracks are also queued for the TranscodeCache, which keeps a
+ * memory-mappable copy on disk for later sessions and passes it on to the
+ * memory cache, so the original is only decoded once.
+ *
+ * Also replaces AudioTransportSource for start/stop/seek, which otherwise
+ * takes its callback lock whenever the source changes.
+ *
+ * Change messages (a track ended, the deck moved on to the queued track) are
+ * flagged by the audio thread and sent from the message thread by a timer,
+ * since posting a message takes the message queue's lock.
+ */
+class TrackDeck : public juce::AudioSource,
+                  public juce::ChangeBroadcaster,
+                  private juce::Timer
+{
+public:
+    TrackDeck (juce::AudioFormatManager& formatManagerToUse, DecodedTrackCache& decodedCacheToUse,
+               TranscodeCache& transcodeCacheToUse)
+        : formatManager (formatManagerToUse),
+          decodedCache (decodedCacheToUse),
+          transcodeCache (transcodeCacheToUse),
+          loader (*this),
+          collector (*this)
+    {
+        readAheadThread.startThread (juce::Thread::Priority::high);
+        keyLockThread.startThread (juce::Thread::Priority::high);
+        loader.startThread (juce::Thread::Priority::normal);
+        collector.startThread (juce::Thread::Priority::low);
+
+        startTimer (changePollIntervalMs);
+    }
+
+    ~TrackDeck() override
+    {
+        stopTimer();
+        loader.stopThread (4000);
+
+        delete incoming.exchange (nullptr);
+        delete upcoming.exchange (nullptr);
+        cancelledTrack.reset();
+        delete current;
+        current = nullptr;
+
+        collector.stopThread (1000);
+        collector.deleteRetiredTracks();
+
+        keyLockThread.stopThread (1000);
+        readAheadThread.stopThread (1000);
+    }
+
+    //==============================================================================
+    // Message thread: queue a file for loading. Returns immediately - the deck keeps
+    // playing the current track until the new one is primed, then swaps to it.
+    void loadTrack (const juce::File& file, const TrackSource::Loudness& loudness = {})
+    {
+        skipRequested = false;
+
+        {
+            const juce::ScopedLock sl (requestLock);
+            requestedFile = file;
+            requestedLoudness = loudness;
+            ++requestId;
+
+            // Whatever was preloaded belonged to the old running order
+            queuedFile = juce::File();
+            ++queuedRequestId;
+
+            if (auto* preloaded = upcoming.exchange (nullptr))
+                cancelledTrack.reset (preloaded);  // The audio thread never saw it - the loader deletes it
+        }
+
+        streamFinished = false;
+        loader.notify();
+    }
+
+    // Message thread: open and decode the head of the track that plays after the
+    // current one, so the switch needs no file I/O. Replaces any earlier queued track.
+    void queueNextTrack (const juce::File& file, const TrackSource::Loudness& loudness = {})
+    {
+        {
+            const juce::ScopedLock sl (requestLock);
+            queuedFile = file;
+            queuedLoudness = loudness;
+            ++queuedRequestId;
+        }
+
+        loader.notify();
+    }
+
+    bool isNextTrackReady() const noexcept  { return upcoming.load() != nullptr; }
+
+    // Switch to the queued track at the next block, using the crossfade length
+    // (or a short click-free fade when gapless). Waits for the preload if needed.
+    void skipToNextTrack()
+    {
+        streamFinished = false;
+        skipRequested = true;
+    }
+
+    // 0 = gapless: the next track starts on the sample after the current one ends
+    void setCrossfadeSeconds (double seconds)
+    {
+        crossfadeSeconds = juce::jlimit (0.0, maximumCrossfadeSeconds, seconds);
+    }
+
+    double getCrossfadeSeconds() const noexcept  { return crossfadeSeconds.load(); }
+
+    // Bumped by the audio thread every time it moves on to the queued track
+    int getNumQueuedTrackTransitions() const noexcept  { return numTransitions.load(); }
+
+    void start()
+    {
+        streamFinished = false;
+        playing = true;
+    }
+
+    void stop()
+    {
+        playing = false;
+    }
+
+    bool isPlaying() const noexcept          { return playing.load(); }
+    bool hasStreamFinished() const noexcept  { return streamFinished.load(); }
+    bool hasTrack() const noexcept           { return publishedLength.load() > 0; }
+
+    void setPosition (double seconds)
+    {
+        auto position = static_cast<juce::int64> (juce::jmax (0.0, seconds) * publishedFileRate.load());
+        pendingSeek = position;
+        publishedPosition = position;
+    }
+
+    double getCurrentPosition() const
+    {
+        auto rate = publishedFileRate.load();
+        return rate > 0.0 ? static_cast<double> (publishedPosition.load()) / rate : 0.0;
+    }
+
+    double getLengthInSeconds() const
+    {
+        auto rate = publishedFileRate.load();
+        return rate > 0.0 ? static_cast<double> (publishedLength.load()) / rate : 0.0;
+    }
+
+    // Turntable pitch, picked up by the audio thread at the start of the next block
+    void setPitchSemitones (double semitones)  { pitchSemitones = semitones; }
+
+    // Interpolation used for the pitch, for this track and every later one
+    void setResamplerQuality (QualityResamplingSource::Quality quality)  { resamplerQuality = static_cast<int> (quality); }
+
+    QualityResamplingSource::Quality getResamplerQuality() const noexcept
+    {
+        return static_cast<QualityResamplingSource::Quality> (resamplerQuality.load());
+    }
+
+    // Pitch changes the key but not the tempo, for this track and every later one
+    void setKeyLockEnabled (bool shouldBeEnabled)  { keyLockEnabled = shouldBeEnabled; }
+    bool isKeyLockEnabled() const noexcept         { return keyLockEnabled.load(); }
+
+    // Audio thread: the loudness of whatever getNextAudioBlock() just played, for normalisation
+    TrackSource::Loudness getCurrentLoudness() const noexcept
+    {
+        return current != nullptr ? current->getLoudness() : TrackSource::Loudness();
+    }
+
+    // How far the current track's key lock reads ahead of what's heard
+    double getKeyLockLatencySeconds() const noexcept  { return publishedKeyLockLatency.load(); }
+
+    // Read-ahead depth (0.5 to 10 seconds) for tracks loaded from now on
+    void setReadAheadSeconds (double seconds)
+    {
+        readAheadSeconds = juce::jlimit (ReadAheadAudioSource::minimumBufferSeconds,
+                                         ReadAheadAudioSource::maximumBufferSeconds, seconds);
+    }
+
+    double getReadAheadSeconds() const noexcept { return readAheadSeconds.load(); }
+
+    // Read-ahead underruns of the track that's currently playing
+    int getNumUnderruns() const noexcept                { return publishedUnderruns.load(); }
+    juce::int64 getNumUnderrunSamples() const noexcept  { return publishedUnderrunSamples.load(); }
+
+    //==============================================================================
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        const juce::ScopedLock sl (prepareLock);
+
+        preparedBlockSize = samplesPerBlockExpected;
+        preparedSampleRate = sampleRate;
+        fadeBuffer.setSize (2, juce::jmax (samplesPerBlockExpected, minimumFadeSamples));
+
+        if (current != nullptr)
+            current->prepareToPlay (samplesPerBlockExpected, sampleRate);
+
+        // The loader and loadTrack() only replace or drop these under requestLock
+        const juce::ScopedLock rl (requestLock);
+
+        if (auto* pending = incoming.load())
+            pending->prepareToPlay (samplesPerBlockExpected, sampleRate);
+
+        if (auto* preloaded = upcoming.load())
+            preloaded->prepareToPlay (samplesPerBlockExpected, sampleRate);
+    }
+
+    void releaseResources() override
+    {
+        const juce::ScopedLock sl (prepareLock);
+
+        preparedSampleRate = 0.0;
+
+        if (current != nullptr)
+            current->releaseResources();
+    }
+
+    // Audio thread: never allocates, locks, opens files, deletes anything or posts
+    // messages - changes are flagged for timerCallback() to send
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& info) override
+    {
+        adoptIncomingTrack();
+        startDueTransition();
+
+        if (current != nullptr)
+        {
+            auto seekTarget = pendingSeek.exchange (-1);
+
+            if (seekTarget >= 0)
+            {
+                current->setNextReadPosition (seekTarget);
+                finishedTrack = nullptr;
+            }
+
+            auto pitch = pitchSemitones.load();
+
+            if (pitch != appliedPitchSemitones)
+            {
+                current->setPitchSemitones (pitch);
+                appliedPitchSemitones = pitch;
+            }
+
+            auto quality = resamplerQuality.load();
+
+            if (quality != appliedResamplerQuality)
+            {
+                current->setResamplerQuality (static_cast<QualityResamplingSource::Quality> (quality));
+                appliedResamplerQuality = quality;
+            }
+
+            auto keyLock = keyLockEnabled.load() ? 1 : 0;
+
+            if (keyLock != appliedKeyLock)
+            {
+                current->setKeyLockEnabled (keyLock != 0);
+                appliedKeyLock = keyLock;
+            }
+        }
+
+        auto isAudible = current != nullptr && current != finishedTrack;
+        auto targetGain = (playing.load() && isAudible) ? 1.0f : 0.0f;
+
+        if (targetGain == 0.0f && lastGain == 0.0f)
+        {
+            info.clearActiveBufferRegion();
+
+            // Nothing to hear, so there's nothing to fade either
+            if (outgoing != nullptr)
+            {
+                retire (outgoing);
+                outgoing = nullptr;
+            }
+        }
+        else
+        {
+            renderMix (info, targetGain);
+        }
+
+        lastGain = targetGain;
+
+        if (current != nullptr)
+        {
+            checkForEndOfStream();
+            publishState();
+        }
+    }
+
+private:
+    //==============================================================================
+    class Loader : public juce::Thread
+    {
+    public:
+        explicit Loader (TrackDeck& d) : juce::Thread ("Track Loader"), deck (d) {}
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                wait (-1);
+
+                while (! threadShouldExit() && deck.loadLatestRequest())
+                {
+                }
+            }
+        }
+
+    private:
+        TrackDeck& deck;
+    };
+
+    class Collector : public juce::Thread
+    {
+    public:
+        explicit Collector (TrackDeck& d) : juce::Thread ("Track Garbage"), deck (d) {}
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                deleteRetiredTracks();
+                wait (50);
+            }
+        }
+
+        void deleteRetiredTracks()
+        {
+            int start1, size1, start2, size2;
+            deck.retireFifo.prepareToRead (deck.retireFifo.getNumReady(), start1, size1, start2, size2);
+
+            for (int i = 0; i < size1; ++i)
+                delete deck.retired[start1 + i];
+
+            for (int i = 0; i < size2; ++i)
+                delete deck.retired[start2 + i];
+
+            deck.retireFifo.finishedRead (size1 + size2);
+        }
+
+    private:
+        TrackDeck& deck;
+    };
+
+    //==============================================================================
+    // Loader thread: returns true if a request was handled, so newer ones get picked up too.
+    // Tracks to play now always go before preloading the next one.
+    bool loadLatestRequest()
+    {
+        juce::File file;
+        int id = 0;
+        bool isQueued = false;
+        TrackSource::Loudness loudness;
+        std::unique_ptr<TrackSource> trackToDelete, replacedTrack;
+
+        {
+            const juce::ScopedLock sl (requestLock);
+            trackToDelete = std::move (cancelledTrack);
+
+            if (requestId != loadedRequestId)
+            {
+                file = requestedFile;
+                loudness = requestedLoudness;
+                id = loadedRequestId = requestId;
+            }
+            else if (queuedRequestId != loadedQueuedRequestId)
+            {
+                file = queuedFile;
+                loudness = queuedLoudness;
+                id = loadedQueuedRequestId = queuedRequestId;
+                isQueued = true;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (file == juce::File())
+            return true;
+
+        auto track = TrackSource::open (formatManager, decodedCache, transcodeCache, file,
+                                        readAheadThread, readAheadSeconds.load(), keyLockThread);
+
+        if (track == nullptr)
+        {
+            DBG ("TrackDeck: couldn't open " << file.getFullPathName());
+            return true;
+        }
+
+        track->setLoudness (loudness);
+
+        {
+            const juce::ScopedLock sl (prepareLock);
+
+            if (preparedSampleRate > 0.0)
+                track->prepareToPlay (preparedBlockSize, preparedSampleRate);
+        }
+
+        if (track->getPreparedSampleRate() > 0.0)
+            track->prime (primeSeconds, 2000);
+
+        const auto fromMemory = track->isPlayingFromMemory();
+        const auto fromTranscode = track->isPlayingFromTranscode();
+
+        {
+            const juce::ScopedLock sl (prepareLock);
+
+            if (preparedSampleRate > 0.0 && (track->getPreparedSampleRate() != preparedSampleRate
+                                              || track->getPreparedBlockSize() != preparedBlockSize))
+                track->prepareToPlay (preparedBlockSize, preparedSampleRate);
+
+            // Held from the stale check until the track is published, so a loadTrack()
+            // in between can't leave a track from the old running order in the slot
+            const juce::ScopedLock rl (requestLock);
+
+            // Skip straight to the newest track if the user kept pressing next
+            if (id != (isQueued ? queuedRequestId : requestId))
+                return true;
+
+            // The audio thread takes ownership with its own exchange; a track it never
+            // picked up was never touched by it, so it's safe to delete once unlocked
+            if (isQueued)
+                replacedTrack.reset (upcoming.exchange (track.release()));
+            else
+                replacedTrack.reset (incoming.exchange (track.release()));
+        }
+
+        // Decode the whole file in the background now that it's ready to play, for next time,
+        // and to disk once so later sessions map it. Only one of those decodes the original:
+        // the memory cache reads an existing transcode, or waits for the new one to be written.
+        if (fromTranscode)
+            decodedCache.prefetch (file, transcodeCache.findTranscode (file));
+        else if (! fromMemory && ! transcodeCache.transcode (file, &decodedCache))
+            decodedCache.prefetch (file);
+
+        return true;
+    }
+
+    //==============================================================================
+    void adoptIncomingTrack()
+    {
+        if (incoming.load() == nullptr || retireFifo.getFreeSpace() < 2)
+            return;
+
+        auto* newTrack = incoming.exchange (nullptr);
+
+        if (newTrack == nullptr)
+            return;
+
+        switchTo (newTrack, getClickFreeFadeSamples());
+        appliedPitchSemitones = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // Moves on to the preloaded track. Returns false if there isn't one (yet).
+    bool switchToUpcomingTrack (int fadeSamples)
+    {
+        if (upcoming.load() == nullptr || retireFifo.getFreeSpace() < 2)
+            return false;
+
+        auto* newTrack = upcoming.exchange (nullptr);
+
+        if (newTrack == nullptr)
+            return false;
+
+        switchTo (newTrack, fadeSamples);
+
+        // A skip asked for before the track ended by itself has happened too
+        skipRequested = false;
+
+        // Every track starts at its own pitch, same as a manual load
+        pitchSemitones = 0.0;
+        appliedPitchSemitones = 0.0;
+
+        ++numTransitions;
+        changePending = true;
+        return true;
+    }
+
+    void switchTo (TrackSource* newTrack, int fadeSamples)
+    {
+        // A track that was still fading in fades out from wherever it had got to
+        auto currentGain = outgoing != nullptr ? getFadeInGain (fadePosition) : 1.0f;
+
+        if (outgoing != nullptr)
+        {
+            retire (outgoing);
+            outgoing = nullptr;
+        }
+
+        if (current != nullptr)
+        {
+            // Fade the old track out if it's audible, otherwise just drop it
+            if (lastGain > 0.0f && current != finishedTrack && fadeSamples > 0)
+            {
+                outgoing = current;
+                outgoingGain = currentGain;
+                fadeLength = fadeSamples;
+                fadePosition = 0;
+            }
+            else
+            {
+                retire (current);
+            }
+        }
+
+        current = newTrack;
+        finishedTrack = nullptr;
+        appliedResamplerQuality = -1;
+        appliedKeyLock = -1;
+        publishedUnderruns = 0;
+        publishedUnderrunSamples = 0;
+    }
+
+    // Skip requests, and crossfades that are due to start within this block
+    void startDueTransition()
+    {
+        if (upcoming.load() == nullptr)
+            return;
+
+        auto crossfadeSamples = getCrossfadeSamples();
+
+        if (skipRequested.load())
+        {
+            if (switchToUpcomingTrack (crossfadeSamples > 0 ? crossfadeSamples : getClickFreeFadeSamples()))
+                skipRequested = false;
+
+            return;
+        }
+
+        if (crossfadeSamples == 0 || outgoing != nullptr || current == nullptr
+             || current == finishedTrack || current->isLooping() || ! playing.load())
+            return;
+
+        auto remaining = current->getNumOutputSamplesRemaining();
+
+        if (remaining <= crossfadeSamples)
+            switchToUpcomingTrack (static_cast<int> (juce::jmax ((juce::int64) 1, remaining)));
+    }
+
+    void renderMix (const juce::AudioSourceChannelInfo& info, float targetGain)
+    {
+        renderCurrent (info);
+
+        auto numFadeSamples = 0;
+
+        if (outgoing != nullptr)
+        {
+            numFadeSamples = juce::jmin (info.numSamples, fadeLength - fadePosition);
+            info.buffer->applyGainRamp (info.startSample, numFadeSamples,
+                                        getFadeInGain (fadePosition), getFadeInGain (fadePosition + numFadeSamples));
+        }
+
+        info.buffer->applyGainRamp (info.startSample, info.numSamples, lastGain, targetGain);
+
+        if (outgoing != nullptr)
+        {
+            addFadeOut (info, numFadeSamples, targetGain);
+            fadePosition += numFadeSamples;
+
+            if (fadePosition >= fadeLength)
+            {
+                retire (outgoing);
+                outgoing = nullptr;
+            }
+        }
+    }
+
+    // Gapless: if the current track ends inside this block, the queued one starts on the very next sample
+    void renderCurrent (const juce::AudioSourceChannelInfo& info)
+    {
+        auto isGaplessSwitchDue = upcoming.load() != nullptr && getCrossfadeSamples() == 0
+                                   && current != finishedTrack && ! current->isLooping()
+                                   && current->getNumOutputSamplesRemaining() <= info.numSamples;
+
+        if (! isGaplessSwitchDue)
+        {
+            current->getNextAudioBlock (info);
+            return;
+        }
+
+        auto numHead = static_cast<int> (current->getNumOutputSamplesRemaining());
+
+        if (numHead > 0)
+            current->getNextAudioBlock (juce::AudioSourceChannelInfo (info.buffer, info.startSample, numHead));
+
+        if (numHead < info.numSamples)
+        {
+            // If the preload was cancelled in the meantime this just renders the old track's silent tail
+            switchToUpcomingTrack (0);
+            current->getNextAudioBlock (juce::AudioSourceChannelInfo (info.buffer, info.startSample + numHead,
+                                                                      info.numSamples - numHead));
+        }
+        else
+        {
+            switchToUpcomingTrack (0);
+        }
+    }
+
+    // Renders the outgoing track in fadeBuffer-sized chunks, so crossfades can span any number of blocks
+    void addFadeOut (const juce::AudioSourceChannelInfo& info, int numSamples, float targetGain)
+    {
+        auto gainStep = (targetGain - lastGain) / static_cast<float> (juce::jmax (1, info.numSamples));
+
+        for (int done = 0; done < numSamples;)
+        {
+            auto numThisTime = juce::jmin (numSamples - done, fadeBuffer.getNumSamples());
+            juce::AudioSourceChannelInfo fadeInfo (&fadeBuffer, 0, numThisTime);
+
+            outgoing->getNextAudioBlock (fadeInfo);
+
+            auto startGain = getFadeOutGain (fadePosition + done) * (lastGain + gainStep * done);
+            auto endGain = getFadeOutGain (fadePosition + done + numThisTime) * (lastGain + gainStep * (done + numThisTime));
+            fadeBuffer.applyGainRamp (0, numThisTime, startGain, endGain);
+
+            for (int ch = 0; ch < info.buffer->getNumChannels(); ++ch)
+                info.buffer->addFrom (ch, info.startSample + done, fadeBuffer, ch % fadeBuffer.getNumChannels(), 0, numThisTime);
+
+            done += numThisTime;
+        }
+    }
+
+    // Equal-power curves, applied as per-block linear ramps between curve points
+    float getFadeInGain (int position) const
+    {
+        return std::sin (juce::MathConstants<float>::halfPi * juce::jlimit (0.0f, 1.0f, position / static_cast<float> (fadeLength)));
+    }
+
+    float getFadeOutGain (int position) const
+    {
+        return outgoingGain * std::cos (juce::MathConstants<float>::halfPi * juce::jlimit (0.0f, 1.0f, position / static_cast<float> (fadeLength)));
+    }
+
+    int getCrossfadeSamples() const
+    {
+        return static_cast<int> (crossfadeSeconds.load() * preparedSampleRate);
+    }
+
+    int getClickFreeFadeSamples() const
+    {
+        return juce::jmax (minimumFadeSamples, static_cast<int> (clickFreeFadeSeconds * preparedSampleRate));
+    }
+
+    void retire (TrackSource* track)
+    {
+        int start1, size1, start2, size2;
+        retireFifo.prepareToWrite (1, start1, size1, start2, size2);
+
+        if (size1 > 0)
+            retired[start1] = track;
+        else if (size2 > 0)
+            retired[start2] = track;
+
+        retireFifo.finishedWrite (size1 + size2);
+    }
+
+    void checkForEndOfStream()
+    {
+        if (current == finishedTrack || current->isLooping())
+            return;
+
+        if (current->getNextReadPosition() >= current->getTotalLength())
+        {
+            finishedTrack = current;
+
+            if (playing.exchange (false))
+            {
+                streamFinished = true;
+                changePending = true;
+            }
+        }
+    }
+
+    // Message thread: sends the change messages the audio thread has flagged
+    void timerCallback() override
+    {
+        if (changePending.exchange (false))
+            sendChangeMessage();
+    }
+
+    void publishState()
+    {
+        if (pendingSeek.load() < 0)
+            publishedPosition = current->getNextReadPosition();
+
+        publishedLength = current->getTotalLength();
+        publishedFileRate = current->getFileSampleRate();
+        publishedUnderruns = current->getNumUnderruns();
+        publishedUnderrunSamples = current->getNumUnderrunSamples();
+        publishedKeyLockLatency = current->getKeyLockLatencySamples() / juce::jmax (1.0, current->getFileSampleRate());
+    }
+
+    //==============================================================================
+    static constexpr int retireCapacity = 32;
+    static constexpr int minimumFadeSamples = 256;
+    static constexpr double primeSeconds = 0.25;
+    static constexpr double clickFreeFadeSeconds = 0.01;
+    static constexpr double maximumCrossfadeSeconds = 30.0;
+    static constexpr int changePollIntervalMs = 20;
+
+    juce::AudioFormatManager& formatManager;
+    DecodedTrackCache& decodedCache;
+    TranscodeCache& transcodeCache;
+    juce::TimeSliceThread readAheadThread { "Track Read-Ahead" };  // Decodes ahead of the audio callback
+    juce::TimeSliceThread keyLockThread { "Track Key Lock" };      // Runs SoundTouch for key-locked tracks
+    Loader loader;
+    Collector collector;
+
+    // Loader requests - only the newest of each kind matters. Also guards replacing or
+    // dropping the incoming/upcoming tracks off the audio thread. Taken after prepareLock.
+    juce::CriticalSection requestLock;
+    juce::File requestedFile, queuedFile;
+    TrackSource::Loudness requestedLoudness, queuedLoudness;
+    int requestId = 0, loadedRequestId = 0;
+    int queuedRequestId = 0, loadedQueuedRequestId = 0;
+    std::unique_ptr<TrackSource> cancelledTrack;  // Preload dropped by loadTrack(), deleted by the loader
+
+    // Guards device settings against the loader preparing a track at the same time (never the audio thread).
+    // Only written while the device is stopped, so the audio thread reads them directly.
+    juce::CriticalSection prepareLock;
+    int preparedBlockSize = 512;
+    double preparedSampleRate = 0.0;
+
+    // Track handoff: loader -> audio thread -> garbage thread
+    std::atomic<TrackSource*> incoming { nullptr };  // Play now
+    std::atomic<TrackSource*> upcoming { nullptr };  // Play when the current track ends
+    TrackSource* current = nullptr;        // Audio thread only
+    TrackSource* outgoing = nullptr;       // Audio thread only - fading out under current
+    TrackSource* finishedTrack = nullptr;  // Audio thread only
+    TrackSource* retired[retireCapacity] = {};
+    juce::AbstractFifo retireFifo { retireCapacity };
+
+    juce::AudioBuffer<float> fadeBuffer;
+    float lastGain = 0.0f, outgoingGain = 1.0f;
+    int fadeLength = 1, fadePosition = 0;
+    double appliedPitchSemitones = 0.0;
+    int appliedResamplerQuality = -1;
+    int appliedKeyLock = -1;
+
+    std::atomic<bool> playing { false }, streamFinished { false }, skipRequested { false }, keyLockEnabled { false };
+    std::atomic<bool> changePending { false };  // Set by the audio thread, cleared by timerCallback()
+    std::atomic<juce::int64> pendingSeek { -1 };
+    std::atomic<double> pitchSemitones { 0.0 }, readAheadSeconds { 2.0 }, crossfadeSeconds { 0.0 };
+    std::atomic<int> numTransitions { 0 };
+    std::atomic<int> resamplerQuality { static_cast<int> (QualityResamplingSource::Quality::sinc) };
+
+    // Snapshot of the current track for the message thread
+    std::atomic<juce::int64> publishedPosition { 0 }, publishedLength { 0 };
+    std::atomic<double> publishedFileRate { 0.0 }, publishedKeyLockLatency { 0.0 };
+    std::atomic<int> publishedUnderruns { 0 };
+    std::atomic<juce::int64> publishedUnderrunSamples { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackDeck)
+};
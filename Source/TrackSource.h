@@ -0,0 +1,224 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "DecodedAudioSource.h"
+#include "KeyLockSource.h"
+#include "ReadAheadAudioSource.h"
+#include "SmoothResamplingSource.h"
+#include "TranscodeCache.h"
+
+//==============================================================================
+/**
+ * One loaded track: file reader -> read-ahead decode buffer -> key lock
+ * -> one resampler for both the pitch and the conversion to the device rate.
+ * A track that's already in the DecodedTrackCache plays from memory instead
+ * of the reader and read-ahead buffer, and one with a TranscodeCache file is
+ * read memory-mapped from that rather than decoded again.
+ *
+ * Opened, prepared and primed off the audio thread by TrackDeck, then handed
+ * to the audio callback as a single pointer. Seeking and pitch changes are
+ * safe to call from the audio thread once the track has been handed over.
+ */
+class TrackSource : public juce::PositionableAudioSource
+{
+public:
+    // Measured ahead of time by the library analysis, for loudness normalisation
+    struct Loudness
+    {
+        float lufs = 0.0f;         // Integrated loudness
+        float peak = 1.0f;         // Sample peak, 1 = full scale
+        bool isMeasured = false;
+    };
+
+    // Returns nullptr if the file can't be decoded
+    static std::unique_ptr<TrackSource> open (juce::AudioFormatManager& formatManager, DecodedTrackCache& cache,
+                                              TranscodeCache& transcodes, const juce::File& file,
+                                              juce::TimeSliceThread& readAheadThread, double readAheadSeconds,
+                                              juce::TimeSliceThread& keyLockThread)
+    {
+        if (auto decoded = cache.find (file))
+            return std::unique_ptr<TrackSource> (new TrackSource (file, std::move (decoded), keyLockThread));
+
+        if (auto mapped = transcodes.createMappedReaderFor (file))
+            return std::unique_ptr<TrackSource> (new TrackSource (file, mapped.release(), true, readAheadThread,
+                                                                  readAheadSeconds, keyLockThread));
+
+        auto* reader = formatManager.createReaderFor (file);
+
+        if (reader == nullptr)
+            return {};
+
+        return std::unique_ptr<TrackSource> (new TrackSource (file, reader, false, readAheadThread, readAheadSeconds, keyLockThread));
+    }
+
+    ~TrackSource() override
+    {
+        releaseResources();
+    }
+
+    const juce::File& getFile() const noexcept  { return file; }
+    double getFileSampleRate() const noexcept   { return fileSampleRate; }
+    double getPreparedSampleRate() const noexcept { return preparedSampleRate; }
+    int getPreparedBlockSize() const noexcept   { return preparedBlockSize; }
+
+    // True if the whole track came out of the decoded cache, so the decoder isn't involved at all
+    bool isPlayingFromMemory() const noexcept   { return decodedSource != nullptr; }
+
+    // Set before the track is handed to the audio thread
+    void setLoudness (const Loudness& newLoudness) noexcept  { loudness = newLoudness; }
+    const Loudness& getLoudness() const noexcept             { return loudness; }
+
+    // True if the reader is mapped over a TranscodeCache file rather than decoding the original
+    bool isPlayingFromTranscode() const noexcept  { return playingFromTranscode; }
+
+    void setPitchSemitones (double semitones)
+    {
+        pitchShifter->setPitchSemitones (semitones);
+
+        // Stretch by as much as the resampler shortens, so key-locked playback keeps its tempo
+        keyLock->setTempo (1.0 / pitchShifter->getPitchRatio());
+    }
+
+    // Pitch changes the key but not the tempo. Crossfades over a few milliseconds from the next block.
+    void setKeyLockEnabled (bool shouldBeEnabled)
+    {
+        keyLock->setEnabled (shouldBeEnabled);
+    }
+
+    // Source samples the key lock reads ahead of what's heard
+    int getKeyLockLatencySamples() const noexcept  { return keyLock->getLatencySamples(); }
+
+    void setResamplerQuality (QualityResamplingSource::Quality quality)
+    {
+        pitchShifter->setQuality (quality);
+    }
+
+    // Decode far enough ahead that the first callbacks never underrun. Background threads only.
+    bool prime (double seconds, int timeoutMs)
+    {
+        if (readAheadSource == nullptr)
+            return true;  // Already decoded
+
+        return readAheadSource->waitUntilPrimed (static_cast<int> (seconds * fileSampleRate), timeoutMs);
+    }
+
+    // Read-ahead and key-lock stretcher underruns together
+    int getNumUnderruns() const noexcept
+    {
+        return (readAheadSource != nullptr ? readAheadSource->getNumUnderruns() : 0) + keyLock->getNumUnderruns();
+    }
+
+    juce::int64 getNumUnderrunSamples() const noexcept
+    {
+        return (readAheadSource != nullptr ? readAheadSource->getNumUnderrunSamples() : 0) + keyLock->getNumUnderrunSamples();
+    }
+
+    //==============================================================================
+    void prepareToPlay (int samplesPerBlockExpected, double deviceSampleRate) override
+    {
+        preparedSampleRate = deviceSampleRate;
+        preparedBlockSize = samplesPerBlockExpected;
+
+        // The file-rate correction rides along with the pitch ratio instead of being a second resampling pass
+        pitchShifter->setSampleRateRatio (deviceSampleRate > 0.0 ? fileSampleRate / deviceSampleRate : 1.0);
+        pitchShifter->prepareToPlay (samplesPerBlockExpected, deviceSampleRate);
+
+        isPrepared = true;
+    }
+
+    void releaseResources() override
+    {
+        if (! isPrepared)
+            return;
+
+        isPrepared = false;
+        pitchShifter->releaseResources();
+    }
+
+    void getNextAudioBlock (const juce::AudioSourceChannelInfo& info) override
+    {
+        pitchShifter->getNextAudioBlock (info);
+
+        // The resampler advances by exactly this much, so the deck can find the
+        // sample where the track ends without waiting for the read-ahead to run dry
+        playbackPosition += info.numSamples * getSourceSamplesPerOutputSample();
+    }
+
+    // Output samples left before the end of the file at the current pitch
+    juce::int64 getNumOutputSamplesRemaining() const
+    {
+        auto sourceSamplesLeft = static_cast<double> (getTotalLength()) - playbackPosition;
+        return static_cast<juce::int64> (std::ceil (juce::jmax (0.0, sourceSamplesLeft)
+                                                    / getSourceSamplesPerOutputSample()));
+    }
+
+    //==============================================================================
+    void setNextReadPosition (juce::int64 newPosition) override
+    {
+        pitchShifter->setNextReadPosition (newPosition);
+        playbackPosition = static_cast<double> (newPosition);
+    }
+
+    // Position of the audio actually output so far, not how far the decoder has read ahead
+    juce::int64 getNextReadPosition() const override { return static_cast<juce::int64> (playbackPosition); }
+    juce::int64 getTotalLength() const override      { return pitchShifter->getTotalLength(); }
+    bool isLooping() const override                  { return pitchShifter->isLooping(); }
+
+private:
+    TrackSource (const juce::File& sourceFile, juce::AudioFormatReader* reader, bool isTranscode,
+                 juce::TimeSliceThread& readAheadThread, double readAheadSeconds,
+                 juce::TimeSliceThread& keyLockThread)
+        : file (sourceFile),
+          fileSampleRate (reader->sampleRate),
+          playingFromTranscode (isTranscode)
+    {
+        readerSource.reset (new juce::AudioFormatReaderSource (reader, true));
+
+        // Decode (or take the page faults) on the read-ahead thread so the audio callback only copies PCM
+        readAheadSource.reset (new ReadAheadAudioSource (readerSource.get(), false, readAheadThread,
+                                                         reader->sampleRate, readAheadSeconds,
+                                                         static_cast<int> (reader->numChannels)));
+
+        createPitchStages (readAheadSource.get(), keyLockThread);
+    }
+
+    TrackSource (const juce::File& sourceFile, DecodedTrackCache::TrackPtr decoded, juce::TimeSliceThread& keyLockThread)
+        : file (sourceFile),
+          fileSampleRate (decoded->sampleRate)
+    {
+        decodedSource.reset (new DecodedAudioSource (std::move (decoded)));
+        createPitchStages (decodedSource.get(), keyLockThread);
+    }
+
+    void createPitchStages (juce::PositionableAudioSource* decodedAudio, juce::TimeSliceThread& keyLockThread)
+    {
+        // Pass-through until key lock is switched on, then SoundTouch stretches on its own thread
+        keyLock.reset (new KeyLockSource (decodedAudio, false, keyLockThread, fileSampleRate));
+
+        // Pitch and file-to-device rate conversion in a single resampler
+        pitchShifter.reset (new SmoothResamplingSource (keyLock.get(), false));
+    }
+
+    juce::File file;
+    double fileSampleRate;
+    bool playingFromTranscode = false;
+    Loudness loudness;
+    double preparedSampleRate = 0.0;
+    int preparedBlockSize = 0;
+    bool isPrepared = false;
+    double playbackPosition = 0.0;  // In source samples, audio thread only once handed over
+
+    // Declared in signal order so each stage is destroyed before the one it reads from
+    std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
+    std::unique_ptr<ReadAheadAudioSource> readAheadSource;
+    std::unique_ptr<DecodedAudioSource> decodedSource;        // Instead of the two above when cached
+    std::unique_ptr<KeyLockSource> keyLock;                   // Tempo-preserving stretch when key lock is on
+    std::unique_ptr<SmoothResamplingSource> pitchShifter;     // Turntable pitch and file rate -> device rate
+
+    double getSourceSamplesPerOutputSample() const
+    {
+        return juce::jmax (1.0e-6, pitchShifter->getResamplingRatio() * keyLock->getInputSamplesPerOutputSample());
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TrackSource)
+};
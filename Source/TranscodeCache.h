@@ -0,0 +1,305 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include "DecodedTrackCache.h"
+
+//==============================================================================
+/**
+ * Tracks transcoded once to float WAV files on disk, then played memory-mapped
+ *
+ * Reading a transcode is page faults into the file rather than AAC decoding,
+ * so a track that has been played before opens and streams almost for free.
+ * Files are named after the source's path, size and modification time: an
+ * edited source gets a new transcode and the stale one ages out.
+ *
+ * Transcoding runs on the cache's own low-priority thread into a temporary
+ * file that's renamed once complete, so a half-written file is never opened.
+ * The folder is kept under its size limit by deleting the transcodes that
+ * were played least recently.
+ *
+ * A transcode can also hand the track on to a DecodedTrackCache once it's
+ * written, which then reads the transcode rather than decoding the original
+ * a second time.
+ *
+ * Does nothing until setDirectory() is given a folder.
+ */
+class TranscodeCache
+{
+public:
+    static constexpr juce::int64 defaultSizeLimit = (juce::int64) 2048 * 1024 * 1024;  // Around twenty four-minute stereo tracks
+
+    explicit TranscodeCache (juce::AudioFormatManager& formatManagerToUse)
+        : formatManager (formatManagerToUse),
+          transcoder (*this)
+    {
+        transcoder.startThread (juce::Thread::Priority::background);
+    }
+
+    ~TranscodeCache()
+    {
+        transcoder.stopThread (4000);
+    }
+
+    // An empty File switches the cache off. Shrinking the limit deletes old transcodes straight away.
+    void setDirectory (const juce::File& newDirectory, juce::int64 sizeLimitBytes = defaultSizeLimit)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+            directory = newDirectory;
+            sizeLimit = sizeLimitBytes;
+            pendingFiles.clear();
+            pendingPrefetches.clear();
+
+            if (directory != juce::File())
+                directory.createDirectory();
+        }
+
+        trimToSizeLimit();
+    }
+
+    juce::File getDirectory() const
+    {
+        const juce::ScopedLock sl (lock);
+        return directory;
+    }
+
+    // A memory-mapped reader over the file's transcode, or nullptr if there isn't one (yet)
+    std::unique_ptr<juce::AudioFormatReader> createMappedReaderFor (const juce::File& file)
+    {
+        auto transcode = getTranscodeFile (file);
+
+        if (! transcode.existsAsFile())
+            return {};
+
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader (wavFormat.createMemoryMappedReader (transcode));
+
+        if (reader == nullptr || ! reader->mapEntireFile())
+            return {};
+
+        // The modification time doubles as "last played" for trimming
+        transcode.setLastModificationTime (juce::Time::getCurrentTime());
+        return reader;
+    }
+
+    // The file's finished transcode, or File() if there isn't one (yet)
+    juce::File findTranscode (const juce::File& file) const
+    {
+        auto transcode = getTranscodeFile (file);
+        return transcode.existsAsFile() ? transcode : juce::File();
+    }
+
+    // Queues a file for transcoding in the background, if it isn't done or queued already.
+    // Once the transcode exists, 'thenPrefetchInto' (which must outlive this cache) is given
+    // the track to decode from it. Returns false, doing nothing, if transcoding is switched off.
+    bool transcode (const juce::File& file, DecodedTrackCache* thenPrefetchInto = nullptr)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (directory == juce::File())
+                return false;
+
+            auto queued = pendingFiles.indexOf (file);
+
+            if (queued >= 0)
+            {
+                if (thenPrefetchInto != nullptr)
+                    pendingPrefetches.set (queued, thenPrefetchInto);
+
+                return true;
+            }
+
+            pendingFiles.add (file);
+            pendingPrefetches.add (thenPrefetchInto);
+        }
+
+        transcoder.notify();
+        return true;
+    }
+
+private:
+    //==============================================================================
+    class Transcoder : public juce::Thread
+    {
+    public:
+        explicit Transcoder (TranscodeCache& c) : juce::Thread ("Track Transcoder"), cache (c) {}
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                wait (-1);
+
+                while (! threadShouldExit() && cache.transcodeNextPending())
+                {
+                }
+            }
+        }
+
+    private:
+        TranscodeCache& cache;
+    };
+
+    //==============================================================================
+    // Transcoder thread: returns true if there was a file to transcode, so the rest of the queue gets done too
+    bool transcodeNextPending()
+    {
+        juce::File file;
+        DecodedTrackCache* prefetchInto = nullptr;
+
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (pendingFiles.isEmpty())
+                return false;
+
+            file = pendingFiles.removeAndReturn (0);
+            prefetchInto = pendingPrefetches.removeAndReturn (0);
+        }
+
+        auto target = getTranscodeFile (file);
+
+        if (target == juce::File())
+            return true;
+
+        if (! target.existsAsFile())
+        {
+            auto partial = target.withFileExtension ("partial");
+
+            if (writeTranscode (file, partial) && partial.moveFileTo (target))
+            {
+                trimToSizeLimit();
+            }
+            else
+            {
+                partial.deleteFile();
+
+                // Cut short or failed - the cache decodes the original after all
+                if (prefetchInto != nullptr && ! transcoder.threadShouldExit())
+                    prefetchInto->prefetch (file);
+
+                return true;
+            }
+        }
+
+        if (prefetchInto != nullptr)
+            prefetchInto->prefetch (file, target);
+
+        return true;
+    }
+
+    bool writeTranscode (const juce::File& source, const juce::File& destination)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (source));
+
+        if (reader == nullptr || reader->lengthInSamples <= 0)
+            return false;
+
+        destination.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream (destination.createOutputStream());
+
+        if (stream == nullptr)
+            return false;
+
+        // 32-bit float keeps the decoder's output exactly
+        auto numChannels = static_cast<int> (juce::jmax (1u, reader->numChannels));
+        std::unique_ptr<juce::AudioFormatWriter> writer (wavFormat.createWriterFor (stream.get(), reader->sampleRate,
+                                                                                    static_cast<unsigned int> (numChannels),
+                                                                                    32, {}, 0));
+        if (writer == nullptr)
+            return false;
+
+        stream.release();  // Owned by the writer now
+
+        juce::AudioBuffer<float> buffer (numChannels, chunkSize);
+
+        for (juce::int64 position = 0; position < reader->lengthInSamples; position += chunkSize)
+        {
+            if (transcoder.threadShouldExit())
+                return false;
+
+            auto numThisTime = static_cast<int> (juce::jmin ((juce::int64) chunkSize, reader->lengthInSamples - position));
+
+            if (! reader->read (&buffer, 0, numThisTime, position, true, true)
+                 || ! writer->writeFromAudioSampleBuffer (buffer, 0, numThisTime))
+                return false;
+        }
+
+        return writer->flush();
+    }
+
+    // Deletes the least recently played transcodes until the folder fits the limit
+    void trimToSizeLimit()
+    {
+        juce::File folder;
+        juce::int64 limit;
+
+        {
+            const juce::ScopedLock sl (lock);
+            folder = directory;
+            limit = sizeLimit;
+        }
+
+        if (folder == juce::File())
+            return;
+
+        auto transcodes = folder.findChildFiles (juce::File::findFiles, false, "*.wav");
+        juce::int64 total = 0;
+
+        for (auto& f : transcodes)
+            total += f.getSize();
+
+        std::sort (transcodes.begin(), transcodes.end(), [] (const juce::File& a, const juce::File& b)
+        {
+            return a.getLastModificationTime() < b.getLastModificationTime();
+        });
+
+        // A transcode that's playing can't be deleted on every platform, so just move on if it won't go
+        for (auto& f : transcodes)
+        {
+            if (total <= limit)
+                break;
+
+            auto size = f.getSize();
+
+            if (f.deleteFile())
+                total -= size;
+        }
+    }
+
+    juce::File getTranscodeFile (const juce::File& source) const
+    {
+        juce::File folder;
+
+        {
+            const juce::ScopedLock sl (lock);
+            folder = directory;
+        }
+
+        if (folder == juce::File())
+            return {};
+
+        auto key = source.getFullPathName() + "|" + juce::String (source.getSize())
+                     + "|" + juce::String (source.getLastModificationTime().toMilliseconds());
+
+        return folder.getChildFile (juce::String::toHexString (key.hashCode64()) + ".wav");
+    }
+
+    //==============================================================================
+    static constexpr int chunkSize = 65536;
+
+    juce::AudioFormatManager& formatManager;
+    juce::WavAudioFormat wavFormat;
+
+    juce::CriticalSection lock;
+    juce::File directory;
+    juce::int64 sizeLimit = defaultSizeLimit;
+    juce::Array<juce::File> pendingFiles;
+    juce::Array<DecodedTrackCache*> pendingPrefetches;  // Side by side with pendingFiles, may be nullptr
+
+    Transcoder transcoder;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TranscodeCache)
+};
@@ -0,0 +1,215 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Times the whole Distortion::process at 1x, 2x, 4x and 8x oversampling,
+/// juce::dsp::Oversampling's up and down filters included. First checks that
+/// each factor delays a quiet tone by exactly the latency it reports, and that
+/// switching factor crossfades between the old and new paths without the new
+/// one fading in from silence.
+///
+///   DistortionBench            checks and benchmark
+///   DistortionBench --check    checks only
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include <JuceHeader.h>
+#include "Distortion.h"
+#include "BenchTools.h"
+
+#define SAMPLE_RATE     48000
+#define BLOCK           512
+
+// Check tone, quiet enough that the shaper is linear to 1e-4, and the largest
+// error against the expected output, relative to its level. The half-band
+// filters ripple a little even well inside their passband.
+#define TONE_HZ         1000
+#define TONE_LEVEL      0.01
+#define TONE_TOLERANCE  0.01
+
+static const int factors[] = { 1, 2, 4, 8 };
+
+
+// The check tone from sample 'start' on, a sample later in the right channel
+static void fillTone(juce::AudioBuffer<float> &buffer, long start)
+{
+    for (int ch = 0; ch < buffer.getNumChannels(); ch ++)
+    {
+        for (int i = 0; i < buffer.getNumSamples(); i ++)
+        {
+            buffer.setSample(ch, i, (float)(TONE_LEVEL * sin(2 * M_PI * TONE_HZ * (start + i - ch) / SAMPLE_RATE)));
+        }
+    }
+}
+
+
+// Stereo Distortion at 'factor', fully wet unless 'mix' says otherwise
+static Distortion *newDistortion(int factor, float drive, float mix)
+{
+    Distortion *d = new Distortion();
+
+    d->prepare({ SAMPLE_RATE, BLOCK, 2 });
+    d->setOversamplingFactor(factor);
+    d->setDrive(drive);
+    d->setMix(mix);
+    d->reset();
+    return d;
+}
+
+
+// Largest difference between the output of 'factor' and the tone delayed by
+// its reported latency, after the filters have settled, relative to the tone
+static double latencyError(int factor)
+{
+    Distortion *d = newDistortion(factor, 1.0f, 1.0f);
+    juce::AudioBuffer<float> buffer(2, BLOCK), expected(2, BLOCK);
+    int latency = d->getLatencySamples();
+    double err = 0;
+
+    for (int b = 0; b < 20; b ++)
+    {
+        juce::dsp::AudioBlock<float> block(buffer);
+
+        fillTone(buffer, (long)b * BLOCK);
+        fillTone(expected, (long)b * BLOCK - latency);
+        d->process(block);
+
+        for (int ch = 0; ch < 2 && b >= 4; ch ++)
+        {
+            for (int i = 0; i < BLOCK; i ++)
+            {
+                double e = fabs(buffer.getSample(ch, i) - expected.getSample(ch, i)) / TONE_LEVEL;
+                if (!(e <= err)) err = e;      // NaN sticks
+            }
+        }
+    }
+    delete d;
+    return err;
+}
+
+
+// Largest difference, in the block where the factor switches from 'from' to
+// 'to', between the output and a crossfade from the tone delayed by one
+// latency to the tone delayed by the other, relative to the tone
+static double switchError(int from, int to)
+{
+    Distortion *d = newDistortion(from, 1.0f, 1.0f);
+    juce::AudioBuffer<float> buffer(2, BLOCK), before(2, BLOCK), after(2, BLOCK);
+    int latencyBefore = d->getLatencySamples(from);
+    int latencyAfter = d->getLatencySamples(to);
+    double err = 0;
+
+    for (int b = 0; b <= 8; b ++)
+    {
+        juce::dsp::AudioBlock<float> block(buffer);
+
+        if (b == 8) d->setOversamplingFactor(to);
+        fillTone(buffer, (long)b * BLOCK);
+        d->process(block);
+    }
+
+    fillTone(before, 8L * BLOCK - latencyBefore);
+    fillTone(after, 8L * BLOCK - latencyAfter);
+    for (int ch = 0; ch < 2; ch ++)
+    {
+        for (int i = 0; i < BLOCK; i ++)
+        {
+            double fade = (double)i / BLOCK;
+            double expected = before.getSample(ch, i) + fade * (after.getSample(ch, i) - before.getSample(ch, i));
+            double e = fabs(buffer.getSample(ch, i) - expected) / TONE_LEVEL;
+            if (!(e <= err)) err = e;
+        }
+    }
+    delete d;
+    return err;
+}
+
+
+// Fastest of five runs of 'seconds' of 'music' through 'factor', in ns per
+// stereo frame. With 'switchTo' the factor alternates with that one every 40
+// blocks.
+static double timeFactor(int factor, int switchTo, const juce::AudioBuffer<float> &music, int seconds)
+{
+    const int blocks = seconds * SAMPLE_RATE / BLOCK;
+    const int musicBlocks = music.getNumSamples() / BLOCK;
+    juce::AudioBuffer<float> buffer(2, BLOCK);
+    double best = 1e30;
+
+    for (int r = 0; r < 5; r ++)
+    {
+        Distortion *d = newDistortion(factor, 5.0f, 0.5f);
+        double elapsed = 0;
+
+        for (int b = 0; b < blocks; b ++)
+        {
+            juce::dsp::AudioBlock<float> block(buffer);
+            double start;
+
+            for (int ch = 0; ch < 2; ch ++)
+            {
+                buffer.copyFrom(ch, 0, music, ch, (b % musicBlocks) * BLOCK, BLOCK);
+            }
+            if (switchTo && b % 40 == 0)
+            {
+                d->setOversamplingFactor(((b / 40) & 1) ? switchTo : factor);
+            }
+
+            start = bench::now();
+            d->process(block);
+            elapsed += bench::now() - start;
+        }
+        delete d;
+
+        if (elapsed < best) best = elapsed;
+    }
+    return best * 1e9 / ((double)blocks * BLOCK);
+}
+
+
+int main(int argc, char **argv)
+{
+    bool timing = !bench::checkOnly(argc, argv);
+    int failures = 0;
+
+    for (int factor : factors)
+    {
+        double e = latencyError(factor);
+        failures += !bench::check(e <= TONE_TOLERANCE, "%dx delays by its latency, max error %.1e of the tone",
+                                  factor, e);
+    }
+    for (int factor : factors)
+    {
+        for (int other : factors)
+        {
+            double e;
+
+            if (other == factor) continue;
+            e = switchError(factor, other);
+            failures += !bench::check(e <= TONE_TOLERANCE, "%dx to %dx crossfades cleanly, max error %.1e of the tone",
+                                      factor, other, e);
+        }
+    }
+
+    if (timing)
+    {
+        std::vector<float> interleaved = bench::music(SAMPLE_RATE, 4);
+        juce::AudioBuffer<float> music(2, (int)interleaved.size() / 2);
+        const int seconds = 10;
+
+        for (int i = 0; i < music.getNumSamples(); i ++)
+        {
+            music.setSample(0, i, interleaved[2 * (size_t)i]);
+            music.setSample(1, i, interleaved[2 * (size_t)i + 1]);
+        }
+
+        printf("stereo, %d Hz, %d-frame blocks, drive 5, mix 0.5, ns per frame, best of 5:\n", SAMPLE_RATE, BLOCK);
+        for (int factor : factors)
+        {
+            Distortion *d = newDistortion(factor, 1.0f, 1.0f);
+            printf("  %dx   %7.1f   latency %d samples\n", factor, timeFactor(factor, 0, music, seconds),
+                   d->getLatencySamples());
+            delete d;
+        }
+        printf("  1x and 8x switching every 40 blocks  %7.1f\n", timeFactor(1, 8, music, seconds));
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Measures the interpolation kernels QualityResamplingSource picks between
+/// (ResamplingKernels.h): how much of a tone above the output's Nyquist
+/// survives nearly an octave up as aliasing, how loud the image of a tone is
+/// an octave down, how flat the passband is, and how long each takes per
+/// stereo output frame.
+///
+///   ResamplerBench            checks and benchmark
+///   ResamplerBench --check    checks only
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "ResamplingKernels.h"
+#include "BenchTools.h"
+
+typedef ResamplingKernels::Quality Quality;
+
+#define SAMPLE_RATE     44100
+#define OUTPUT_FRAMES   65536
+
+// Ratios as QualityResamplingSource takes them: source samples per output
+// sample. Up is just short of an octave, so that the read positions fall
+// between samples.
+#define RATIO_UP        1.9
+#define RATIO_DOWN      0.5
+#define MAXIMUM_RATIO   8.0
+
+// Sinc has to keep the aliasing at least this far below linear's, and this low
+#define SINC_MIN_ALIAS_GAIN_DB  40.0
+#define SINC_MAX_ALIAS_DB       -60.0
+
+static const char *qualityNames[] = { "linear", "cubic", "shannon", "sinc" };
+
+
+// Resamples the planar channels of 'in' at a steady 'ratio', the way
+// QualityResamplingSource::renderChunk does: one set of weights per output
+// frame, shared by the channels
+static std::vector<std::vector<float>> resample(const std::vector<std::vector<float>> &in, double ratio,
+                                                Quality quality, int frames)
+{
+    static const int halfWidth = ResamplingKernels::getHalfWidth(MAXIMUM_RATIO);
+    std::vector<float> weights(2 * halfWidth + 4);
+    std::vector<std::vector<float>> out(in.size(), std::vector<float>(frames));
+    float scale = ResamplingKernels::getSincScale(ratio);
+    double position = halfWidth;
+
+    for (int i = 0; i < frames; i ++)
+    {
+        int index = (int)position;
+        ResamplingKernels::Taps taps;
+
+        taps = ResamplingKernels::computeWeights(quality, (float)(position - index), scale, weights.data());
+        for (size_t ch = 0; ch < in.size(); ch ++)
+        {
+            out[ch][i] = ResamplingKernels::dotProduct(in[ch].data() + index + taps.first, weights.data(), taps.count);
+        }
+        position += ratio;
+    }
+    return out;
+}
+
+
+// Sine of 'hz' at SAMPLE_RATE, long enough for OUTPUT_FRAMES at 'ratio'
+static std::vector<std::vector<float>> tone(double hz, double ratio)
+{
+    int frames = (int)(OUTPUT_FRAMES * ratio) + 4 * ResamplingKernels::getHalfWidth(MAXIMUM_RATIO);
+    std::vector<std::vector<float>> s(1, std::vector<float>(frames));
+
+    for (int i = 0; i < frames; i ++)
+    {
+        s[0][i] = (float)sin(2 * M_PI * hz * i / SAMPLE_RATE);
+    }
+    return s;
+}
+
+
+// Level of 'hz' in 'x', Hann windowed, relative to a full-scale sine
+static double levelAt(const std::vector<float> &x, double hz)
+{
+    double w = 2 * M_PI * hz / SAMPLE_RATE;
+    double c = 2 * cos(w);
+    double s1 = 0, s2 = 0;
+    size_t n = x.size();
+
+    for (size_t i = 0; i < n; i ++)
+    {
+        double window = 0.5 - 0.5 * cos(2 * M_PI * i / (n - 1));
+        double s = x[i] * window + c * s1 - s2;
+        s2 = s1;
+        s1 = s;
+    }
+    // a Hann window halves a sine's amplitude, and the sum scales it by n / 2
+    return sqrt(s1 * s1 + s2 * s2 - c * s1 * s2) / (n / 4.0);
+}
+
+
+static double rmsOf(const std::vector<float> &x)
+{
+    double sum = 0;
+
+    for (float v : x) sum += (double)v * v;
+    return sqrt(sum / x.size());
+}
+
+
+static double dB(double gain)
+{
+    return 20 * log10(gain + 1e-12);
+}
+
+
+struct KernelStats
+{
+    double aliasDb;     ///< what's left of a 15 kHz tone at RATIO_UP, where it's all above Nyquist
+    double imageDb;     ///< image of a 15 kHz tone at RATIO_DOWN, against the tone itself
+    double passbandDb;  ///< level of a 5 kHz tone at RATIO_UP
+};
+
+
+static KernelStats measure(Quality quality)
+{
+    KernelStats stats;
+    std::vector<std::vector<float>> out;
+
+    // everything above 22050 / 1.9 Hz has nowhere to go but fold back down
+    out = resample(tone(15000, RATIO_UP), RATIO_UP, quality, OUTPUT_FRAMES);
+    stats.aliasDb = dB(rmsOf(out[0]) / sqrt(0.5));
+
+    // at half speed 15 kHz plays at 7.5 kHz, and the image of the source's
+    // spectrum above its Nyquist lands at (44100 - 15000) / 2
+    out = resample(tone(15000, RATIO_DOWN), RATIO_DOWN, quality, OUTPUT_FRAMES);
+    stats.imageDb = dB(levelAt(out[0], (SAMPLE_RATE - 15000) / 2.0) / levelAt(out[0], 7500));
+
+    out = resample(tone(5000, RATIO_UP), RATIO_UP, quality, OUTPUT_FRAMES);
+    stats.passbandDb = dB(rmsOf(out[0]) / sqrt(0.5));
+    return stats;
+}
+
+
+// Fastest of five stereo runs at 'ratio', in ns per output frame
+static double timeKernel(Quality quality, double ratio, const std::vector<std::vector<float>> &music)
+{
+    int frames = (int)((music[0].size() - 4 * ResamplingKernels::getHalfWidth(MAXIMUM_RATIO)) / ratio);
+    double best = 1e30;
+    volatile float sink = 0;
+
+    for (int r = 0; r < 5; r ++)
+    {
+        double start = bench::now();
+        std::vector<std::vector<float>> out = resample(music, ratio, quality, frames);
+        double t = (bench::now() - start) / frames;
+
+        if (t < best) best = t;
+        sink += out[0][frames / 2];
+    }
+    return best * 1e9;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool timing = !bench::checkOnly(argc, argv);
+    KernelStats stats[4];
+    bool finite = true;
+    int failures = 0;
+
+    printf("kernels, %d Hz, %d output frames, up %.2f, down %.2f:\n", SAMPLE_RATE, OUTPUT_FRAMES,
+           RATIO_UP, RATIO_DOWN);
+    for (int q = 0; q < 4; q ++)
+    {
+        stats[q] = measure((Quality)q);
+        printf("  %-8s up: alias %7.1f dB  5 kHz %+6.2f dB   down: image %7.1f dB\n",
+               qualityNames[q], stats[q].aliasDb, stats[q].passbandDb, stats[q].imageDb);
+        finite = finite && std::isfinite(stats[q].aliasDb + stats[q].passbandDb + stats[q].imageDb);
+    }
+
+    failures += !bench::check(finite, "every kernel's output is finite");
+    failures += !bench::check(stats[3].aliasDb <= stats[0].aliasDb - SINC_MIN_ALIAS_GAIN_DB &&
+                              stats[3].aliasDb <= SINC_MAX_ALIAS_DB,
+                              "sinc aliases %.1f dB less than linear", stats[0].aliasDb - stats[3].aliasDb);
+    failures += !bench::check(stats[3].imageDb < stats[0].imageDb,
+                              "sinc images %.1f dB less than linear", stats[0].imageDb - stats[3].imageDb);
+
+    if (timing)
+    {
+        std::vector<float> interleaved = bench::music(SAMPLE_RATE, 10);
+        std::vector<std::vector<float>> music(2, std::vector<float>(interleaved.size() / 2));
+        static const double ratios[] = { 1.0594630944, 1.189207115, 1.8877486254, 0.7491535384 };
+
+        for (size_t i = 0; i < music[0].size(); i ++)
+        {
+            music[0][i] = interleaved[2 * i];
+            music[1][i] = interleaved[2 * i + 1];
+        }
+
+        printf("stereo, ns per output frame, best of 5:\n");
+        printf("  %-8s  +1 st   +3 st  +11 st   -5 st\n", "");
+        for (int q = 0; q < 4; q ++)
+        {
+            printf("  %-8s", qualityNames[q]);
+            for (double ratio : ratios)
+            {
+                printf(" %6.1f ", timeKernel((Quality)q, ratio, music));
+            }
+            printf("\n");
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,256 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Compares StereoDelay with the per-sample juce::dsp::DelayLine loop it
+/// replaced: checks that both give the same output at a steady delay time,
+/// including one shorter than a block, then times them per sample with the
+/// time steady and while it glides, and StereoDelay's ping-pong and filtered
+/// feedback modes.
+///
+///   StereoDelayBench            checks and benchmark
+///   StereoDelayBench --check    checks only
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include <JuceHeader.h>
+#include "StereoDelay.h"
+#include "BenchTools.h"
+
+#define SAMPLE_RATE     48000
+#define BLOCK           512
+#define MAXIMUM_DELAY   3.0
+
+// Largest difference from the DelayLine output that counts as the same. The
+// steps are the same, but JUCE's vector operations may fuse the wet/dry mix.
+#define MATCH_TOLERANCE 1e-5
+
+// Seconds the EffectsProcessor smoothers take to reach a new value
+#define TIME_RAMP       0.2
+#define LEVEL_RAMP      0.05
+
+
+struct DelaySettings
+{
+    float seconds, feedback, mix;
+    bool glide;         ///< switch the time between 0.2 and 0.5 s every 40 blocks
+    bool pingPong, filtered;
+};
+
+
+/// The delay as EffectsProcessor::processDelay ran it before StereoDelay:
+/// every parameter smoothed per sample, and a pop and a push per sample and
+/// channel
+class DelayLineEffect
+{
+public:
+    DelayLineEffect(const DelaySettings &settings)
+    {
+        juce::dsp::ProcessSpec spec { SAMPLE_RATE, BLOCK, 2 };
+
+        delayLine.prepare(spec);
+        delayLine.setMaximumDelayInSamples((int)(SAMPLE_RATE * MAXIMUM_DELAY));
+        time.reset(SAMPLE_RATE, TIME_RAMP);
+        feedback.reset(SAMPLE_RATE, LEVEL_RAMP);
+        mix.reset(SAMPLE_RATE, LEVEL_RAMP);
+        time.setCurrentAndTargetValue(settings.seconds);
+        feedback.setCurrentAndTargetValue(settings.feedback);
+        mix.setCurrentAndTargetValue(settings.mix);
+    }
+
+    void setTime(float seconds) { time.setTargetValue(seconds); }
+
+    void process(juce::dsp::AudioBlock<float> &block)
+    {
+        for (size_t i = 0; i < block.getNumSamples(); i ++)
+        {
+            float delaySamples = time.getNextValue() * (float)SAMPLE_RATE;
+            float feedbackGain = feedback.getNextValue();
+            float wet = mix.getNextValue();
+
+            for (size_t ch = 0; ch < block.getNumChannels(); ch ++)
+            {
+                float *data = block.getChannelPointer(ch);
+                float input = data[i];
+                float delayed = delayLine.popSample((int)ch, delaySamples);
+
+                delayLine.pushSample((int)ch, input + delayed * feedbackGain);
+                data[i] = input * (1.0f - wet) + delayed * wet;
+            }
+        }
+    }
+
+private:
+    juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Linear> delayLine;
+    juce::SmoothedValue<float> time, feedback, mix;
+};
+
+
+/// StereoDelay as EffectsProcessor runs it: the smoothers advance a block at a
+/// time and StereoDelay ramps across the block
+class StereoDelayEffect
+{
+public:
+    StereoDelayEffect(const DelaySettings &settings)
+    {
+        delay.prepare({ SAMPLE_RATE, BLOCK, 2 }, MAXIMUM_DELAY);
+        time.reset(SAMPLE_RATE, TIME_RAMP);
+        time.setCurrentAndTargetValue(settings.seconds);
+        delay.setDelayTime(settings.seconds);
+        delay.setFeedback(settings.feedback);
+        delay.setMix(settings.mix);
+        delay.setPingPong(settings.pingPong);
+        delay.setFeedbackFiltered(settings.filtered);
+        delay.reset();
+    }
+
+    void setTime(float seconds) { time.setTargetValue(seconds); }
+
+    void process(juce::dsp::AudioBlock<float> &block)
+    {
+        if (time.isSmoothing())
+        {
+            delay.setDelayTime(time.skip((int)block.getNumSamples()));
+        }
+        delay.process(block);
+    }
+
+private:
+    StereoDelay delay;
+    juce::SmoothedValue<float> time;
+};
+
+
+// Runs 'seconds' of 'music' through 'effect' in BLOCK-frame blocks. Returns the
+// time per sample and channel in ns, and the output in 'out' if given.
+template <class Effect> static double run(Effect &effect, const DelaySettings &settings,
+                                          const juce::AudioBuffer<float> &music, int seconds,
+                                          std::vector<float> *out)
+{
+    const int blocks = seconds * SAMPLE_RATE / BLOCK;
+    const int musicBlocks = music.getNumSamples() / BLOCK;
+    juce::AudioBuffer<float> buffer(2, BLOCK);
+    double elapsed = 0;
+
+    for (int b = 0; b < blocks; b ++)
+    {
+        juce::dsp::AudioBlock<float> block(buffer);
+        double start;
+
+        for (int ch = 0; ch < 2; ch ++)
+        {
+            buffer.copyFrom(ch, 0, music, ch, (b % musicBlocks) * BLOCK, BLOCK);
+        }
+        if (settings.glide && b % 40 == 0)
+        {
+            effect.setTime(((b / 40) & 1) ? 0.5f : 0.2f);
+        }
+
+        start = bench::now();
+        effect.process(block);
+        elapsed += bench::now() - start;
+
+        if (out)
+        {
+            for (int ch = 0; ch < 2; ch ++)
+            {
+                out->insert(out->end(), buffer.getReadPointer(ch), buffer.getReadPointer(ch) + BLOCK);
+            }
+        }
+    }
+    return elapsed * 1e9 / ((double)blocks * BLOCK * 2);
+}
+
+
+// Largest of |a[i] - b[i]|
+static double maxAbsError(const std::vector<float> &a, const std::vector<float> &b)
+{
+    double err = 0;
+
+    if (a.size() != b.size()) return 1e30;
+    for (size_t i = 0; i < a.size(); i ++)
+    {
+        double e = fabs((double)a[i] - b[i]);
+        if (!(e <= err)) err = e;      // NaN sticks
+    }
+    return err;
+}
+
+
+// Fastest of five runs of 'seconds'
+template <class Effect> static double bestOfFive(const DelaySettings &settings, const juce::AudioBuffer<float> &music,
+                                                 int seconds)
+{
+    double best = 1e30;
+
+    for (int r = 0; r < 5; r ++)
+    {
+        Effect effect(settings);
+        double t = run(effect, settings, music, seconds, NULL);
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool timing = !bench::checkOnly(argc, argv);
+    std::vector<float> interleaved = bench::music(SAMPLE_RATE, 4);
+    juce::AudioBuffer<float> music(2, (int)interleaved.size() / 2);
+    static const DelaySettings matched[] =
+    {
+        { 0.35031f,   0.5f, 0.4f, false, false, false },
+        { 100.25f / SAMPLE_RATE, 0.7f, 0.6f, false, false, false },   // shorter than a block
+    };
+    int failures = 0;
+
+    for (int i = 0; i < music.getNumSamples(); i ++)
+    {
+        music.setSample(0, i, interleaved[2 * (size_t)i]);
+        music.setSample(1, i, interleaved[2 * (size_t)i + 1]);
+    }
+
+    for (const DelaySettings &settings : matched)
+    {
+        DelayLineEffect before(settings);
+        StereoDelayEffect after(settings);
+        std::vector<float> expected, actual;
+        double e;
+
+        run(before, settings, music, 4, &expected);
+        run(after, settings, music, 4, &actual);
+        e = maxAbsError(actual, expected);
+        failures += !bench::check(e <= MATCH_TOLERANCE, "%.1f sample delay matches DelayLine, max abs error %.1e",
+                                  settings.seconds * SAMPLE_RATE, e);
+    }
+
+    if (timing)
+    {
+        static const struct { const char *name; DelaySettings settings; } cases[] =
+        {
+            { "time steady",        { 0.35f, 0.5f, 0.4f, false, false, false } },
+            { "time gliding",       { 0.35f, 0.5f, 0.4f, true,  false, false } },
+            { "ping-pong",          { 0.35f, 0.5f, 0.4f, false, true,  false } },
+            { "filtered feedback",  { 0.35f, 0.5f, 0.4f, false, false, true  } },
+        };
+        const int seconds = 20;
+
+        printf("stereo, %d Hz, %d-frame blocks, ns per sample, best of 5:\n", SAMPLE_RATE, BLOCK);
+        for (const auto &c : cases)
+        {
+            double after = bestOfFive<StereoDelayEffect>(c.settings, music, seconds);
+
+            // the DelayLine loop has neither mode
+            if (c.settings.pingPong || c.settings.filtered)
+            {
+                printf("  %-20s StereoDelay %5.2f\n", c.name, after);
+            }
+            else
+            {
+                double before = bestOfFive<DelayLineEffect>(c.settings, music, seconds);
+                printf("  %-20s StereoDelay %5.2f   DelayLine %5.2f   %4.1fx\n", c.name, after, before, before / after);
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// The counting hooks that FIFOSampleBuffer calls when it's built with
+/// SOUNDTOUCH_COUNT_BUFFER_OPS.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "BenchTools.h"
+
+bench::BufferCounters bench::counters;
+
+
+void soundtouchCountCopy(unsigned long bytes)
+{
+    bench::counters.copiedBytes += bytes;
+}
+
+
+void soundtouchCountMove(unsigned long bytes)
+{
+    bench::counters.movedBytes += bytes;
+}
+
+
+void soundtouchCountAlloc()
+{
+    bench::counters.allocations ++;
+}
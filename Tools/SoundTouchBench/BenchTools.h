@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Shared helpers for the SoundTouch benchmarks and checks: a clock, test
+/// signals and reporting.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BenchTools_H
+#define BenchTools_H
+
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace bench
+{
+
+/// Seconds on a monotonic clock
+inline double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/// True if the program was asked to run its checks only, as ctest does
+inline bool checkOnly(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i ++)
+    {
+        if (strcmp(argv[i], "--check") == 0) return true;
+    }
+    return false;
+}
+
+
+/// Prints the outcome of a check. Returns 'ok', so that callers can count
+/// the failures and return them from main.
+inline bool check(bool ok, const char *format, ...)
+{
+    va_list args;
+
+    printf(ok ? "  ok    " : "  FAIL  ");
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    return ok;
+}
+
+
+/// Interleaved test signal that behaves like music for the overlap search:
+/// a harmonic tone changing every half second, a noise drum hit on every beat
+/// and a low noise floor. The channels differ slightly.
+inline std::vector<float> music(int sampleRate, int seconds, int channels = 2)
+{
+    static const double notes[] = { 110, 146.8, 164.8, 196, 220, 293.7 };
+    std::mt19937 rng(7);
+    std::normal_distribution<float> gauss(0, 1);
+    int frames = sampleRate * seconds;
+    std::vector<float> s((size_t)frames * channels);
+
+    for (int i = 0; i < frames; i ++)
+    {
+        double t = (double)i / sampleRate;
+        double f = notes[(int)(t * 2) % 6];
+        double tone = 0;
+        double drum;
+
+        for (int h = 1; h <= 6; h ++)
+        {
+            tone += sin(2 * M_PI * f * h * t + h) / h;
+        }
+        drum = exp(-fmod(t, 0.5) * 30) * gauss(rng);
+
+        for (int c = 0; c < channels; c ++)
+        {
+            double gain = 1.0 - 0.1 * c;
+            s[(size_t)i * channels + c] = (float)(0.3 * gain * tone + 0.5 * drum + 0.02 * gauss(rng));
+        }
+    }
+    return s;
+}
+
+
+/// What the FIFOSampleBuffer hooks have counted, see BenchCounters.cpp
+struct BufferCounters
+{
+    unsigned long long copiedBytes; ///< samples copied in by putSamples and out by receiveSamples
+    unsigned long long movedBytes;  ///< samples moved within buffers
+    unsigned long long allocations; ///< buffer (re)allocations
+
+    void reset()
+    {
+        copiedBytes = movedBytes = allocations = 0;
+    }
+};
+
+extern BufferCounters counters;
+
+
+/// Interleaved white noise, independent in each channel
+inline std::vector<float> noise(int frames, int channels, float level, unsigned seed = 2)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gauss(0, level);
+    std::vector<float> s((size_t)frames * channels);
+
+    for (float &v : s) v = gauss(rng);
+    return s;
+}
+
+}
+
+#endif
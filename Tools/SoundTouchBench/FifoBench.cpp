@@ -0,0 +1,230 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Checks FIFOSampleBuffer against a std::deque through random puts and
+/// receives, by copy and through ptrEnd/ptrBegin, and that it stops
+/// allocating once warmed up. Then times steady put/receive traffic and the
+/// whole SoundTouch pipe, counting the bytes the buffers move internally.
+///
+/// FifoBench uses the mirrored ring where the platform has it, and
+/// FifoBenchCopyOnWrap the fallback that copies samples down at the wrap.
+///
+///   FifoBench            checks and benchmark
+///   FifoBench --check    checks only
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include <deque>
+
+#include "FIFOSampleBuffer.h"
+#include "SoundTouch.h"
+#include "BenchTools.h"
+
+using namespace soundtouch;
+
+#define MODEL_STEPS     200000
+#define MAX_BLOCK       3000
+
+
+// Random puts and receives on a buffer of 'channels' channels, each checked
+// against the same on a deque. Returns false at the first difference.
+static bool compareWithDeque(int channels, int steps)
+{
+    FIFOSampleBuffer buffer(channels);
+    std::deque<float> model;
+    std::vector<float> block(MAX_BLOCK * channels);
+    std::mt19937 rng(channels);
+    float next = 0;
+
+    for (int step = 0; step < steps; step ++)
+    {
+        // large blocks first to make the ring grow, then small ones so that it
+        // wraps many times
+        uint n = rng() % (step < steps / 2 ? MAX_BLOCK : MAX_BLOCK / 10);
+        uint count = n * channels;
+
+        switch (rng() % 4)
+        {
+            case 0:     // put by copy
+                for (uint i = 0; i < count; i ++)
+                {
+                    block[i] = next;
+                    model.push_back(next ++);
+                }
+                buffer.putSamples(block.data(), n);
+                break;
+
+            case 1:     // put through ptrEnd
+            {
+                float *end = buffer.ptrEnd(n);
+                for (uint i = 0; i < count; i ++)
+                {
+                    end[i] = next;
+                    model.push_back(next ++);
+                }
+                buffer.putSamples(n);
+                break;
+            }
+
+            case 2:     // receive by copy
+            {
+                uint got = buffer.receiveSamples(block.data(), n);
+                for (uint i = 0; i < got * channels; i ++)
+                {
+                    if (block[i] != model.front()) return false;
+                    model.pop_front();
+                }
+                break;
+            }
+
+            default:    // read through ptrBegin, then drop some
+            {
+                uint have = buffer.numSamples();
+                const float *begin = buffer.ptrBegin();
+                uint drop = (n < have) ? n : have;
+                uint check = (have < 2 * MAX_BLOCK) ? have : 2 * MAX_BLOCK;
+
+                // the start, which is what gets read, and the very last sample
+                for (uint i = 0; i < check * channels; i ++)
+                {
+                    if (begin[i] != model[i]) return false;
+                }
+                if (have && begin[have * channels - 1] != model.back()) return false;
+                buffer.receiveSamples(drop);
+                model.erase(model.begin(), model.begin() + drop * channels);
+                break;
+            }
+        }
+
+        if (buffer.numSamples() * channels != model.size()) return false;
+    }
+    return true;
+}
+
+
+struct Traffic
+{
+    double nsPerFrame;
+    double movedPerFrame;
+    unsigned long long allocations;
+};
+
+
+// Puts and receives 256 stereo frames at a time with 'backlog' frames kept
+// buffered, the way the SoundTouch stages use their buffers. Counts from after
+// the first blocks.
+static Traffic steadyTraffic(uint backlog, int blocks)
+{
+    const uint block = 256;
+    FIFOSampleBuffer buffer(2);
+    std::vector<float> in(2 * block, 0.25f), out(2 * block);
+    Traffic result;
+    double start = 0;
+
+    buffer.putSamples(backlog);
+    for (int b = 0; b < blocks + 16; b ++)
+    {
+        if (b == 16)
+        {
+            bench::counters.reset();
+            start = bench::now();
+        }
+        memcpy(buffer.ptrEnd(block), in.data(), sizeof(float) * 2 * block);
+        buffer.putSamples(block);
+        buffer.receiveSamples(out.data(), block);
+    }
+
+    result.nsPerFrame = (bench::now() - start) * 1e9 / ((double)blocks * block);
+    result.movedPerFrame = (double)bench::counters.movedBytes / ((double)blocks * block);
+    result.allocations = bench::counters.allocations;
+    return result;
+}
+
+
+// Stretches 20 s of stereo in 512-frame blocks, counting from after the first
+// second. Returns the moves and allocations per output frame, and the time
+// per second of output in 'nsPerFrame'.
+static Traffic pipeTraffic(double tempo, double pitch)
+{
+    const int block = 512;
+    SoundTouch st;
+    std::vector<float> in = bench::music(44100, 1), out(2 * 8192);
+    double produced = 0;
+    double start = 0;
+    Traffic result;
+
+    st.setChannels(2);
+    st.setSampleRate(44100);
+    st.setTempo(tempo);
+    st.setPitch(pitch);
+
+    for (int b = 0; b < 44100 * 21 / block; b ++)
+    {
+        uint n;
+
+        if (b == 44100 / block)
+        {
+            bench::counters.reset();
+            produced = 0;
+            start = bench::now();
+        }
+        st.putSamples(in.data() + (size_t)2 * block * (b % (44100 / block)), block);
+        while ((n = st.receiveSamples(out.data(), 8192)) != 0) produced += n;
+    }
+
+    result.nsPerFrame = (bench::now() - start) * 1e9 / produced;
+    result.movedPerFrame = bench::counters.movedBytes / produced;
+    result.allocations = bench::counters.allocations;
+    return result;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool timing = !bench::checkOnly(argc, argv);
+    int failures = 0;
+
+#ifdef SOUNDTOUCH_NO_MIRRORED_RING
+    printf("FIFOSampleBuffer with copy-on-wrap:\n");
+#else
+    printf("FIFOSampleBuffer, mirrored where the platform allows:\n");
+#endif
+
+    for (int channels = 1; channels <= 3; channels ++)
+    {
+        failures += !bench::check(compareWithDeque(channels, timing ? MODEL_STEPS : MODEL_STEPS / 4),
+                                  "%d channel(s) match a deque over random puts and receives", channels);
+    }
+    {
+        Traffic t = steadyTraffic(16384, 4000);
+        failures += !bench::check(t.allocations == 0, "no allocations once warmed up (%llu)", t.allocations);
+    }
+
+    if (timing)
+    {
+        static const uint backlogs[] = { 512, 4096, 16384 };
+        static const double settings[][2] = { { 0.8, 1.0 }, { 1.25, 1.0 }, { 1.0, 1.06 } };
+
+        printf("256-frame stereo put/receive, best of 5:\n");
+        for (uint backlog : backlogs)
+        {
+            Traffic best = steadyTraffic(backlog, 200000);
+            for (int rep = 1; rep < 5; rep ++)
+            {
+                Traffic t = steadyTraffic(backlog, 200000);
+                if (t.nsPerFrame < best.nsPerFrame) best = t;
+            }
+            printf("  backlog %5u: %5.2f ns/frame, moved %5.2f bytes/frame, %llu allocations\n",
+                   backlog, best.nsPerFrame, best.movedPerFrame, best.allocations);
+        }
+
+        printf("SoundTouch, 512-frame stereo blocks at 44.1 kHz:\n");
+        for (const auto &s : settings)
+        {
+            Traffic t = pipeTraffic(s[0], s[1]);
+            printf("  tempo %.2f pitch %.2f: %6.1f ns/output frame, moved %5.2f bytes/output frame, %llu allocations\n",
+                   s[0], s[1], t.nsPerFrame, t.movedPerFrame, t.allocations);
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Checks that SoundTouch gives bit-identical output with and without stage
+/// fusion (SETTING_USE_STAGE_FUSION), including while the rate sweeps across
+/// 1.0. Then times each stage on its own and the whole pipe both ways,
+/// counting the bytes the FIFO buffers copy per output frame.
+///
+///   FusionBench            checks and benchmark
+///   FusionBench --check    checks only
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "SoundTouch.h"
+#include "RateTransposer.h"
+#include "TDStretch.h"
+#include "BenchTools.h"
+
+using namespace soundtouch;
+
+#define SAMPLE_RATE     44100
+#define BLOCK           512
+
+
+struct Throughput
+{
+    double nsPerFrame;          ///< time per output frame
+    double copiedPerFrame;      ///< bytes copied by putSamples/receiveSamples per output frame
+    double movedPerFrame;       ///< bytes moved within the buffers per output frame
+};
+
+
+// Feeds 'seconds' of 'in' to 'pipe' in BLOCK-frame blocks and collects what
+// comes out, flushing at the end if 'st' is given. With 'sweep' the rate
+// switches between 0.9 and 1.1 every 40 blocks. Counts from the second
+// second if there are more than two.
+static Throughput run(FIFOSamplePipe *pipe, SoundTouch *st, const std::vector<float> &in, int seconds,
+                      bool sweep, std::vector<float> *out)
+{
+    const int blocksPerSecond = SAMPLE_RATE / BLOCK;
+    std::vector<float> buffer(2 * 8192);
+    double produced = 0;
+    double start = bench::now();
+    Throughput result;
+    uint n;
+
+    bench::counters.reset();
+    for (int b = 0; b < seconds * blocksPerSecond; b ++)
+    {
+        if (b == blocksPerSecond && seconds > 2)
+        {
+            bench::counters.reset();
+            produced = 0;
+            start = bench::now();
+        }
+        if (sweep && st && b % 40 == 0)
+        {
+            st->setRate(((b / 40) & 1) ? 1.1 : 0.9);
+        }
+
+        pipe->putSamples(in.data() + (size_t)2 * BLOCK * (b % blocksPerSecond), BLOCK);
+        while ((n = pipe->receiveSamples(buffer.data(), 8192)) != 0)
+        {
+            produced += n;
+            if (out) out->insert(out->end(), buffer.begin(), buffer.begin() + 2 * n);
+        }
+    }
+    if (st && out)
+    {
+        st->flush();
+        while ((n = st->receiveSamples(buffer.data(), 8192)) != 0)
+        {
+            out->insert(out->end(), buffer.begin(), buffer.begin() + 2 * n);
+        }
+    }
+
+    result.nsPerFrame = (bench::now() - start) * 1e9 / produced;
+    result.copiedPerFrame = bench::counters.copiedBytes / produced;
+    result.movedPerFrame = bench::counters.movedBytes / produced;
+    return result;
+}
+
+
+// Stereo SoundTouch at 'rate' and 'tempo', fused or not
+static SoundTouch *newSoundTouch(double rate, double tempo, bool fuse)
+{
+    SoundTouch *st = new SoundTouch();
+
+    st->setChannels(2);
+    st->setSampleRate(SAMPLE_RATE);
+    st->setRate(rate);
+    st->setTempo(tempo);
+    st->setSetting(SETTING_USE_STAGE_FUSION, fuse);
+    return st;
+}
+
+
+// Runs the pipe fused and unfused over 'seconds' of 'in'. Returns true if the
+// outputs are bit-identical.
+static bool compareFusion(double rate, double tempo, bool sweep, const std::vector<float> &in, int seconds)
+{
+    std::vector<float> out[2];
+
+    for (int fuse = 0; fuse < 2; fuse ++)
+    {
+        SoundTouch *st = newSoundTouch(rate, tempo, fuse != 0);
+        run(st, st, in, seconds, sweep, &out[fuse]);
+        delete st;
+    }
+    return !out[0].empty() && out[0].size() == out[1].size() &&
+           memcmp(out[0].data(), out[1].data(), sizeof(float) * out[0].size()) == 0;
+}
+
+
+// Fastest of five runs of 'seconds' through 'pipe'
+static Throughput bestOfFive(FIFOSamplePipe *pipe, SoundTouch *st, const std::vector<float> &in, int seconds)
+{
+    Throughput best = run(pipe, st, in, seconds, false, NULL);
+
+    for (int i = 1; i < 5; i ++)
+    {
+        Throughput t = run(pipe, st, in, seconds, false, NULL);
+        if (t.nsPerFrame < best.nsPerFrame) best = t;
+    }
+    return best;
+}
+
+
+static void printThroughput(const char *name, const Throughput &t)
+{
+    printf("  %-28s %6.1f ns/frame   copied %5.1f   moved %4.1f bytes/output frame\n",
+           name, t.nsPerFrame, t.copiedPerFrame, t.movedPerFrame);
+}
+
+
+int main(int argc, char **argv)
+{
+    bool timing = !bench::checkOnly(argc, argv);
+    std::vector<float> in = bench::music(SAMPLE_RATE, 1);
+    static const double rates[] = { 0.85, 1.0, 1.2 };
+    static const double tempos[] = { 0.8, 1.1 };
+    int failures = 0;
+
+    for (double rate : rates)
+    {
+        for (double tempo : tempos)
+        {
+            for (int sweep = 0; sweep < 2; sweep ++)
+            {
+                failures += !bench::check(compareFusion(rate, tempo, sweep != 0, in, 10),
+                                          "rate %.2f tempo %.2f%s: fused output is bit-identical",
+                                          rate, tempo, sweep ? " swept across 1.0" : "");
+            }
+        }
+    }
+
+    if (timing)
+    {
+        const int seconds = 20;
+        char name[64];
+
+        printf("stages on their own, stereo, %d-frame blocks, best of 5:\n", BLOCK);
+        {
+            RateTransposer *rt = new RateTransposer();
+            rt->setChannels(2);
+            rt->setRate(0.85);
+            printThroughput("RateTransposer rate 0.85", bestOfFive(rt, NULL, in, seconds));
+            rt->setRate(1.2);
+            printThroughput("RateTransposer rate 1.20", bestOfFive(rt, NULL, in, seconds));
+            delete rt;
+        }
+        {
+            TDStretch *td = TDStretch::newInstance();
+            td->setChannels(2);
+            td->setParameters(SAMPLE_RATE);
+            td->setTempo(1.1);
+            printThroughput("TDStretch tempo 1.10", bestOfFive(td, NULL, in, seconds));
+            delete td;
+        }
+
+        printf("SoundTouch, stereo, %d-frame blocks, tempo 1.10, best of 5:\n", BLOCK);
+        for (double rate : { 0.85, 1.2 })
+        {
+            for (int fuse = 0; fuse < 2; fuse ++)
+            {
+                SoundTouch *st = newSoundTouch(rate, 1.1, fuse != 0);
+                snprintf(name, sizeof(name), "rate %.2f %s", rate, fuse ? "fused" : "unfused");
+                printThroughput(name, bestOfFive(st, st, in, seconds));
+                delete st;
+            }
+        }
+    }
+
+    return failures ? 1 : 0;
+}
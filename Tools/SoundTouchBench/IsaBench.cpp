@@ -0,0 +1,287 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Checks and times the SIMD kernels that TDStretch::newInstance and
+/// FIRFilter::newInstance pick between. Each of the SSE, AVX2+FMA and AVX-512
+/// versions that the CPU supports is compared against the plain C one, then
+/// the whole SoundTouch pipe is timed with the extensions above each level
+/// disabled.
+///
+///   IsaBench            checks and benchmark
+///   IsaBench --check    checks only
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "SoundTouch.h"
+#include "TDStretch.h"
+#include "FIRFilter.h"
+#include "cpu_detect.h"
+#include "BenchTools.h"
+
+using namespace soundtouch;
+
+// Largest differences from the plain C results that count as a match: relative
+// for the normalized correlation, absolute for the filter output. The SIMD
+// correlations sum in a different order, which alone gives about 1e-4.
+#define CORR_TOLERANCE  5e-4
+#define FIR_TOLERANCE   1e-6
+
+// Seek window and overlap of the correlation test, about the defaults at 44.1 kHz
+#define SEEK_POSITIONS  1200
+#define OVERLAP_LENGTH  352
+
+#define FIR_TAPS        64
+#define FIR_FRAMES      8192
+
+
+/// Exposes the protected correlation routines of TDStretch class 'Base'
+template <class Base> class CorrelationKernel : public Base
+{
+public:
+    CorrelationKernel()
+    {
+        this->setChannels(2);
+        this->overlapLength = OVERLAP_LENGTH;
+    }
+
+    /// Correlates 'compare' against SEEK_POSITIONS positions of 'ref' the way the
+    /// full search does, first with calcCrossCorr and then with the accumulating
+    /// version. Returns the time per position of each.
+    void correlate(const float *ref, const float *compare, int reps,
+                   std::vector<double> &full, std::vector<double> &accumulated,
+                   double &fullTime, double &accumulatedTime)
+    {
+        double norm, start;
+
+        full.resize(SEEK_POSITIONS);
+        accumulated.resize(SEEK_POSITIONS);
+
+        start = bench::now();
+        for (int r = 0; r < reps; r ++)
+        {
+            for (int i = 0; i < SEEK_POSITIONS; i ++)
+            {
+                full[i] = this->calcCrossCorr(ref + 2 * i, compare, norm);
+            }
+        }
+        fullTime = (bench::now() - start) / (reps * SEEK_POSITIONS);
+
+        start = bench::now();
+        for (int r = 0; r < reps; r ++)
+        {
+            accumulated[0] = this->calcCrossCorr(ref, compare, norm);
+            for (int i = 1; i < SEEK_POSITIONS; i ++)
+            {
+                accumulated[i] = this->calcCrossCorrAccumulate(ref + 2 * i, compare, norm);
+            }
+        }
+        accumulatedTime = (bench::now() - start) / (reps * SEEK_POSITIONS);
+    }
+};
+
+
+/// Exposes the protected stereo routine of FIRFilter class 'Base'
+template <class Base> class FilterKernel : public Base
+{
+public:
+    FilterKernel()
+    {
+        float coeffs[FIR_TAPS];
+
+        for (int i = 0; i < FIR_TAPS; i ++)
+        {
+            coeffs[i] = (float)(sin(0.1 * (i + 1)) / (i + 1));
+        }
+        // the coefficients are scaled by the result divider set by the previous
+        // call, so the first call only sets that up
+        this->setCoefficients(coeffs, FIR_TAPS, 0);
+        this->setCoefficients(coeffs, FIR_TAPS, 0);
+    }
+
+    /// Filters FIR_FRAMES stereo frames 'reps' times. Returns the time per frame.
+    double filter(const float *src, std::vector<float> &dest, int reps)
+    {
+        uint done = 0;
+        double start;
+
+        dest.resize(2 * FIR_FRAMES);
+        start = bench::now();
+        for (int r = 0; r < reps; r ++)
+        {
+            done = this->evaluateFilterStereo(dest.data(), src, FIR_FRAMES);
+        }
+        dest.resize(2 * done);
+        return (bench::now() - start) / (reps * (double)done);
+    }
+};
+
+
+// Largest of |a[i] - b[i]| / (|b[i]| + floor)
+static double maxRelError(const std::vector<double> &a, const std::vector<double> &b, double floor)
+{
+    double err = 0;
+
+    if (a.size() != b.size()) return 1e30;
+    for (size_t i = 0; i < a.size(); i ++)
+    {
+        double e = fabs(a[i] - b[i]) / (fabs(b[i]) + floor);
+        if (!(e <= err)) err = e;      // NaN sticks
+    }
+    return err;
+}
+
+
+// Largest of |a[i] - b[i]|
+static double maxAbsError(const std::vector<float> &a, const std::vector<float> &b)
+{
+    double err = 0;
+
+    if (a.size() != b.size()) return 1e30;
+    for (size_t i = 0; i < a.size(); i ++)
+    {
+        double e = fabs((double)a[i] - b[i]);
+        if (!(e <= err)) err = e;      // NaN sticks
+    }
+    return err;
+}
+
+
+struct Reference
+{
+    std::vector<double> full, accumulated;
+    std::vector<float> filtered;
+};
+
+
+// Checks and times one level of kernels against the plain C results in 'ref'.
+// The plain C level fills in 'ref'. Returns the number of failed checks.
+template <class Stretch, class Filter> static int testLevel(const char *name, const std::vector<float> &sig,
+                                                            Reference &ref, bool timing)
+{
+    // the classes' own operator new refuses to make anything but what
+    // newInstance picks
+    CorrelationKernel<Stretch> *td = ::new CorrelationKernel<Stretch>();
+    FilterKernel<Filter> *fir = ::new FilterKernel<Filter>();
+    std::vector<double> full, accumulated;
+    std::vector<float> filtered;
+    double fullTime, accumulatedTime, firTime;
+    int failures = 0;
+    int reps = timing ? 200 : 1;
+
+    td->correlate(sig.data() + 2, sig.data() + 100000, reps, full, accumulated, fullTime, accumulatedTime);
+    firTime = fir->filter(sig.data(), filtered, timing ? 400 : 1);
+
+    if (ref.full.empty())
+    {
+        ref.full = full;
+        ref.accumulated = accumulated;
+        ref.filtered = filtered;
+    }
+    else
+    {
+        double e;
+
+        // correlations near zero are compared in absolute terms
+        e = maxRelError(full, ref.full, 1e-3);
+        failures += !bench::check(e <= CORR_TOLERANCE, "%-8s calcCrossCorr            max rel error %.1e", name, e);
+        e = maxRelError(accumulated, ref.accumulated, 1e-3);
+        failures += !bench::check(e <= CORR_TOLERANCE, "%-8s calcCrossCorrAccumulate  max rel error %.1e", name, e);
+        e = maxAbsError(filtered, ref.filtered);
+        failures += !bench::check(e <= FIR_TOLERANCE, "%-8s evaluateFilterStereo     max abs error %.1e", name, e);
+    }
+
+    if (timing)
+    {
+        printf("  %-8s calcCrossCorr %6.1f ns  calcCrossCorrAccumulate %6.1f ns  FIR %d taps %5.1f ns/frame\n",
+               name, fullTime * 1e9, accumulatedTime * 1e9, FIR_TAPS, firTime * 1e9);
+    }
+
+    delete td;
+    delete fir;
+    return failures;
+}
+
+
+// Stretches a minute of stereo with the given extensions disabled. Returns the
+// time taken in milliseconds.
+static double timePipe(uint disable, double tempo, double rate, const std::vector<float> &in)
+{
+    SoundTouch *st;
+    std::vector<float> out(2 * 16384);
+    const int block = 4096;
+    double start, elapsed;
+
+    // the kernels are picked when the stages are created
+    disableExtensions(disable);
+    st = new SoundTouch();
+    disableExtensions(0);
+
+    st->setChannels(2);
+    st->setSampleRate(44100);
+    st->setTempo(tempo);
+    st->setRate(rate);
+
+    start = bench::now();
+    for (int b = 0; b < 44100 * 60 / block; b ++)
+    {
+        st->putSamples(in.data() + (size_t)2 * block * (b % 8), block);
+        while (st->receiveSamples(out.data(), 16384) > 0) {}
+    }
+    elapsed = bench::now() - start;
+
+    delete st;
+    return elapsed * 1000;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool timing = !bench::checkOnly(argc, argv);
+    uint ext = detectCPUextensions();
+    std::vector<float> sig = bench::noise(200000, 2, 0.3f);
+    Reference ref;
+    int failures = 0;
+
+    printf("CPU: %s%s%s%s%s\n", (ext & SUPPORT_SSE) ? "SSE " : "", (ext & SUPPORT_AVX) ? "AVX " : "",
+           (ext & SUPPORT_AVX2) ? "AVX2 " : "", (ext & SUPPORT_FMA) ? "FMA " : "",
+           (ext & SUPPORT_AVX512F) ? "AVX512F" : "");
+
+    printf("kernels against plain C:\n");
+    failures += testLevel<TDStretch, FIRFilter>("C", sig, ref, timing);
+#ifdef SOUNDTOUCH_ALLOW_SSE
+    if (ext & SUPPORT_SSE)
+    {
+        failures += testLevel<TDStretchSSE, FIRFilterSSE>("SSE", sig, ref, timing);
+    }
+#endif
+#ifdef SOUNDTOUCH_ALLOW_AVX
+    if ((ext & SUPPORT_AVX2) && (ext & SUPPORT_FMA))
+    {
+        failures += testLevel<TDStretchAVX, FIRFilterAVX>("AVX2+FMA", sig, ref, timing);
+    }
+    if (ext & SUPPORT_AVX512F)
+    {
+        failures += testLevel<TDStretchAVX512, FIRFilterAVX512>("AVX-512", sig, ref, timing);
+    }
+#endif
+
+    if (timing)
+    {
+        static const struct { const char *name; uint needs; uint disable; } levels[] =
+        {
+            { "C",        0,                          0xffffffff },
+            { "SSE",      SUPPORT_SSE,                SUPPORT_AVX | SUPPORT_AVX2 | SUPPORT_FMA | SUPPORT_AVX512F },
+            { "AVX2+FMA", SUPPORT_AVX2 | SUPPORT_FMA, SUPPORT_AVX512F },
+            { "AVX-512",  SUPPORT_AVX512F,            0 },
+        };
+
+        printf("SoundTouch, 60 s of stereo at 44.1 kHz:\n");
+        for (const auto &level : levels)
+        {
+            if ((ext & level.needs) != level.needs) continue;
+            printf("  %-8s tempo 1.25 %6.1f ms   rate 1.1 %6.1f ms\n", level.name,
+                   timePipe(level.disable, 1.25, 1.0, sig), timePipe(level.disable, 1.0, 1.1, sig));
+        }
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Compares the TDStretch overlap searches against the direct full search, on
+/// synthetic music: how often each finds the same offset, how much weighted
+/// correlation it loses where it doesn't, and how long it takes. Also shows
+/// which full search the cost model in isFFTSeekCheaper picks. The quick and
+/// hierarchical searches trade some of that correlation for speed.
+///
+///   SeekBench            checks and benchmark
+///   SeekBench --check    checks only
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "TDStretch.h"
+#include "cpu_detect.h"
+#include "BenchTools.h"
+
+using namespace soundtouch;
+
+// Seconds of test signal, and how many random searches are compared per row
+#define SIGNAL_SECONDS  20
+#define SEARCHES        1000
+#define CHECK_SEARCHES  200
+
+// The FFT search has to find the full search's offset this often, and lose
+// no more than this much where it doesn't (ties within float rounding)
+#define FFT_MIN_SAME    0.99
+#define FFT_MAX_LOSS    1e-4
+
+// Mean loss the hierarchical search may have on music
+#define HIERARCHICAL_MAX_MEAN_LOSS  1e-3
+
+
+enum SearchMethod
+{
+    SEARCH_FULL,
+    SEARCH_FFT,
+    SEARCH_QUICK,
+    SEARCH_HIERARCHICAL,
+    NUM_SEARCH_METHODS
+};
+
+static const char *methodNames[NUM_SEARCH_METHODS] = { "full", "FFT", "quick", "hierarchical" };
+
+
+/// Exposes the search routines of TDStretch class 'Base'
+template <class Base> class SeekTester : public Base
+{
+public:
+    void prepare(int numChannels, int sampleRate, double tempo)
+    {
+        this->setChannels(numChannels);
+        this->setParameters(sampleRate);
+        this->setTempo(tempo);
+    }
+
+    int getSeekLength() const { return this->seekLength; }
+    int getOverlapLength() const { return this->overlapLength; }
+    bool prefersFFT() const { return this->isFFTSeekCheaper(); }
+
+    /// Sets the sequence the searches look for, as the end of the previous one
+    void setMid(const float *samples)
+    {
+        memcpy(this->pMidBuffer, samples, sizeof(float) * this->channels * this->overlapLength);
+    }
+
+    const float *getMid() const { return this->pMidBuffer; }
+
+    int search(SearchMethod method, const float *refPos)
+    {
+        switch (method)
+        {
+            case SEARCH_FFT:          return this->seekBestOverlapPositionFFT(refPos);
+            case SEARCH_QUICK:        return this->seekBestOverlapPositionQuick(refPos);
+            case SEARCH_HIERARCHICAL: return this->seekBestOverlapPositionHierarchical(refPos);
+            default:                  return this->seekBestOverlapPositionFull(refPos);
+        }
+    }
+};
+
+
+// Weighted correlation score of 'offset', as the full search rates it, in double
+static double score(const float *refPos, const float *mid, int channels, int overlapLength,
+                    int seekLength, int offset)
+{
+    const float *p = refPos + channels * offset;
+    double corr = 0, norm = 0, t;
+
+    for (int k = 0; k < channels * overlapLength; k ++)
+    {
+        corr += (double)p[k] * mid[k];
+        norm += (double)p[k] * p[k];
+    }
+    corr /= sqrt(norm < 1e-9 ? 1.0 : norm);
+
+    if (offset == 0) return (corr + 0.1) * 0.75;
+    t = (double)(2 * offset - seekLength) / seekLength;
+    return (corr + 0.1) * (1.0 - 0.25 * t * t);
+}
+
+
+struct SearchStats
+{
+    int same;
+    double meanLoss;
+    double worstLoss;
+    double time;
+};
+
+
+// Runs 'searches' random searches with every method on 'sig' and compares them
+// with the full search; times each method too if 'timing' is set
+template <class Base> static void measure(SeekTester<Base> *td, const std::vector<float> &sig, int channels,
+                                          int sampleRate, double tempo, int searches, bool timing,
+                                          SearchStats stats[NUM_SEARCH_METHODS])
+{
+    int seekLength = td->getSeekLength();
+    int overlapLength = td->getOverlapLength();
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> position(sampleRate, (SIGNAL_SECONDS - 2) * sampleRate);
+
+    memset(stats, 0, sizeof(SearchStats) * NUM_SEARCH_METHODS);
+
+    for (int s = 0; s < searches; s ++)
+    {
+        int pos = position(rng);
+        const float *refPos = sig.data() + (size_t)channels * pos;
+        double best;
+        int full;
+
+        // the mid buffer comes from roughly one sequence earlier
+        td->setMid(sig.data() + (size_t)channels * (pos - (int)(0.04 * sampleRate * tempo)));
+        full = td->search(SEARCH_FULL, refPos);
+        best = score(refPos, td->getMid(), channels, overlapLength, seekLength, full);
+
+        for (int m = 0; m < NUM_SEARCH_METHODS; m ++)
+        {
+            int offset = td->search((SearchMethod)m, refPos);
+            double loss;
+
+            loss = (best - score(refPos, td->getMid(), channels, overlapLength, seekLength, offset)) / best;
+            if (offset == full) stats[m].same ++;
+            stats[m].meanLoss += loss / searches;
+            if (loss > stats[m].worstLoss) stats[m].worstLoss = loss;
+        }
+    }
+
+    if (!timing) return;
+
+    for (int m = 0; m < NUM_SEARCH_METHODS; m ++)
+    {
+        const int reps = 400;
+        volatile int sink = 0;
+        double start = bench::now();
+
+        for (int r = 0; r < reps; r ++)
+        {
+            sink += td->search((SearchMethod)m, sig.data() + (size_t)channels * (sampleRate + 37 * r));
+        }
+        stats[m].time = (bench::now() - start) / reps;
+    }
+}
+
+
+// Compares and times the searches with the correlation kernels of 'Base'.
+// Returns the number of failed checks.
+template <class Base> static int testKernel(const char *name, bool timing)
+{
+    static const int rates[] = { 44100, 96000 };
+    static const double tempos[] = { 1.0, 1.25 };
+    int failures = 0;
+
+    for (int channels = 1; channels <= 2; channels ++)
+    {
+        for (int sampleRate : rates)
+        {
+            std::vector<float> sig = bench::music(sampleRate, SIGNAL_SECONDS, channels);
+
+            for (double tempo : tempos)
+            {
+                SeekTester<Base> *td;
+                SearchStats stats[NUM_SEARCH_METHODS];
+                int searches = timing ? SEARCHES : CHECK_SEARCHES;
+
+                // the checks only need one rate and tempo
+                if (!timing && (sampleRate != 44100 || tempo != 1.0)) continue;
+
+                td = ::new SeekTester<Base>();      // see IsaBench
+                td->prepare(channels, sampleRate, tempo);
+                measure(td, sig, channels, sampleRate, tempo, searches, timing, stats);
+
+                printf("%s, %d ch, %d Hz, tempo %.2f, seek %d, overlap %d:\n", name, channels, sampleRate,
+                       tempo, td->getSeekLength(), td->getOverlapLength());
+                for (int m = 0; m < NUM_SEARCH_METHODS; m ++)
+                {
+                    printf("  %-14s", methodNames[m]);
+                    if (timing) printf(" %8.1f us", stats[m].time * 1e6);
+                    printf("   same %5.1f%%   mean loss %.1e   worst %.1e\n", 100.0 * stats[m].same / searches,
+                           stats[m].meanLoss, stats[m].worstLoss);
+                }
+                if (timing)
+                {
+                    bool fftFaster = stats[SEARCH_FFT].time < stats[SEARCH_FULL].time;
+                    printf("  cost model picks %s, %s\n", td->prefersFFT() ? "FFT" : "direct",
+                           (fftFaster == td->prefersFFT()) ? "the faster one" : "the slower one");
+                }
+
+                failures += !bench::check(stats[SEARCH_FFT].same >= FFT_MIN_SAME * searches &&
+                                          stats[SEARCH_FFT].worstLoss <= FFT_MAX_LOSS,
+                                          "FFT search matches the full search");
+                failures += !bench::check(stats[SEARCH_HIERARCHICAL].meanLoss <= HIERARCHICAL_MAX_MEAN_LOSS,
+                                          "hierarchical search loses %.1e on average",
+                                          stats[SEARCH_HIERARCHICAL].meanLoss);
+                delete td;
+            }
+        }
+    }
+    return failures;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool timing = !bench::checkOnly(argc, argv);
+    uint ext = detectCPUextensions();
+    int failures = 0;
+
+    failures += testKernel<TDStretch>("C kernels", timing);
+#if defined(SOUNDTOUCH_ALLOW_AVX)
+    if (ext & SUPPORT_AVX512F)
+    {
+        failures += testKernel<TDStretchAVX512>("AVX-512 kernels", timing);
+    }
+    else if ((ext & SUPPORT_AVX2) && (ext & SUPPORT_FMA))
+    {
+        failures += testKernel<TDStretchAVX>("AVX2 kernels", timing);
+    }
+    else if (ext & SUPPORT_SSE)
+    {
+        failures += testKernel<TDStretchSSE>("SSE kernels", timing);
+    }
+#elif defined(SOUNDTOUCH_ALLOW_SSE)
+    if (ext & SUPPORT_SSE)
+    {
+        failures += testKernel<TDStretchSSE>("SSE kernels", timing);
+    }
+#endif
+    (void)ext;
+
+    return failures ? 1 : 0;
+}